@@ -0,0 +1,40 @@
+import * as std from "std";
+import { RTCPeerConnection } from "webrtc";
+
+// Connects two peers inside the same process, exchanges one message over a
+// data channel and exits.
+
+const offerer = new RTCPeerConnection();
+const answerer = new RTCPeerConnection();
+
+answerer.ondatachannel = (channel) => {
+    channel.onmessage = (msg) => {
+        console.log('Answerer got:', msg);
+        channel.send('pong');
+    };
+    globalThis.answererChannel = channel;
+};
+
+answerer.onicegatheringstatechange = (state) => {
+    if (state == "complete")
+        offerer.setRemoteDescription(answerer.localDescription);
+};
+
+offerer.onicegatheringstatechange = (state) => {
+    if (state == "complete") {
+        answerer.setRemoteDescription(offerer.localDescription);
+        answerer.createAnswer();
+    }
+};
+
+const channel = offerer.createDataChannel('static-host');
+channel.onopen = () => channel.send('ping');
+channel.onmessage = (msg) => {
+    console.log('Offerer got:', msg);
+    channel.close();
+    offerer.close();
+    answerer.close();
+    std.exit(0);
+};
+
+offerer.createOffer();
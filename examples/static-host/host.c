@@ -0,0 +1,60 @@
+// Minimal QuickJS host with the WebRTC module linked in statically. It runs
+// the application bytecode compiled by qjsc at build time, so nothing is
+// parsed or dlopen'ed at startup.
+#include <quickjs/quickjs.h>
+#include <quickjs/quickjs-libc.h>
+#include <stdio.h>
+#include <string.h>
+#include "webrtc-js-client.h"
+
+extern const uint8_t qjsc_app[];
+extern const uint32_t qjsc_app_size;
+
+// The module polls its event pipe through os.setReadHandler on the global
+// object, which qjs only sets up with --std
+static const char stdGlobals[] =
+    "import * as std from 'std';\n"
+    "import * as os from 'os';\n"
+    "globalThis.std = std;\n"
+    "globalThis.os = os;\n";
+
+static int evalModule(JSContext *ctx, const char *src, const char *filename) {
+    JSValue val = JS_Eval(ctx, src, strlen(src), filename, JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
+    if (!JS_IsException(val)) {
+        js_module_set_import_meta(ctx, val, 0, 1);
+        val = JS_EvalFunction(ctx, val);
+    }
+    if (JS_IsException(val)) {
+        js_std_dump_error(ctx);
+        return -1;
+    }
+    JS_FreeValue(ctx, val);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    JSRuntime *rt = JS_NewRuntime();
+    if (rt == NULL) {
+        fprintf(stderr, "Cannot allocate JS runtime\n");
+        return 1;
+    }
+    js_std_init_handlers(rt);
+    JS_SetModuleLoaderFunc(rt, NULL, js_module_loader, NULL);
+    JSContext *ctx = JS_NewContext(rt);
+    if (ctx == NULL) {
+        fprintf(stderr, "Cannot allocate JS context\n");
+        return 1;
+    }
+    js_init_module_std(ctx, "std");
+    js_init_module_os(ctx, "os");
+    js_init_module_webrtc_client(ctx, "webrtc");
+    js_std_add_helpers(ctx, argc - 1, argv + 1);
+    if (evalModule(ctx, stdGlobals, "<globals>") < 0)
+        return 1;
+    js_std_eval_binary(ctx, qjsc_app, qjsc_app_size, 0);
+    js_std_loop(ctx);
+    js_std_free_handlers(rt);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+    return 0;
+}
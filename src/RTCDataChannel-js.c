@@ -1,12 +1,28 @@
 #include "RTCDataChannel-js.h"
 #include "RTCDataChannelBase-js.h"
+#include "task-queue.h"
 #include <rtc/rtc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
-static void RTCDataChannel_Finalizer(JSRuntime *rt, JSValue val) {
-    int channelId = getRTCDataChannelId(val);
+typedef struct {
+    channelCodec *codec;
+    int incoming;
+} RTCDataChannel_InitArg;
+
+static void closeOnWorker(void *opaque) {
+    int channelId = (int)(intptr_t)opaque;
+    rtcClose(channelId);
     rtcDeleteDataChannel(channelId);
 }
 
+// Encoded and coalesced sends still wait on the worker thread, the channel
+// goes away behind them
+static void RTCDataChannel_close(int channelId, void *opaque) {
+    taskQueuePost(closeOnWorker, (void *)(intptr_t)channelId);
+}
+
 static JSValue RTCDataChannel_getLabel(JSContext *ctx, JSValueConst this_val) {
     int channelId = getRTCDataChannelId(this_val);
     int labelLen = rtcGetDataChannelLabel(channelId, NULL, 0);
@@ -17,12 +33,169 @@ static JSValue RTCDataChannel_getLabel(JSContext *ctx, JSValueConst this_val) {
     return JS_NewString(ctx, label); 
 }
 
+static JSValue RTCDataChannel_getId(JSContext *ctx, JSValueConst this_val) {
+    int channelId = getRTCDataChannelId(this_val);
+    int stream = rtcGetDataChannelStream(channelId);
+    if (stream < 0)
+        return JS_NULL; // not assigned until the transport is up
+    return JS_NewInt32(ctx, stream);
+}
+
+static JSValue RTCDataChannel_getOrdered(JSContext *ctx, JSValueConst this_val) {
+    int channelId = getRTCDataChannelId(this_val);
+    rtcReliability reliability;
+    if (rtcGetDataChannelReliability(channelId, &reliability) < 0)
+        return JS_ThrowInternalError(ctx, "Error getting data channel reliability");
+    return JS_NewBool(ctx, !reliability.unordered);
+}
+
+// coalesce: {interval, maxBytes}, interval in ms
+static JSValue fromJsCoalesceConfig(JSContext *ctx, JSValueConst val, channelCodecConfig *config) {
+    JSValue coalesceVal = JS_GetPropertyStr(ctx, val, "coalesce");
+    JSValue intervalVal = JS_UNDEFINED, maxBytesVal = JS_UNDEFINED;
+    JSValue ret = JS_UNDEFINED;
+    config->coalesceMaxBytes = CHANNEL_CODEC_DEFAULT_COALESCE_BYTES;
+    if (JS_IsObject(coalesceVal)) {
+        intervalVal = JS_GetPropertyStr(ctx, coalesceVal, "interval");
+        maxBytesVal = JS_GetPropertyStr(ctx, coalesceVal, "maxBytes");
+        if (!JS_IsNumber(intervalVal) || JS_ToUint32(ctx, &config->coalesceIntervalMs, intervalVal)
+            || config->coalesceIntervalMs == 0)
+            ret = JS_ThrowRangeError(ctx, "The coalesce interval should be a positive number of ms");
+        else if (!JS_IsUndefined(maxBytesVal) && (!JS_IsNumber(maxBytesVal)
+            || JS_ToUint32(ctx, &config->coalesceMaxBytes, maxBytesVal)
+            || config->coalesceMaxBytes == 0 || config->coalesceMaxBytes > CHANNEL_CODEC_MAX_MESSAGE))
+            ret = JS_ThrowRangeError(ctx, "Invalid coalesce maxBytes value");
+    } else if (!JS_IsUndefined(coalesceVal)) {
+        ret = JS_ThrowTypeError(ctx, "The coalesce option should be an object");
+    }
+    JS_FreeValue(ctx, intervalVal);
+    JS_FreeValue(ctx, maxBytesVal);
+    JS_FreeValue(ctx, coalesceVal);
+    return ret;
+}
+
+JSValue fromJsChannelCodecConfig(JSContext *ctx, JSValueConst val, channelCodecConfig *config) {
+    JSValue framedVal = JS_GetPropertyStr(ctx, val, "framed");
+    JSValue compressionVal = JS_GetPropertyStr(ctx, val, "compression");
+    JSValue thresholdVal = JS_GetPropertyStr(ctx, val, "compressionThreshold");
+    JSValue dictionaryVal = JS_GetPropertyStr(ctx, val, "compressionDictionary");
+    JSValue ret = JS_UNDEFINED;
+    const char *compression = NULL;
+    const uint8_t *dictionary = NULL;
+    size_t dictionaryLen;
+    memset(config, 0, sizeof(*config));
+    config->threshold = CHANNEL_CODEC_DEFAULT_THRESHOLD;
+    config->framed = JS_ToBool(ctx, framedVal);
+    if (!JS_IsUndefined(compressionVal)) {
+        compression = JS_IsString(compressionVal) ? JS_ToCString(ctx, compressionVal) : NULL;
+        if (compression && !strcmp(compression, "deflate"))
+            config->compression = CHANNEL_COMPRESSION_DEFLATE;
+        else if (compression == NULL || strcmp(compression, "none"))
+            ret = JS_ThrowTypeError(ctx, "Invalid compression value, expected 'deflate' or 'none'");
+    }
+    if (!JS_IsException(ret) && !JS_IsUndefined(thresholdVal)) {
+        if (!JS_IsNumber(thresholdVal) || JS_ToUint32(ctx, &config->threshold, thresholdVal))
+            ret = JS_ThrowRangeError(ctx, "Invalid compressionThreshold value");
+    }
+    if (!JS_IsException(ret) && !JS_IsUndefined(dictionaryVal)) {
+        if (JS_IsString(dictionaryVal))
+            dictionary = (const uint8_t *)JS_ToCStringLen(ctx, &dictionaryLen, dictionaryVal);
+        else
+            dictionary = JS_GetArrayBuffer(ctx, &dictionaryLen, dictionaryVal);
+        if (dictionary == NULL || dictionaryLen == 0) {
+            ret = JS_ThrowTypeError(ctx, "The compression dictionary should be a non empty string or ArrayBuffer");
+        } else {
+            config->dictionary = malloc(dictionaryLen);
+            memcpy(config->dictionary, dictionary, dictionaryLen);
+            config->dictionaryLen = dictionaryLen;
+        }
+        if (dictionary && JS_IsString(dictionaryVal))
+            JS_FreeCString(ctx, (const char *)dictionary);
+    }
+    JS_FreeCString(ctx, compression);
+    JS_FreeValue(ctx, framedVal);
+    JS_FreeValue(ctx, compressionVal);
+    JS_FreeValue(ctx, thresholdVal);
+    JS_FreeValue(ctx, dictionaryVal);
+    if (JS_IsException(ret))
+        return ret;
+    return fromJsCoalesceConfig(ctx, val, config);
+}
+
+static JSValue RTCDataChannel_setCompression(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    channelCodecConfig config;
+    if (argc == 0 || !JS_IsObject(argv[0]))
+        return JS_ThrowTypeError(ctx, "The compression options should be an object");
+    if (JS_IsException(fromJsChannelCodecConfig(ctx, argv[0], &config))) {
+        free(config.dictionary);
+        return JS_EXCEPTION;
+    }
+    if (!channelCodecConfigEnabled(&config)) {
+        free(config.dictionary);
+        return JS_ThrowTypeError(ctx, "Missing framed, compression or coalesce value");
+    }
+    channelCodec *codec = channelCodecCreate(&config);
+    if (codec == NULL)
+        return JS_ThrowInternalError(ctx, "Error creating the channel codec");
+    if (setRTCDataChannelCodec(this_val, codec) < 0) {
+        channelCodecRelease(codec);
+        return JS_ThrowTypeError(ctx, "Compression can only be set in ondatachannel, for a channel the peer frames");
+    }
+    return JS_UNDEFINED;
+}
+
 static JSCFunctionListEntry RTCDataChannel_Methods[] = {
-    JS_CGETSET_DEF("label", RTCDataChannel_getLabel, NULL)
+    JS_CFUNC_DEF("setCompression", 1, RTCDataChannel_setCompression),
+    JS_CGETSET_DEF("label", RTCDataChannel_getLabel, NULL),
+    JS_CGETSET_DEF("id", RTCDataChannel_getId, NULL),
+    JS_CGETSET_DEF("ordered", RTCDataChannel_getOrdered, NULL)
+};
+
+JSFullClassDef RTCDataChannel_Class = {
+    .def = {
+        .class_name = "RTCDataChannel",
+    },
+    .constructor = { NULL, 0 },
+    .funcs_len = sizeof(RTCDataChannel_Methods),
+    .funcs = RTCDataChannel_Methods
+};
+
+// The codec is in place before the first message can arrive
+static int RTCDataChannel_init(JSContext *ctx, JSValueConst obj, int channelId, void *opaque, const void *arg) {
+    const RTCDataChannel_InitArg *init = arg;
+    if (init->codec)
+        setRTCDataChannelCodec(obj, init->codec);
+    // setCompression() in ondatachannel may still replace the codec
+    if (init->codec && init->incoming)
+        holdRTCDataChannelMessages(obj);
+    return 0;
+}
+
+static const RTCDataChannelBase_Hooks RTCDataChannel_Hooks = {
+    .classDef = &RTCDataChannel_Class,
+    .init = RTCDataChannel_init,
+    .close = RTCDataChannel_close,
 };
 
-JSValue createRTCDataChannelClass(JSContext *ctx, int channelId) {
-    JSValue obj = createRTCDataChannelBaseClass(ctx, channelId, RTCDataChannel_Finalizer);
-    JS_SetPropertyFunctionList(ctx, obj, RTCDataChannel_Methods, countof(RTCDataChannel_Methods));
-    return obj;
-}
\ No newline at end of file
+JSValue createRTCDataChannelClass(JSContext *ctx, int channelId, channelCodec *codec, int incoming) {
+    RTCDataChannel_InitArg init = { .codec = codec, .incoming = incoming };
+    return createRTCDataChannelBaseClass(ctx, channelId, &RTCDataChannel_Hooks, &init);
+}
+
+// Framed channels carry CHANNEL_CODEC_PROTOCOL, the receiving side starts
+// with a codec that only frames
+channelCodec *createIncomingChannelCodec(int channelId) {
+    channelCodecConfig config = {
+        .framed = 1,
+        .threshold = CHANNEL_CODEC_DEFAULT_THRESHOLD,
+        .coalesceMaxBytes = CHANNEL_CODEC_DEFAULT_COALESCE_BYTES,
+    };
+    char protocol[sizeof(CHANNEL_CODEC_PROTOCOL)];
+    if (rtcGetDataChannelProtocol(channelId, protocol, sizeof(protocol)) < 0
+        || strcmp(protocol, CHANNEL_CODEC_PROTOCOL))
+        return NULL;
+    return channelCodecCreate(&config);
+}
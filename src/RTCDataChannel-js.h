@@ -2,8 +2,15 @@
 #define __RTC_DATA_CHANNEL_JS_H
 
 #include "js-utils.h"
+#include "channel-codec.h"
 
-//extern JSFullClassDef RTCDataChannel_Class;
-JSValue createRTCDataChannelClass(JSContext *ctx, int channelId);
+extern JSFullClassDef RTCDataChannel_Class;
+JSValue fromJsChannelCodecConfig(JSContext *ctx, JSValueConst val, channelCodecConfig *config);
+// Takes ownership of codec, which may be NULL. Incoming channels with a
+// codec hold their messages until ondatachannel returned, see
+// startRTCDataChannelMessages.
+JSValue createRTCDataChannelClass(JSContext *ctx, int channelId, channelCodec *codec, int incoming);
+// NULL unless the channel was opened with CHANNEL_CODEC_PROTOCOL
+channelCodec *createIncomingChannelCodec(int channelId);
 
 #endif
\ No newline at end of file
@@ -1,5 +1,18 @@
 #include "RTCDataChannelBase-js.h"
 #include "event-queue.h"
+#include "logger.h"
+#include "msgpack.h"
+#include "channel-codec.h"
+#include "channel-coalescer.h"
+#include "task-queue.h"
+#include "file-transfer.h"
+#include "net-impairment.h"
+#include "trace.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -9,6 +22,9 @@ enum {
     RTC_DATACHANNEL_EVENTS_ONOPEN,
     RTC_DATACHANNEL_EVENTS_ONCLOSE,
     RTC_DATACHANNEL_EVENTS_ONMESSAGE,
+    RTC_DATACHANNEL_EVENTS_ONVALUE,
+    RTC_DATACHANNEL_EVENTS_ONFILEPROGRESS,
+    RTC_DATACHANNEL_EVENTS_ONFILECOMPLETE,
     RTC_DATACHANNEL_EVENTS_MAX,
 };
 
@@ -18,14 +34,63 @@ typedef struct {
     int pMsgLen;
 } RTCDataChannelBase_Message;
 
+enum {
+    RTC_FILE_SEND,
+    RTC_FILE_RECEIVE,
+};
+
+typedef struct {
+    int direction;
+    uint64_t bytes;
+    uint64_t total;
+    int status;
+} RTCDataChannelBase_FileEvent;
+
 typedef struct {
     JSContext *ctx;
     int channelId;
     JSValue thisObj;
     JSValue events[RTC_DATACHANNEL_EVENTS_MAX];
-    JSClassFinalizer *finalizer;
+    const RTCDataChannelBase_Hooks *hooks;
+    void *opaque;
+    // set while onvalue is assigned, read from the network thread
+    atomic_int decodeValues;
+    // messages are framed by the codec once it is set
+    _Atomic(channelCodec *) codec;
+    // RTC_MESSAGES_, JS thread only
+    int messages;
+    // set along with a codec that coalesces, JS thread only
+    channelCoalescer *coalescer;
+    // test only, set at most once like the codec
+    _Atomic(netImpairment *) impairment;
+    // guards sender and receiver, which the network threads use
+    pthread_mutex_t transferLock;
+    fileSender *sender;
+    fileReceiver *receiver;
+    // at most one progress event per direction waits in the queue
+    atomic_int progressPending[2];
+    eventTarget *target;
+    int closed;
+    // the subclass state, hooks->opaqueSize bytes
+    _Alignas(max_align_t) unsigned char opaqueData[];
 } RTCDataChannelBase_ClassData;
 
+// Until the message callback is set libdatachannel keeps inbound messages,
+// which lets the codec change before the first one is decoded
+enum {
+    RTC_MESSAGES_FLOWING,
+    RTC_MESSAGES_CREATING,
+    RTC_MESSAGES_HELD,
+};
+
+typedef struct {
+    int channelId;
+    channelCodec *codec;
+    uint8_t *data;
+    size_t len;
+    int flags;
+} RTCDataChannelBase_Outgoing;
+
 static RTCDataChannelBase_ClassData* getRTCDataChannelClassData(JSValueConst this_val) {
     return JS_GetOpaque(this_val, RTCDataChannelBase_Class.id);
 }
@@ -34,10 +99,55 @@ int getRTCDataChannelId(JSValueConst this_val) {
     return getRTCDataChannelClassData(this_val)->channelId;
 }
 
+void *getRTCDataChannelOpaque(JSValueConst this_val) {
+    return getRTCDataChannelClassData(this_val)->opaque;
+}
+
+const RTCDataChannelBase_Hooks *getRTCDataChannelHooks(JSValueConst val) {
+    RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(val);
+    return state ? state->hooks : NULL;
+}
+
+eventTarget *getRTCDataChannelEventTarget(JSValueConst this_val) {
+    return getRTCDataChannelClassData(this_val)->target;
+}
+
+// The network thread only reads the codec once messages flow, so it can be
+// swapped until then
+int setRTCDataChannelCodec(JSValueConst this_val, channelCodec *codec) {
+    RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
+    if (state->messages == RTC_MESSAGES_FLOWING || state->closed)
+        return -1;
+    channelCodec *previous = atomic_exchange(&state->codec, codec);
+    if (state->coalescer) {
+        channelCoalescerFlush(state->coalescer);
+        channelCoalescerDestroy(state->coalescer);
+        state->coalescer = NULL;
+    }
+    if (previous)
+        channelCodecRelease(previous);
+    if (channelCodecGetConfig(codec)->coalesceIntervalMs > 0)
+        state->coalescer = channelCoalescerCreate(state->channelId, codec);
+    return 0;
+}
+
+void holdRTCDataChannelMessages(JSValueConst this_val) {
+    getRTCDataChannelClassData(this_val)->messages = RTC_MESSAGES_HELD;
+}
+
+int setRTCDataChannelImpairment(JSValueConst this_val, netImpairment *ni) {
+    RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
+    netImpairment *expected = NULL;
+    if (!atomic_compare_exchange_strong(&state->impairment, &expected, ni))
+        return -1;
+    netImpairmentRetain(ni);
+    return 0;
+}
+
 static void RTCDataChannelBase_onOpen(JSContext *ctx, JSValue this_val, void *data) {
     RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
-    printf("opening conection\n");
     if (state) {
+        logMessage(RTC_LOG_DEBUG, "Channel %d open", state->channelId);
         JSValue fn = state->events[RTC_DATACHANNEL_EVENTS_ONOPEN];
         if (JS_IsFunction(state->ctx, fn))
             JS_Call(state->ctx, fn, this_val, 0, NULL);
@@ -54,49 +164,293 @@ static void RTCDataChannelBase_onClose(JSContext *ctx, JSValue this_val, void *d
     }
 }
 
+static void freeArrayBufferData(JSRuntime *rt, void *opaque, void *ptr) {
+    free(ptr);
+}
+
 static void RTCDataChannelBase_onMessage(JSContext *ctx, JSValue this_val, void *data) {
     RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
     RTCDataChannelBase_Message *msg = (RTCDataChannelBase_Message *)data;
     if (state) {
         JSValue fn = state->events[RTC_DATACHANNEL_EVENTS_ONMESSAGE];
         if (JS_IsFunction(state->ctx, fn)) {
-            JSValue param = msg->isBinary 
-                ? JS_NewArrayBuffer(state->ctx, msg->pMsg, msg->pMsgLen, NULL, NULL, 0)
-                : JS_NewStringLen(state->ctx,  msg->pMsg, msg->pMsgLen);
+            JSValue param;
+            if (msg->isBinary) {
+                // the ArrayBuffer takes over the copy made on the network thread
+                param = JS_NewArrayBuffer(state->ctx, (uint8_t *)msg->pMsg, msg->pMsgLen, freeArrayBufferData, NULL, 0);
+                msg->pMsg = NULL;
+            } else {
+                param = JS_NewStringLen(state->ctx, msg->pMsg, msg->pMsgLen);
+            }
             JS_Call(state->ctx, fn, this_val, 1, &param);
             JS_FreeValue(state->ctx, param);   
         }
     }
+}
+
+static void freeMessage(void *data) {
+    RTCDataChannelBase_Message *msg = (RTCDataChannelBase_Message *)data;
     free(msg->pMsg);
+    free(msg);
+}
+
+static void freeValue(void *data) {
+    msgpackDocumentFree((msgpackDocument *)data);
+}
+
+static void RTCDataChannelBase_onValue(JSContext *ctx, JSValue this_val, void *data) {
+    RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
+    msgpackDocument *doc = (msgpackDocument *)data;
+    if (state) {
+        JSValue fn = state->events[RTC_DATACHANNEL_EVENTS_ONVALUE];
+        if (JS_IsFunction(state->ctx, fn)) {
+            JSValue param = msgpackToJSValue(state->ctx, doc);
+            if (!JS_IsException(param))
+                JS_Call(state->ctx, fn, this_val, 1, &param);
+            JS_FreeValue(state->ctx, param);
+        }
+    }
+}
+
+static void RTCDataChannelBase_onFileEvent(JSContext *ctx, JSValue this_val, void *data) {
+    RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
+    RTCDataChannelBase_FileEvent *ev = (RTCDataChannelBase_FileEvent *)data;
+    if (!state)
+        return;
+    int done = ev->status != FILE_TRANSFER_RUNNING;
+    if (!done) {
+        atomic_store(&state->progressPending[ev->direction], 0);
+    } else if (ev->direction == RTC_FILE_SEND) {
+        // the reader has returned, joining it doesn't block
+        pthread_mutex_lock(&state->transferLock);
+        fileSender *sender = state->sender;
+        state->sender = NULL;
+        pthread_mutex_unlock(&state->transferLock);
+        if (sender)
+            fileSenderStop(sender);
+    } else {
+        // so is the writer
+        pthread_mutex_lock(&state->transferLock);
+        fileReceiver *receiver = state->receiver;
+        state->receiver = NULL;
+        pthread_mutex_unlock(&state->transferLock);
+        if (receiver)
+            fileReceiverStop(receiver);
+    }
+    JSValue fn = state->events[done ? RTC_DATACHANNEL_EVENTS_ONFILECOMPLETE : RTC_DATACHANNEL_EVENTS_ONFILEPROGRESS];
+    if (JS_IsFunction(ctx, fn)) {
+        JSValue arg = JS_NewObject(ctx);
+        JS_SetPropertyStr(ctx, arg, "direction", JS_NewString(ctx, ev->direction == RTC_FILE_SEND ? "send" : "receive"));
+        JS_SetPropertyStr(ctx, arg, "bytes", JS_NewFloat64(ctx, ev->bytes));
+        JS_SetPropertyStr(ctx, arg, "total", ev->total ? JS_NewFloat64(ctx, ev->total) : JS_NULL);
+        if (done)
+            JS_SetPropertyStr(ctx, arg, "success", JS_NewBool(ctx, ev->status == FILE_TRANSFER_DONE));
+        JS_Call(ctx, fn, this_val, 1, &arg);
+        JS_FreeValue(ctx, arg);
+    }
+}
+
+static void queueFileEvent(RTCDataChannelBase_ClassData *state, int direction, uint64_t bytes, uint64_t total, int status) {
+    if (status == FILE_TRANSFER_RUNNING && atomic_exchange(&state->progressPending[direction], 1))
+        return;
+    RTCDataChannelBase_FileEvent *ev = malloc(sizeof(RTCDataChannelBase_FileEvent));
+    ev->direction = direction;
+    ev->bytes = bytes;
+    ev->total = total;
+    ev->status = status;
+    enqueueTargetEvent(state->target, RTCDataChannelBase_onFileEvent, ev, NULL);
+}
+
+static void handleFileSent(void *opaque, uint64_t bytes, uint64_t total, int status) {
+    queueFileEvent((RTCDataChannelBase_ClassData *)opaque, RTC_FILE_SEND, bytes, total, status);
+}
+
+static void handleFileReceived(void *opaque, uint64_t bytes, uint64_t total, int status) {
+    queueFileEvent((RTCDataChannelBase_ClassData *)opaque, RTC_FILE_RECEIVE, bytes, total, status);
+}
+
+// The writer thread does the disk I/O, this only queues a copy
+static int receiveChunk(RTCDataChannelBase_ClassData *state, const char *message, size_t len) {
+    int consumed = 0;
+    pthread_mutex_lock(&state->transferLock);
+    if (state->receiver)
+        consumed = fileReceiverWrite(state->receiver, message, len);
+    pthread_mutex_unlock(&state->transferLock);
+    return consumed;
+}
+
+static void handleOnBufferedAmountLow(int channelId, void *ptr) {
+    RTCDataChannelBase_ClassData *state = (RTCDataChannelBase_ClassData *)ptr;
+    pthread_mutex_lock(&state->transferLock);
+    if (state->sender)
+        fileSenderNotify(state->sender);
+    pthread_mutex_unlock(&state->transferLock);
 }
 
 static void handleOnOpen(int channelId, void *ptr) {
     RTCDataChannelBase_ClassData *state = (RTCDataChannelBase_ClassData *)ptr;
-    enqueueEvent(RTCDataChannelBase_onOpen, state->thisObj, NULL);
+    traceSetThreadName("libdatachannel");
+    traceInstant("channelOpen", "channel", channelId);
+    enqueueTargetEvent(state->target, RTCDataChannelBase_onOpen, NULL, NULL);
 }
 
 static void handleOnClose(int channelId, void *ptr) {
     RTCDataChannelBase_ClassData *state = (RTCDataChannelBase_ClassData *)ptr;
-    enqueueEvent(RTCDataChannelBase_onClose, state->thisObj, NULL);
+    traceSetThreadName("libdatachannel");
+    traceInstant("channelClose", "channel", channelId);
+    pthread_mutex_lock(&state->transferLock);
+    if (state->receiver)
+        fileReceiverEnd(state->receiver);
+    pthread_mutex_unlock(&state->transferLock);
+    enqueueTargetEvent(state->target, RTCDataChannelBase_onClose, NULL, NULL);
 }
 
-static void handleOnMessage(int id, const char *message, int size, void *ptr) {
-    RTCDataChannelBase_ClassData *state = (RTCDataChannelBase_ClassData *)ptr;
+static void queueMessage(RTCDataChannelBase_ClassData *state, const char *message, size_t len, int isBinary) {
     RTCDataChannelBase_Message *msg = malloc(sizeof(RTCDataChannelBase_Message));
-    msg->isBinary = size >= 0;
-    msg->pMsgLen = size < 0 ? strlen(message) + 1 : size;
-    msg->pMsg = malloc(msg->pMsgLen);
-    memcpy(msg->pMsg, message, msg->pMsgLen);
-    enqueueEvent(RTCDataChannelBase_onMessage, state->thisObj, msg);
+    msg->isBinary = isBinary;
+    msg->pMsgLen = len;
+    msg->pMsg = malloc(len + 1);
+    memcpy(msg->pMsg, message, len);
+    msg->pMsg[len] = 0;
+    enqueueTargetEvent(state->target, RTCDataChannelBase_onMessage, msg, freeMessage);
+}
+
+static void queueBinary(RTCDataChannelBase_ClassData *state, const char *message, size_t len) {
+    if (receiveChunk(state, message, len))
+        return;
+    queueMessage(state, message, len, 1);
+}
+
+// Only frames sent with sendValue() are decoded, values nobody listens to
+// are dropped
+static void queueValue(RTCDataChannelBase_ClassData *state, const char *message, size_t len) {
+    msgpackDocument *doc;
+    if (!atomic_load(&state->decodeValues))
+        return;
+    doc = msgpackDecode((const uint8_t *)message, len);
+    if (doc == NULL) {
+        logMessage(RTC_LOG_WARNING, "Channel %d dropped a value that could not be decoded", state->channelId);
+        return;
+    }
+    enqueueTargetEvent(state->target, RTCDataChannelBase_onValue, doc, freeValue);
+}
+
+static void queueFrame(RTCDataChannelBase_ClassData *state, const uint8_t *message, size_t len, int flags) {
+    if (flags & CHANNEL_FRAME_TEXT)
+        queueMessage(state, (const char *)message, len, 0);
+    else if (flags & CHANNEL_FRAME_VALUE)
+        queueValue(state, (const char *)message, len);
+    else
+        queueBinary(state, (const char *)message, len);
+}
+
+// Every message of a coalesced frame gets its own event
+static void receiveBatch(RTCDataChannelBase_ClassData *state, const uint8_t *data, size_t len) {
+    const uint8_t *msg;
+    size_t msgLen;
+    int flags, status;
+    while ((status = channelBatchNext(&data, &len, &msg, &msgLen, &flags)) > 0)
+        queueFrame(state, msg, msgLen, flags);
+    if (status < 0)
+        logMessage(RTC_LOG_WARNING, "Channel %d dropped the rest of a malformed batch", state->channelId);
+}
+
+static void receiveMessage(RTCDataChannelBase_ClassData *state, int id, const char *message, int size) {
+    RTCDataChannelBase_MessageFilter filter = state->hooks->messageFilter;
+    channelCodec *codec = atomic_load(&state->codec);
+    if (filter && filter(id, message, size, state->opaque))
+        return;
+    if (codec && size >= 0) {
+        int flags;
+        size_t len;
+        uint8_t *decoded = channelCodecDecode(codec, (const uint8_t *)message, size, &flags, &len);
+        if (decoded == NULL) {
+            logMessage(RTC_LOG_WARNING, "Channel %d dropped a message that could not be decoded", id);
+            return;
+        }
+        if (flags & CHANNEL_FRAME_BATCH)
+            receiveBatch(state, decoded, len);
+        else
+            queueFrame(state, decoded, len, flags);
+        free(decoded);
+    } else if (size >= 0) {
+        queueBinary(state, message, size);
+    } else {
+        queueMessage(state, message, strlen(message), 0);
+    }
+}
+
+static void deliverImpaired(const char *message, int size, void *opaque) {
+    RTCDataChannelBase_ClassData *state = opaque;
+    receiveMessage(state, state->channelId, message, size);
+}
+
+static void handleOnMessage(int id, const char *message, int size, void *ptr) {
+    RTCDataChannelBase_ClassData *state = ptr;
+    netImpairment *ni = atomic_load(&state->impairment);
+    uint64_t start = traceNow();
+    traceSetThreadName("libdatachannel");
+    if (ni)
+        netImpairmentSubmit(ni, message, size, deliverImpaired, state);
+    else
+        receiveMessage(state, id, message, size);
+    traceComplete("onMessage", start, "bytes", size);
+}
+
+void startRTCDataChannelMessages(JSValueConst this_val) {
+    RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
+    if (state == NULL || state->messages == RTC_MESSAGES_FLOWING || state->closed)
+        return;
+    state->messages = RTC_MESSAGES_FLOWING;
+    rtcSetMessageCallback(state->channelId, handleOnMessage);
+}
+
+// Releases everything native right away, the JS object stays usable but
+// inert until it's collected
+static void closeChannel(RTCDataChannelBase_ClassData *state) {
+    if (state->closed)
+        return;
+    state->closed = 1;
+    rtcSetOpenCallback(state->channelId, NULL);
+    rtcSetClosedCallback(state->channelId, NULL);
+    rtcSetMessageCallback(state->channelId, NULL);
+    rtcSetBufferedAmountLowCallback(state->channelId, NULL);
+    if (state->impairment)
+        netImpairmentCancel(state->impairment, state);
+    if (state->coalescer) {
+        channelCoalescerFlush(state->coalescer);
+        channelCoalescerDestroy(state->coalescer);
+    }
+    state->coalescer = NULL;
+    state->hooks->close(state->channelId, state->opaque);
+    pthread_mutex_lock(&state->transferLock);
+    fileSender *sender = state->sender;
+    fileReceiver *receiver = state->receiver;
+    state->sender = NULL;
+    state->receiver = NULL;
+    pthread_mutex_unlock(&state->transferLock);
+    if (sender)
+        fileSenderStop(sender);
+    if (receiver)
+        fileReceiverStop(receiver);
+    eventTargetClose(state->target);
 }
 
 static void RTCDataChannelBase_Finalizer(JSRuntime *rt, JSValue val) {
     RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(val);
+    logMessage(RTC_LOG_VERBOSE, "Freeing channel %d", state->channelId);
+    closeChannel(state);
     for (int i = 0 ; i < RTC_DATACHANNEL_EVENTS_MAX; i++)
         JS_FreeValueRT(rt, state->events[i]);
-    state->finalizer(rt, val);
+    if (state->hooks->finalizer)
+        state->hooks->finalizer(rt, val);
+    if (state->codec)
+        channelCodecRelease(state->codec);
+    if (state->impairment)
+        netImpairmentRelease(state->impairment);
+    pthread_mutex_destroy(&state->transferLock);
+    eventTargetRelease(state->target);
     js_free(state->ctx, state);
-    printf("freeing data channel\n");
 }
 
 static void RTCDataChannelBase_GcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func) {
@@ -104,6 +458,8 @@ static void RTCDataChannelBase_GcMark(JSRuntime *rt, JSValueConst val, JS_MarkFu
     if (state) {
         for (int i = 0 ; i < RTC_DATACHANNEL_EVENTS_MAX; i++)
             JS_MarkValue(rt, state->events[i], mark_func);
+        if (state->hooks->gcMark)
+            state->hooks->gcMark(rt, val, mark_func);
     }
 }
 
@@ -124,6 +480,55 @@ static JSValue RTCDataChannelBase_EventSet(
         state->events[magic] = JS_DupValue(ctx, value);
     else
         state->events[magic] = JS_UNDEFINED;
+    if (magic == RTC_DATACHANNEL_EVENTS_ONVALUE)
+        atomic_store(&state->decodeValues, !JS_IsUndefined(state->events[magic]));
+    return JS_UNDEFINED;
+}
+
+static void sendEncoded(void *opaque) {
+    RTCDataChannelBase_Outgoing *out = (RTCDataChannelBase_Outgoing *)opaque;
+    uint64_t start = traceNow();
+    size_t len;
+    uint8_t *frame = channelCodecEncode(out->codec, out->data, out->len, out->flags, &len);
+    if (frame == NULL || rtcSendMessage(out->channelId, (const char *)frame, len) < 0)
+        logMessage(RTC_LOG_WARNING, "Channel %d failed to send a %zu byte message", out->channelId, out->len);
+    traceComplete("sendEncoded", start, "bytes", out->len);
+    channelCodecRelease(out->codec);
+    free(frame);
+    free(out->data);
+    free(out);
+}
+
+static JSValue sendMessage(
+    JSContext *ctx, RTCDataChannelBase_ClassData *state,
+    const char *data, size_t len, int flags)
+{
+    channelCodec *codec = atomic_load(&state->codec);
+    if (state->closed)
+        return JS_ThrowTypeError(ctx, "The channel is closed");
+    if (state->coalescer) {
+        channelCoalescerPush(state->coalescer, (const uint8_t *)data, len, flags);
+        return JS_UNDEFINED;
+    }
+    if (codec) {
+        // framing and compression happen on the worker thread, which also
+        // keeps the messages in order
+        RTCDataChannelBase_Outgoing *out = malloc(sizeof(RTCDataChannelBase_Outgoing));
+        out->channelId = state->channelId;
+        out->codec = codec;
+        out->data = malloc(len > 0 ? len : 1);
+        memcpy(out->data, data, len);
+        out->len = len;
+        out->flags = flags;
+        channelCodecRetain(codec);
+        taskQueuePost(sendEncoded, out);
+        return JS_UNDEFINED;
+    }
+    uint64_t start = traceNow();
+    int result = rtcSendMessage(state->channelId, data, flags & CHANNEL_FRAME_TEXT ? -1 : (int)len);
+    traceComplete("send", start, "bytes", len);
+    if (result < 0)
+        return JS_ThrowInternalError(ctx, "Error sending data");
     return JS_UNDEFINED;
 }
 
@@ -132,28 +537,164 @@ static JSValue RTCDataChannelBase_send(
     int argc, JSValueConst *argv)
 {
     RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
-    int isString;
-    char *val;
+    JSValue ret;
+    const char *val;
     size_t len;
-    isString = JS_IsString(argv[0]);
-    val = isString 
-        ? (char *)JS_ToCString(ctx, argv[0]) 
-        : (char *)JS_GetArrayBuffer(ctx, &len, argv[0]);
-    if (rtcSendMessage(state->channelId, val, isString ? -1 : len) < 0)
-        return JS_ThrowInternalError(ctx, "Error sending data");
-    if (isString) JS_FreeCString(ctx, val);
+    if (JS_IsString(argv[0])) {
+        val = JS_ToCStringLen(ctx, &len, argv[0]);
+        ret = sendMessage(ctx, state, val, len, CHANNEL_FRAME_TEXT);
+        JS_FreeCString(ctx, val);
+        return ret;
+    }
+    val = (const char *)JS_GetArrayBuffer(ctx, &len, argv[0]);
+    if (val == NULL)
+        return JS_EXCEPTION;
+    return sendMessage(ctx, state, val, len, 0);
+}
+
+static JSValue RTCDataChannelBase_sendValue(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
+    msgpackBuffer buf;
+    // values are told apart from binary messages by the frame flags
+    if (atomic_load(&state->codec) == NULL)
+        return JS_ThrowTypeError(ctx, "Values need a framed channel");
+    if (msgpackEncode(ctx, argv[0], &buf) < 0)
+        return JS_EXCEPTION;
+    JSValue ret = sendMessage(ctx, state, (const char *)buf.data, buf.len, CHANNEL_FRAME_VALUE);
+    msgpackBufferFree(&buf);
+    return ret;
+}
+
+static int JS_GetOptionalUint64Prop(JSContext *ctx, JSValueConst obj, const char *prop, uint64_t *res) {
+    JSValue val = JS_GetPropertyStr(ctx, obj, prop);
+    int64_t num;
+    int status = 0;
+    if (!JS_IsUndefined(val)) {
+        status = !JS_IsNumber(val) || JS_ToInt64(ctx, &num, val) || num < 0 ? -1 : 0;
+        if (status == 0)
+            *res = num;
+    }
+    JS_FreeValue(ctx, val);
+    return status;
+}
+
+static JSValue RTCDataChannelBase_sendFile(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
+    uint64_t chunkSize = FILE_TRANSFER_DEFAULT_CHUNK_SIZE, offset = 0, length = UINT64_MAX;
+    struct stat st;
+    if (argc == 0 || !JS_IsString(argv[0]))
+        return JS_ThrowTypeError(ctx, "Invalid path argument");
+    if (argc > 1 && !JS_IsUndefined(argv[1])) {
+        if (!JS_IsObject(argv[1]))
+            return JS_ThrowTypeError(ctx, "The file options should be an object");
+        if (JS_GetOptionalUint64Prop(ctx, argv[1], "chunkSize", &chunkSize)
+            || chunkSize == 0 || chunkSize > FILE_TRANSFER_MAX_CHUNK_SIZE)
+            return JS_ThrowRangeError(ctx, "Invalid chunkSize value");
+        if (JS_GetOptionalUint64Prop(ctx, argv[1], "offset", &offset))
+            return JS_ThrowRangeError(ctx, "Invalid offset value");
+        if (JS_GetOptionalUint64Prop(ctx, argv[1], "length", &length))
+            return JS_ThrowRangeError(ctx, "Invalid length value");
+    }
+    if (state->closed)
+        return JS_ThrowTypeError(ctx, "The channel is closed");
+    if (state->sender)
+        return JS_ThrowTypeError(ctx, "A file is already being sent on this channel");
+    const char *path = JS_ToCString(ctx, argv[0]);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    JS_FreeCString(ctx, path);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0)
+            close(fd);
+        return JS_ThrowInternalError(ctx, "Error opening file for sending");
+    }
+    if (offset > (uint64_t)st.st_size) {
+        close(fd);
+        return JS_ThrowRangeError(ctx, "The offset is past the end of the file");
+    }
+    if (length > st.st_size - offset)
+        length = st.st_size - offset;
+    fileSender *sender = fileSenderStart(state->channelId, fd, offset, length, chunkSize,
+        atomic_load(&state->codec), handleFileSent, state);
+    if (sender == NULL)
+        return JS_ThrowInternalError(ctx, "Error starting the file reader");
+    pthread_mutex_lock(&state->transferLock);
+    state->sender = sender;
+    pthread_mutex_unlock(&state->transferLock);
+    return JS_UNDEFINED;
+}
+
+static JSValue RTCDataChannelBase_receiveFile(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
+    uint64_t length = 0;
+    if (argc == 0 || !JS_IsString(argv[0]))
+        return JS_ThrowTypeError(ctx, "Invalid path argument");
+    if (argc > 1 && !JS_IsUndefined(argv[1])) {
+        if (!JS_IsObject(argv[1]))
+            return JS_ThrowTypeError(ctx, "The file options should be an object");
+        if (JS_GetOptionalUint64Prop(ctx, argv[1], "length", &length))
+            return JS_ThrowRangeError(ctx, "Invalid length value");
+    }
+    if (state->closed)
+        return JS_ThrowTypeError(ctx, "The channel is closed");
+    // only this thread sets or clears the receiver
+    if (state->receiver)
+        return JS_ThrowTypeError(ctx, "A file is already being received on this channel");
+    const char *path = JS_ToCString(ctx, argv[0]);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    JS_FreeCString(ctx, path);
+    if (fd < 0)
+        return JS_ThrowInternalError(ctx, "Error opening file for receiving");
+    fileReceiver *receiver = fileReceiverStart(fd, length, handleFileReceived, state);
+    if (receiver == NULL)
+        return JS_ThrowInternalError(ctx, "Error starting the file writer");
+    pthread_mutex_lock(&state->transferLock);
+    state->receiver = receiver;
+    pthread_mutex_unlock(&state->transferLock);
+    return JS_UNDEFINED;
+}
+
+static JSValue RTCDataChannelBase_close(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    closeChannel(getRTCDataChannelClassData(this_val));
+    return JS_UNDEFINED;
+}
+
+// Sends the coalesced messages now instead of at the end of the interval
+static JSValue RTCDataChannelBase_flush(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
+    if (state->coalescer)
+        channelCoalescerFlush(state->coalescer);
     return JS_UNDEFINED;
 }
 
 static JSValue RTCDataChannelBase_isOpen(JSContext *ctx, JSValueConst this_val)
 {   
     RTCDataChannelBase_ClassData *state = getRTCDataChannelClassData(this_val);
-    int isOpen = rtcIsOpen(state->channelId);
+    int isOpen = !state->closed && rtcIsOpen(state->channelId);
     return JS_NewBool(ctx, isOpen); 
 }
 
 static JSCFunctionListEntry RTCDataChannelBase_Methods[] = {
     JS_CFUNC_DEF("send", 1, RTCDataChannelBase_send),
+    JS_CFUNC_DEF("sendValue", 1, RTCDataChannelBase_sendValue),
+    JS_CFUNC_DEF("sendFile", 2, RTCDataChannelBase_sendFile),
+    JS_CFUNC_DEF("receiveFile", 2, RTCDataChannelBase_receiveFile),
+    JS_CFUNC_DEF("flush", 0, RTCDataChannelBase_flush),
+    JS_CFUNC_DEF("close", 0, RTCDataChannelBase_close),
     JS_CGETSET_DEF("isOpen", RTCDataChannelBase_isOpen, NULL),
     JS_CGETSET_MAGIC_DEF("onopen", 
         RTCDataChannelBase_EventGet, 
@@ -166,7 +707,19 @@ static JSCFunctionListEntry RTCDataChannelBase_Methods[] = {
     JS_CGETSET_MAGIC_DEF("onmessage", 
         RTCDataChannelBase_EventGet, 
         RTCDataChannelBase_EventSet, 
-        RTC_DATACHANNEL_EVENTS_ONMESSAGE)
+        RTC_DATACHANNEL_EVENTS_ONMESSAGE),
+    JS_CGETSET_MAGIC_DEF("onvalue", 
+        RTCDataChannelBase_EventGet, 
+        RTCDataChannelBase_EventSet, 
+        RTC_DATACHANNEL_EVENTS_ONVALUE),
+    JS_CGETSET_MAGIC_DEF("onfileprogress", 
+        RTCDataChannelBase_EventGet, 
+        RTCDataChannelBase_EventSet, 
+        RTC_DATACHANNEL_EVENTS_ONFILEPROGRESS),
+    JS_CGETSET_MAGIC_DEF("onfilecomplete", 
+        RTCDataChannelBase_EventGet, 
+        RTCDataChannelBase_EventSet, 
+        RTC_DATACHANNEL_EVENTS_ONFILECOMPLETE)
 };
 
 JSFullClassDef RTCDataChannelBase_Class = {
@@ -180,19 +733,29 @@ JSFullClassDef RTCDataChannelBase_Class = {
     .funcs = RTCDataChannelBase_Methods
 };
 
-JSValue createRTCDataChannelBaseClass(JSContext *ctx, int channelId, JSClassFinalizer *finalizer) {
-    JSValue obj = JS_NewObjectClass(ctx, RTCDataChannelBase_Class.id); 
-    RTCDataChannelBase_ClassData *state = js_mallocz(ctx, sizeof(*state));
+JSValue createRTCDataChannelBaseClass(JSContext *ctx, int channelId, const RTCDataChannelBase_Hooks *hooks, const void *initArg) {
+    JSValue obj = JS_NewSubClassObject(ctx, hooks->classDef);
+    RTCDataChannelBase_ClassData *state = js_mallocz(ctx, sizeof(*state) + hooks->opaqueSize);
     state->ctx = ctx;
     state->channelId = channelId;
     state->thisObj = obj;
-    state->finalizer = finalizer;
+    state->hooks = hooks;
+    state->opaque = hooks->opaqueSize > 0 ? state->opaqueData : NULL;
+    state->target = eventTargetCreate(obj);
     for (int i = 0 ; i < RTC_DATACHANNEL_EVENTS_MAX; i++) 
         state->events[i] = JS_UNDEFINED;
+    pthread_mutex_init(&state->transferLock, NULL);
+    state->messages = RTC_MESSAGES_CREATING;
     JS_SetOpaque(obj, state);
+    if (hooks->init && hooks->init(ctx, obj, channelId, state->opaque, initArg) < 0) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
     rtcSetUserPointer(channelId, state);
     rtcSetOpenCallback(channelId, handleOnOpen);
     rtcSetClosedCallback(channelId, handleOnClose);
-    rtcSetMessageCallback(channelId, handleOnMessage);
+    rtcSetBufferedAmountLowCallback(channelId, handleOnBufferedAmountLow);
+    if (state->messages == RTC_MESSAGES_CREATING)
+        startRTCDataChannelMessages(obj);
     return obj;
-}
\ No newline at end of file
+}
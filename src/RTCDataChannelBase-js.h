@@ -2,9 +2,50 @@
 #define __RTC_DATA_CHANNEL_BASE_JS_H
 
 #include "js-utils.h"
+#include "channel-codec.h"
+#include "event-queue.h"
+#include "net-impairment.h"
+
+// Runs on the libdatachannel thread before a message is queued for JS.
+// Returning non zero consumes the message.
+typedef int (*RTCDataChannelBase_MessageFilter)(int channelId, const char *message, int size, void *opaque);
+
+// Releases the native side, runs once from close() or the finalizer
+typedef void (*RTCDataChannelBase_Close)(int channelId, void *opaque);
+
+// Fills opaque before any libdatachannel callback can run. Returns -1 with a
+// pending exception, the object is then closed and released.
+typedef int (*RTCDataChannelBase_Init)(JSContext *ctx, JSValueConst obj, int channelId, void *opaque, const void *arg);
+
+typedef struct {
+    // subclass whose shared prototype the objects get
+    JSFullClassDef *classDef;
+    // opaque is allocated zeroed along with the base class data
+    size_t opaqueSize;
+    RTCDataChannelBase_Init init; // optional
+    RTCDataChannelBase_Close close;
+    // optional, frees what opaque owns once the object is collected
+    JSClassFinalizer *finalizer;
+    JSClassGCMark *gcMark;
+    RTCDataChannelBase_MessageFilter messageFilter;
+} RTCDataChannelBase_Hooks;
 
 extern JSFullClassDef RTCDataChannelBase_Class;
 int getRTCDataChannelId(JSValueConst this_val);
-JSValue createRTCDataChannelBaseClass(JSContext *ctx, int channelId, JSClassFinalizer *finalizer);
+void *getRTCDataChannelOpaque(JSValueConst this_val);
+// Tells which kind of channel val is, NULL when it isn't one
+const RTCDataChannelBase_Hooks *getRTCDataChannelHooks(JSValueConst val);
+eventTarget *getRTCDataChannelEventTarget(JSValueConst this_val);
+// Takes ownership of codec and replaces the current one. Fails once
+// inbound messages flow: after the init hook, or after
+// startRTCDataChannelMessages for channels that hold them.
+int setRTCDataChannelCodec(JSValueConst this_val, channelCodec *codec);
+// Called from the init hook, inbound messages then wait in libdatachannel
+// until startRTCDataChannelMessages
+void holdRTCDataChannelMessages(JSValueConst this_val);
+void startRTCDataChannelMessages(JSValueConst this_val);
+// Inbound messages go through ni from now on, fails if one is already set
+int setRTCDataChannelImpairment(JSValueConst this_val, netImpairment *ni);
+JSValue createRTCDataChannelBaseClass(JSContext *ctx, int channelId, const RTCDataChannelBase_Hooks *hooks, const void *initArg);
 
 #endif
\ No newline at end of file
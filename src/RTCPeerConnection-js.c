@@ -1,12 +1,23 @@
 #include "RTCPeerConnection-js.h"
 #include "RTCDataChannel-js.h"
+#include "RTCDataChannelBase-js.h"
 #include "RTCTrack-js.h"
 #include <rtc/rtc.h>
 #include "event-queue.h"
+#include "trace.h"
+#include "nack-history.h"
+#include "net-impairment.h"
+#include <stdatomic.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
 
+#define DEFAULT_KEYFRAME_REQUEST_INTERVAL 300 // ms
+#define DEFAULT_PACING_BURST 16384 // bytes
+#define MAX_TRACK_RTT 60000 // ms
+#define MIN_PEER_CONNECTION_MTU 576 // bytes, the smallest IPv4 datagram every host accepts
+
 enum {
     RTC_PEER_CONNECTION_EVENTS_ONICECANDIDATE,
     RTC_PEER_CONNECTION_EVENTS_ONLOCALDESCRIPTION,
@@ -33,29 +44,97 @@ typedef struct {
     rtcNalUnitSeparator nalUnitSeparator;
     int ssrc;        // Sincronization source id
     int payloadType; // 96 - 127 => dynamic
+    int nackMode;
+    uint32_t nackHistory;
+    uint32_t maxBitrate;
+    int rtt;
+    uint32_t keyframeRequestInterval;
+    uint32_t pacingRate;
+    uint32_t pacingBurst;
+    int layersLen;
+    RTCTrack_Layer layers[RTC_TRACK_MAX_LAYERS];
+    int packetization;
+    int jitterBuffer;
+    jitterBufferConfig jitter;
 } AddTrackOptions;
 
 typedef struct {
     JSContext *ctx;
     int peerConn;
-    JSValue thisObj;
+    eventTarget *target;
+    int closed;
     JSValue events[RTC_PEER_CONNECTION_EVENTS_MAX];
+    atomic_int gatheringState;
+    netImpairment *impairment; // test only, shared by every channel and track
 } RTCPeerConnection_ClassData;
 
+typedef struct {
+    const char *name;
+    size_t offset;
+    int min;
+    int max;
+} SctpSettingDef;
+
+#define SCTP_SETTING_DEF(name, field, min, max) { name, offsetof(rtcSctpSettings, field), min, max }
+
+static const SctpSettingDef sctpSettingDefs[] = {
+    SCTP_SETTING_DEF("recvBufferSize", recvBufferSize, 0, INT32_MAX),
+    SCTP_SETTING_DEF("sendBufferSize", sendBufferSize, 0, INT32_MAX),
+    SCTP_SETTING_DEF("maxChunksOnQueue", maxChunksOnQueue, 0, INT32_MAX),
+    SCTP_SETTING_DEF("initialCongestionWindow", initialCongestionWindow, 0, INT32_MAX),
+    SCTP_SETTING_DEF("maxBurst", maxBurst, -1, INT32_MAX),
+    SCTP_SETTING_DEF("congestionControlModule", congestionControlModule, 0, 3), // RFC2581, HSTCP, HTCP, RTCC
+    SCTP_SETTING_DEF("delayedSackTime", delayedSackTimeMs, -1, 500),
+    SCTP_SETTING_DEF("minRetransmitTimeout", minRetransmitTimeoutMs, 0, INT32_MAX),
+    SCTP_SETTING_DEF("maxRetransmitTimeout", maxRetransmitTimeoutMs, 0, INT32_MAX),
+    SCTP_SETTING_DEF("initialRetransmitTimeout", initialRetransmitTimeoutMs, 0, INT32_MAX),
+    SCTP_SETTING_DEF("maxRetransmitAttempts", maxRetransmitAttempts, 0, INT32_MAX),
+    SCTP_SETTING_DEF("heartbeatInterval", heartbeatIntervalMs, 0, INT32_MAX),
+};
+
+// SCTP settings are global to libdatachannel and only read when an
+// association is created, so they are locked once a connection exists
+static int peerConnectionCreated = 0;
+
 static RTCPeerConnection_ClassData* getRTCPeerConnectionClassData(JSValueConst this_val) {
     return JS_GetOpaque(this_val, RTCPeerConnection_Class.id);
 }
 
+int getRTCPeerConnectionId(JSValueConst this_val) {
+    return getRTCPeerConnectionClassData(this_val)->peerConn;
+}
+
+int isRTCPeerConnectionGatheringComplete(JSValueConst this_val) {
+    return atomic_load(&getRTCPeerConnectionClassData(this_val)->gatheringState) == RTC_GATHERING_COMPLETE;
+}
+
+static const char* JS_GetCStringProp(JSContext *ctx, JSValueConst thisObj, const char *prop) {
+    JSValue val = JS_GetPropertyStr(ctx, thisObj, prop);
+    const char *str = JS_ToCString(ctx, val);
+    JS_FreeValue(ctx, val);
+    return str;
+}
+
+static int JS_GetOptionalUint32Prop(JSContext *ctx, JSValueConst thisObj, const char *prop, uint32_t *res) {
+    JSValue val = JS_GetPropertyStr(ctx, thisObj, prop);
+    int status = 0;
+    if (!JS_IsUndefined(val))
+        status = !JS_IsNumber(val) || JS_ToUint32(ctx, res, val);
+    JS_FreeValue(ctx, val);
+    return status;
+}
+
 static JSValue parseIceServerValue(JSContext *ctx, JSValue iceServerVal, const char** iceServer) {
     if (!JS_IsObject(iceServerVal)) 
         return JS_ThrowTypeError(ctx, "The iceServers item should be an object");
-    JSValue urlsVal = JS_GetPropertyStr(ctx, iceServerVal, "urls");
-    *iceServer = JS_ToCString(ctx, urlsVal);
-    JS_FreeValue(ctx, urlsVal);
+    if ((*iceServer = JS_GetCStringProp(ctx, iceServerVal, "urls")) == NULL)
+        return JS_ThrowTypeError(ctx, "Invalid iceServers urls value");
     return JS_UNDEFINED;
 }
 
 static JSValue parseIceServersValue(JSContext *ctx, JSValue iceServersVal, rtcConfiguration *config) {
+    if (JS_IsUndefined(iceServersVal))
+        return JS_UNDEFINED;
     if (!JS_IsArray(ctx, iceServersVal)) 
         return JS_ThrowTypeError(ctx, "The iceServers property should be an array");
     uint32_t len = JS_GetArrayLength(ctx, iceServersVal);
@@ -64,9 +143,68 @@ static JSValue parseIceServersValue(JSContext *ctx, JSValue iceServersVal, rtcCo
     for (int i = 0 ; i < len ; i++) {
         JSValue iceServer = JS_GetPropertyUint32(ctx, iceServersVal, i);
         JSValue ret = parseIceServerValue(ctx, iceServer, &(config->iceServers[i]));
-        if (JS_IsException(ret)) return ret;
         JS_FreeValue(ctx, iceServer);
+        if (JS_IsException(ret)) return ret;
+    }
+    return JS_UNDEFINED;
+}
+
+static int JS_GetOptionalBoolProp(JSContext *ctx, JSValueConst thisObj, const char *prop, bool *res) {
+    JSValue val = JS_GetPropertyStr(ctx, thisObj, prop);
+    int status = 0;
+    if (JS_IsBool(val))
+        *res = JS_ToBool(ctx, val);
+    else
+        status = !JS_IsUndefined(val);
+    JS_FreeValue(ctx, val);
+    return status;
+}
+
+static JSValue parseCertificateTypeValue(JSContext *ctx, JSValue configVal, rtcConfiguration *config) {
+    JSValue typeVal = JS_GetPropertyStr(ctx, configVal, "certificateType");
+    JSValue ret = JS_UNDEFINED;
+    if (JS_IsString(typeVal)) {
+        const char *type = JS_ToCString(ctx, typeVal);
+        if (strcmp(type, "default") == 0)
+            config->certificateType = RTC_CERTIFICATE_DEFAULT;
+        else if (strcmp(type, "ecdsa") == 0)
+            config->certificateType = RTC_CERTIFICATE_ECDSA;
+        else if (strcmp(type, "rsa") == 0)
+            config->certificateType = RTC_CERTIFICATE_RSA;
+        else
+            ret = JS_ThrowTypeError(ctx, "Invalid certificateType value");
+        JS_FreeCString(ctx, type);
+    } else if (!JS_IsUndefined(typeVal)) {
+        ret = JS_ThrowTypeError(ctx, "Invalid certificateType value");
     }
+    JS_FreeValue(ctx, typeVal);
+    return ret;
+}
+
+// Zero keeps the libdatachannel default for the port range, mtu and maxMessageSize
+static JSValue parseTransportValues(JSContext *ctx, JSValue configVal, rtcConfiguration *config) {
+    uint32_t portBegin = 0, portEnd = 0, mtu = 0, maxMessageSize = 0;
+    if (JS_GetOptionalUint32Prop(ctx, configVal, "portRangeBegin", &portBegin) || portBegin > UINT16_MAX)
+        return JS_ThrowRangeError(ctx, "portRangeBegin should be a port number");
+    if (JS_GetOptionalUint32Prop(ctx, configVal, "portRangeEnd", &portEnd) || portEnd > UINT16_MAX)
+        return JS_ThrowRangeError(ctx, "portRangeEnd should be a port number");
+    if (portBegin && portEnd && portBegin > portEnd)
+        return JS_ThrowRangeError(ctx, "portRangeBegin should not exceed portRangeEnd");
+    if (JS_GetOptionalUint32Prop(ctx, configVal, "mtu", &mtu)
+        || (mtu && (mtu < MIN_PEER_CONNECTION_MTU || mtu > UINT16_MAX)))
+        return JS_ThrowRangeError(ctx, "mtu should be between %d and %d", MIN_PEER_CONNECTION_MTU, UINT16_MAX);
+    if (JS_GetOptionalUint32Prop(ctx, configVal, "maxMessageSize", &maxMessageSize) || maxMessageSize > INT32_MAX)
+        return JS_ThrowRangeError(ctx, "Invalid maxMessageSize value");
+    config->portRangeBegin = portBegin;
+    config->portRangeEnd = portEnd;
+    config->mtu = mtu;
+    config->maxMessageSize = maxMessageSize;
+    if (JS_GetOptionalBoolProp(ctx, configVal, "enableIceTcp", &config->enableIceTcp))
+        return JS_ThrowTypeError(ctx, "enableIceTcp should be a boolean");
+    if (JS_GetOptionalBoolProp(ctx, configVal, "enableIceUdpMux", &config->enableIceUdpMux))
+        return JS_ThrowTypeError(ctx, "enableIceUdpMux should be a boolean");
+    if (JS_GetOptionalBoolProp(ctx, configVal, "forceMediaTransport", &config->forceMediaTransport))
+        return JS_ThrowTypeError(ctx, "forceMediaTransport should be a boolean");
     return JS_UNDEFINED;
 }
 
@@ -74,9 +212,64 @@ static JSValue parseConfigurationValue(JSContext *ctx, JSValue configVal, rtcCon
     if (!JS_IsObject(configVal)) 
         return JS_ThrowTypeError(ctx, "The configuration parameter should be an object");
     JSValue iceServers = JS_GetPropertyStr(ctx, configVal, "iceServers");
-    parseIceServersValue(ctx, iceServers, config);
+    JSValue ret = parseIceServersValue(ctx, iceServers, config);
     JS_FreeValue(ctx, iceServers);
-    return JS_UNDEFINED;
+    if (JS_IsException(ret))
+        return ret;
+    JSValue bindAddressVal = JS_GetPropertyStr(ctx, configVal, "bindAddress");
+    if (JS_IsString(bindAddressVal))
+        config->bindAddress = JS_ToCString(ctx, bindAddressVal);
+    else if (!JS_IsUndefined(bindAddressVal))
+        ret = JS_ThrowTypeError(ctx, "bindAddress should be a string");
+    JS_FreeValue(ctx, bindAddressVal);
+    if (JS_IsException(ret))
+        return ret;
+    if (JS_IsException(parseTransportValues(ctx, configVal, config)))
+        return JS_EXCEPTION;
+    return parseCertificateTypeValue(ctx, configVal, config);
+}
+
+static void freeConfiguration(JSContext *ctx, rtcConfiguration *config) {
+    for (int i = 0; i < config->iceServersCount; i++)
+        JS_FreeCString(ctx, config->iceServers[i]);
+    js_free(ctx, config->iceServers);
+    JS_FreeCString(ctx, config->bindAddress);
+}
+
+static int JS_GetOptionalPercentProp(JSContext *ctx, JSValueConst thisObj, const char *prop, double *res) {
+    JSValue val = JS_GetPropertyStr(ctx, thisObj, prop);
+    int status = 0;
+    if (!JS_IsUndefined(val))
+        status = !JS_IsNumber(val) || JS_ToFloat64(ctx, res, val) || !(*res >= 0 && *res <= 100);
+    JS_FreeValue(ctx, val);
+    return status;
+}
+
+// testNetwork: {lossPct, delayMs, jitterMs, bandwidthKbps, reorderPct, seed}
+static JSValue parseTestNetworkValue(JSContext *ctx, JSValue configVal, netImpairmentConfig *config, int *enabled) {
+    JSValue testVal = JS_GetPropertyStr(ctx, configVal, "testNetwork");
+    JSValue ret = JS_UNDEFINED;
+    memset(config, 0, sizeof(netImpairmentConfig));
+    config->seed = 1;
+    *enabled = JS_IsObject(testVal);
+    if (*enabled) {
+        if (JS_GetOptionalPercentProp(ctx, testVal, "lossPct", &config->lossPct))
+            ret = JS_ThrowRangeError(ctx, "testNetwork lossPct should be between 0 and 100");
+        else if (JS_GetOptionalPercentProp(ctx, testVal, "reorderPct", &config->reorderPct))
+            ret = JS_ThrowRangeError(ctx, "testNetwork reorderPct should be between 0 and 100");
+        else if (JS_GetOptionalUint32Prop(ctx, testVal, "delayMs", &config->delayMs))
+            ret = JS_ThrowTypeError(ctx, "Invalid testNetwork delayMs value");
+        else if (JS_GetOptionalUint32Prop(ctx, testVal, "jitterMs", &config->jitterMs))
+            ret = JS_ThrowTypeError(ctx, "Invalid testNetwork jitterMs value");
+        else if (JS_GetOptionalUint32Prop(ctx, testVal, "bandwidthKbps", &config->bandwidthKbps))
+            ret = JS_ThrowTypeError(ctx, "Invalid testNetwork bandwidthKbps value");
+        else if (JS_GetOptionalUint32Prop(ctx, testVal, "seed", &config->seed))
+            ret = JS_ThrowTypeError(ctx, "Invalid testNetwork seed value");
+    } else if (!JS_IsUndefined(testVal)) {
+        ret = JS_ThrowTypeError(ctx, "The testNetwork option should be an object");
+    }
+    JS_FreeValue(ctx, testVal);
+    return ret;
 }
 
 static JSValue candidateToJSValue(JSContext *ctx, Candidate *candidate) {
@@ -131,7 +324,6 @@ static void RTCPeerConnection_onIceCandidate(JSContext *ctx, JSValue this_val, v
         JS_Call(ctx, fn, this_val, 1, &candidateVal);
         JS_FreeValue(ctx, candidateVal);
     }
-    freeCandidate(candidate);
 }
 
 static void RTCPeerConnection_onLocalDescription(JSContext *ctx, JSValue this_val, void *data) {
@@ -143,7 +335,6 @@ static void RTCPeerConnection_onLocalDescription(JSContext *ctx, JSValue this_va
         JS_Call(ctx, fn, this_val, 1, &descVal);
         JS_FreeValue(ctx, descVal);
     }
-    freeSessionDescription(desc);
 }
 
 static JSValue gatheringStateToJsValue(JSContext *ctx, rtcGatheringState state) {
@@ -171,48 +362,87 @@ static void RTCPeerConnection_onIceGatheringStateChange(JSContext *ctx, JSValue
     }
 }
 
+static JSValue attachImpairment(RTCPeerConnection_ClassData *state, JSValue channel) {
+    if (state->impairment && !JS_IsException(channel))
+        setRTCDataChannelImpairment(channel, state->impairment);
+    return channel;
+}
+
 static void RTCPeerConnection_onDataChannel(JSContext *ctx, JSValue this_val, void *data) {
     RTCPeerConnection_ClassData *state = getRTCPeerConnectionClassData(this_val);
     int *channelId = data;
     JSValue fn = state->events[RTC_PEER_CONNECTION_EVENTS_ONDATACHANNEL];
     if (JS_IsFunction(ctx, fn)) { 
-        JSValue channelVal = createRTCDataChannelClass(ctx, *channelId);
-        JS_Call(ctx, fn, this_val, 1, &channelVal);
+        channelCodec *codec = createIncomingChannelCodec(*channelId);
+        JSValue channelVal = attachImpairment(state, createRTCDataChannelClass(ctx, *channelId, codec, 1));
+        *channelId = -1; // owned by channelVal now
+        JS_FreeValue(ctx, JS_Call(ctx, fn, this_val, 1, &channelVal));
+        // the handler had its chance to set the codec up
+        if (!JS_IsException(channelVal))
+            startRTCDataChannelMessages(channelVal);
         JS_FreeValue(ctx, channelVal);
     }
 }
 
+static void freeCandidateEvent(void *data) {
+    if (data)
+        freeCandidate((Candidate *)data);
+    free(data);
+}
+
+static void freeLocalDescriptionEvent(void *data) {
+    freeSessionDescription((SessionDescription *)data);
+    free(data);
+}
+
+// Channels nobody picked up are deleted with the event
+static void freeDataChannelEvent(void *data) {
+    int *channelId = data;
+    if (*channelId >= 0)
+        rtcDeleteDataChannel(*channelId);
+    free(channelId);
+}
+
 static void handleOnIceCandidate(int pc, const char *cand, const char *mid, void *ptr) {
     RTCPeerConnection_ClassData *state = (RTCPeerConnection_ClassData *)ptr;
     Candidate *candidate = NULL;
+    traceSetThreadName("libdatachannel");
+    traceInstant("localCandidate", "pc", pc);
     if (cand != NULL) {
         candidate = malloc(sizeof(Candidate));
         candidate->cand = strdup(cand);
         candidate->mid = strdup(mid);
     }
-    enqueueEvent(RTCPeerConnection_onIceCandidate, state->thisObj, (void *)candidate);
+    enqueueTargetEvent(state->target, RTCPeerConnection_onIceCandidate, (void *)candidate, freeCandidateEvent);
 }
 
 static void handleOnLocalDescription(int pc, const char *sdp, const char *type, void *ptr) {
     RTCPeerConnection_ClassData *state = (RTCPeerConnection_ClassData *)ptr;
     SessionDescription *desc = malloc(sizeof(SessionDescription));
+    traceSetThreadName("libdatachannel");
+    traceInstant("localDescription", "pc", pc);
     desc->type = strdup(type);
     desc->sdp = strdup(sdp);
-    enqueueEvent(RTCPeerConnection_onLocalDescription, state->thisObj, (void *)desc);
+    enqueueTargetEvent(state->target, RTCPeerConnection_onLocalDescription, (void *)desc, freeLocalDescriptionEvent);
 }
 
 static void handleOnIceGatheringStateChange(int pc, rtcGatheringState state, void *ptr) {
     RTCPeerConnection_ClassData *classState = (RTCPeerConnection_ClassData *)ptr;
+    atomic_store(&classState->gatheringState, state);
+    traceSetThreadName("libdatachannel");
+    traceInstant("gatheringStateChange", "state", state);
     rtcGatheringState *pGatheringState = malloc(sizeof(rtcGatheringState));
     *pGatheringState = state;
-    enqueueEvent(RTCPeerConnection_onIceGatheringStateChange, classState->thisObj, (void *)pGatheringState);
+    enqueueTargetEvent(classState->target, RTCPeerConnection_onIceGatheringStateChange, (void *)pGatheringState, NULL);
 }
 
 static void handleOnDataChannel(int pc, int dc, void *ptr) {
     RTCPeerConnection_ClassData *classState = (RTCPeerConnection_ClassData *)ptr;
     int *channelId = malloc(sizeof(int));
+    traceSetThreadName("libdatachannel");
+    traceInstant("dataChannel", "channel", dc);
     *channelId = dc;
-    enqueueEvent(RTCPeerConnection_onDataChannel, classState->thisObj, (void *)channelId);
+    enqueueTargetEvent(classState->target, RTCPeerConnection_onDataChannel, (void *)channelId, freeDataChannelEvent);
 }
 
 static JSValue RTCPeerConnection_GetInternalConnection(
@@ -222,27 +452,36 @@ static JSValue RTCPeerConnection_GetInternalConnection(
     rtcConfiguration config;
     int pc;
     memset(&config, 0, sizeof(rtcConfiguration));
-    if (argc > 0) {
+    if (argc > 0 && !JS_IsUndefined(argv[0])) {
         JSValue out = parseConfigurationValue(ctx, argv[0], &config);
-        if (JS_IsException(out)) return out;
+        if (JS_IsException(out)) {
+            freeConfiguration(ctx, &config);
+            return out;
+        }
     }
     config.disableAutoNegotiation = true;
     pc = rtcCreatePeerConnection(&config);
+    freeConfiguration(ctx, &config);
     if (pc < 0)
         return JS_ThrowInternalError(ctx, "Peer connection creation failed. Status code: %x", pc);
+    peerConnectionCreated = 1;
     *pcId = pc;
     return JS_UNDEFINED;
 }
 
-static JSValue RTCPeerConnection_Constructor(
-    JSContext *ctx, JSValueConst this_val,
-    int argc, JSValueConst *argv)
+JSValue createRTCPeerConnection(JSContext *ctx, int argc, JSValueConst *argv)
 {
     JSValue obj = JS_NewObjectClass(ctx, RTCPeerConnection_Class.id);
     RTCPeerConnection_ClassData *state;
     state = js_mallocz(ctx, sizeof(*state));
     state->ctx = ctx;
-    JSValue res = RTCPeerConnection_GetInternalConnection(ctx, &state->peerConn, argc, argv);
+    netImpairmentConfig impairment;
+    int impaired = 0;
+    JSValue res = JS_UNDEFINED;
+    if (argc > 0 && JS_IsObject(argv[0]))
+        res = parseTestNetworkValue(ctx, argv[0], &impairment, &impaired);
+    if (!JS_IsException(res))
+        res = RTCPeerConnection_GetInternalConnection(ctx, &state->peerConn, argc, argv);
     if (JS_IsException(res)) {
         js_free(ctx, state);
         JS_FreeValue(ctx, obj);
@@ -255,18 +494,122 @@ static JSValue RTCPeerConnection_Constructor(
     rtcSetLocalDescriptionCallback(state->peerConn, handleOnLocalDescription);
     rtcSetGatheringStateChangeCallback(state->peerConn, handleOnIceGatheringStateChange);
     rtcSetDataChannelCallback(state->peerConn, handleOnDataChannel);
-    state->thisObj = obj;
+    if (impaired)
+        state->impairment = netImpairmentCreate(&impairment);
+    state->target = eventTargetCreate(obj);
     JS_SetOpaque(obj, state);
     return obj;
 }
 
+static JSValue RTCPeerConnection_Constructor(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    return createRTCPeerConnection(ctx, argc, argv);
+}
+
+JSValue preloadWebRtc(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    rtcPreload();
+    return JS_UNDEFINED;
+}
+
+static const SctpSettingDef *findSctpSettingDef(const char *name) {
+    for (size_t i = 0; i < countof(sctpSettingDefs); i++) {
+        if (strcmp(sctpSettingDefs[i].name, name) == 0)
+            return &sctpSettingDefs[i];
+    }
+    return NULL;
+}
+
+static JSValue fromJsSctpSetting(JSContext *ctx, JSValueConst settingsVal, JSAtom prop, rtcSctpSettings *settings) {
+    const char *name = JS_AtomToCString(ctx, prop);
+    const SctpSettingDef *def = findSctpSettingDef(name);
+    JSValue ret = JS_UNDEFINED;
+    if (def == NULL) {
+        ret = JS_ThrowTypeError(ctx, "Unknown SCTP setting %s", name);
+    } else {
+        JSValue val = JS_GetProperty(ctx, settingsVal, prop);
+        int32_t num;
+        if (!JS_IsNumber(val) || JS_ToInt32(ctx, &num, val))
+            ret = JS_ThrowTypeError(ctx, "Invalid %s value", name);
+        else if (num < def->min || num > def->max)
+            ret = JS_ThrowRangeError(ctx, "%s should be between %d and %d", name, def->min, def->max);
+        else
+            *(int *)((char *)settings + def->offset) = num;
+        JS_FreeValue(ctx, val);
+    }
+    JS_FreeCString(ctx, name);
+    return ret;
+}
+
+// Fields left out or set to 0 keep the libdatachannel defaults, -1 turns off
+// maxBurst and delayedSackTime
+JSValue setSctpSettings(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    rtcSctpSettings settings;
+    JSPropertyEnum *props;
+    uint32_t propsLen;
+    JSValue ret = JS_UNDEFINED;
+    if (argc == 0 || !JS_IsObject(argv[0]))
+        return JS_ThrowTypeError(ctx, "The SCTP settings should be an object");
+    if (peerConnectionCreated)
+        return JS_ThrowInternalError(ctx, "SCTP settings must be set before the first peer connection is created");
+    if (JS_GetOwnPropertyNames(ctx, &props, &propsLen, argv[0], JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
+        return JS_EXCEPTION;
+    memset(&settings, 0, sizeof(settings));
+    for (uint32_t i = 0; i < propsLen; i++) {
+        if (!JS_IsException(ret))
+            ret = fromJsSctpSetting(ctx, argv[0], props[i].atom, &settings);
+        JS_FreeAtom(ctx, props[i].atom);
+    }
+    js_free(ctx, props);
+    if (JS_IsException(ret))
+        return ret;
+    int status = rtcSetSctpSettings(&settings);
+    if (status < 0)
+        return JS_ThrowInternalError(ctx, "Error setting SCTP settings. Status code: %x", status);
+    return JS_UNDEFINED;
+}
+
+// Events still queued for the connection are dropped, data channels and
+// tracks already handed to JS keep their own lifetime
+static void closePeerConnection(RTCPeerConnection_ClassData *state)
+{
+    if (state->closed)
+        return;
+    state->closed = 1;
+    rtcSetLocalCandidateCallback(state->peerConn, NULL);
+    rtcSetLocalDescriptionCallback(state->peerConn, NULL);
+    rtcSetGatheringStateChangeCallback(state->peerConn, NULL);
+    rtcSetDataChannelCallback(state->peerConn, NULL);
+    rtcClosePeerConnection(state->peerConn);
+    rtcDeletePeerConnection(state->peerConn);
+    eventTargetClose(state->target);
+}
+
+static JSValue RTCPeerConnection_close(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    closePeerConnection(getRTCPeerConnectionClassData(this_val));
+    return JS_UNDEFINED;
+}
+
 static void RTCPeerConnection_Finalizer(JSRuntime *rt, JSValue val) 
 {
     RTCPeerConnection_ClassData *state = getRTCPeerConnectionClassData(val);
     if (state) {
-        rtcDeletePeerConnection(state->peerConn);
+        closePeerConnection(state);
         for (int i = 0 ; i < RTC_PEER_CONNECTION_EVENTS_MAX; i++)
             JS_FreeValueRT(rt, state->events[i]);
+        eventTargetRelease(state->target);
+        if (state->impairment)
+            netImpairmentRelease(state->impairment);
         js_free(state->ctx, state);
     }
 }
@@ -347,17 +690,112 @@ static JSValue RTCPeerConnection_getLocalDescription(JSContext *ctx, JSValueCons
     return toJsRtcSessionDescription(ctx, &sessionDesc); 
 }
 
+static JSValue RTCPeerConnection_getIceGatheringState(JSContext *ctx, JSValueConst this_val)
+{
+    RTCPeerConnection_ClassData *state = getRTCPeerConnectionClassData(this_val);
+    return gatheringStateToJsValue(ctx, atomic_load(&state->gatheringState));
+}
+
+static JSValue fromJsDataChannelInit(JSContext *ctx, JSValueConst val, rtcDataChannelInit *init) {
+    JSValue orderedVal = JS_GetPropertyStr(ctx, val, "ordered");
+    JSValue negotiatedVal = JS_GetPropertyStr(ctx, val, "negotiated");
+    JSValue protocolVal = JS_GetPropertyStr(ctx, val, "protocol");
+    JSValue idVal = JS_GetPropertyStr(ctx, val, "id");
+    JSValue retransmitsVal = JS_GetPropertyStr(ctx, val, "maxRetransmits");
+    JSValue lifeTimeVal = JS_GetPropertyStr(ctx, val, "maxPacketLifeTime");
+    JSValue ret = JS_UNDEFINED;
+    uint32_t num;
+    init->reliability.unordered = !JS_IsUndefined(orderedVal) && !JS_ToBool(ctx, orderedVal);
+    init->negotiated = JS_ToBool(ctx, negotiatedVal);
+    if (!JS_IsUndefined(retransmitsVal) && !JS_IsUndefined(lifeTimeVal)) {
+        ret = JS_ThrowTypeError(ctx, "maxRetransmits and maxPacketLifeTime are mutually exclusive");
+    } else if (!JS_IsUndefined(retransmitsVal)) {
+        if (!JS_IsNumber(retransmitsVal) || JS_ToUint32(ctx, &num, retransmitsVal) || num > UINT16_MAX)
+            ret = JS_ThrowRangeError(ctx, "Invalid maxRetransmits value");
+        init->reliability.unreliable = true;
+        init->reliability.maxRetransmits = num;
+    } else if (!JS_IsUndefined(lifeTimeVal)) {
+        if (!JS_IsNumber(lifeTimeVal) || JS_ToUint32(ctx, &num, lifeTimeVal) || num > UINT16_MAX)
+            ret = JS_ThrowRangeError(ctx, "Invalid maxPacketLifeTime value");
+        init->reliability.unreliable = true;
+        init->reliability.maxPacketLifeTime = num;
+    }
+    if (!JS_IsException(ret) && !JS_IsUndefined(idVal)) {
+        // 65535 is reserved by RFC 8832
+        if (!JS_IsNumber(idVal) || JS_ToUint32(ctx, &num, idVal) || num >= UINT16_MAX)
+            ret = JS_ThrowRangeError(ctx, "Invalid id value");
+        init->manualStream = true;
+        init->stream = num;
+    } else if (!JS_IsException(ret) && init->negotiated) {
+        ret = JS_ThrowTypeError(ctx, "Negotiated data channels need an id");
+    }
+    if (!JS_IsException(ret) && !JS_IsUndefined(protocolVal)) {
+        if (JS_IsString(protocolVal))
+            init->protocol = JS_ToCString(ctx, protocolVal);
+        else
+            ret = JS_ThrowTypeError(ctx, "Invalid protocol value");
+    }
+    JS_FreeValue(ctx, orderedVal);
+    JS_FreeValue(ctx, negotiatedVal);
+    JS_FreeValue(ctx, protocolVal);
+    JS_FreeValue(ctx, idVal);
+    JS_FreeValue(ctx, retransmitsVal);
+    JS_FreeValue(ctx, lifeTimeVal);
+    return ret;
+}
+
 static JSValue RTCPeerConnection_createDataChannel(
     JSContext *ctx, JSValueConst this_val,
     int argc, JSValueConst *argv)
 {
     RTCPeerConnection_ClassData *state = getRTCPeerConnectionClassData(this_val);
-    const char *name = JS_ToCString(ctx, argv[0]);
-    int channelId = rtcCreateDataChannel(state->peerConn, name);
-    if (channelId < 0)
+    rtcDataChannelInit init;
+    channelCodecConfig codecConfig;
+    channelCodec *codec = NULL;
+    const char *name;
+    int channelId;
+    if (argc == 0 || !JS_IsString(argv[0]))
+        return JS_ThrowTypeError(ctx, "Invalid label argument");
+    memset(&init, 0, sizeof(init));
+    memset(&codecConfig, 0, sizeof(codecConfig));
+    if (argc > 1 && !JS_IsUndefined(argv[1])) {
+        if (!JS_IsObject(argv[1]))
+            return JS_ThrowTypeError(ctx, "The data channel options should be an object");
+        if (JS_IsException(fromJsDataChannelInit(ctx, argv[1], &init))
+            || JS_IsException(fromJsChannelCodecConfig(ctx, argv[1], &codecConfig))) {
+            JS_FreeCString(ctx, init.protocol);
+            free(codecConfig.dictionary);
+            return JS_EXCEPTION;
+        }
+    }
+    if (channelCodecConfigEnabled(&codecConfig)) {
+        // the protocol tells the peer the messages are framed
+        if (init.protocol) {
+            JS_FreeCString(ctx, init.protocol);
+            free(codecConfig.dictionary);
+            return JS_ThrowTypeError(ctx, "The codec options set the protocol of the channel");
+        }
+        codec = channelCodecCreate(&codecConfig);
+        if (codec == NULL)
+            return JS_ThrowInternalError(ctx, "Error creating the channel codec");
+    } else {
+        free(codecConfig.dictionary);
+    }
+    name = JS_ToCString(ctx, argv[0]);
+    if (codec) {
+        init.protocol = CHANNEL_CODEC_PROTOCOL;
+        channelId = rtcCreateDataChannelEx(state->peerConn, name, &init);
+    } else {
+        channelId = rtcCreateDataChannelEx(state->peerConn, name, &init);
+        JS_FreeCString(ctx, init.protocol);
+    }
+    JS_FreeCString(ctx, name);
+    if (channelId < 0) {
+        if (codec)
+            channelCodecRelease(codec);
         return JS_ThrowInternalError(ctx, "Error creating data channel. Status code: %x", channelId);
-    //JS_FreeCString(ctx, name);
-    return createRTCDataChannelClass(ctx, channelId);
+    }
+    return attachImpairment(state, createRTCDataChannelClass(ctx, channelId, codec, 0));
 }
 
 static int JS_GetInt32Prop(JSContext *ctx, JSValueConst thisObj, const char *prop, int *res) {
@@ -367,11 +805,151 @@ static int JS_GetInt32Prop(JSContext *ctx, JSValueConst thisObj, const char *pro
     return status;
 }
 
-static const char* JS_GetCStringProp(JSContext *ctx, JSValueConst thisObj, const char *prop) {
-    JSValue val = JS_GetPropertyStr(ctx, thisObj, prop);
-    const char *str = JS_ToCString(ctx, val);
-    JS_FreeValue(ctx, val);
-    return str;
+static JSValue fromJsNackHistoryOption(JSContext *ctx, JSValue val, AddTrackOptions *opts) {
+    JSValue nackVal = JS_GetPropertyStr(ctx, val, "nackHistory");
+    JSValue ret = JS_UNDEFINED;
+    opts->nackMode = RTC_TRACK_NACK_FIXED;
+    opts->nackHistory = NACK_HISTORY_DEFAULT_PACKETS;
+    opts->maxBitrate = 0;
+    opts->rtt = 0;
+    if (JS_IsString(nackVal)) {
+        const char *mode = JS_ToCString(ctx, nackVal);
+        if (strcmp(mode, "adaptive") == 0)
+            opts->nackMode = RTC_TRACK_NACK_ADAPTIVE;
+        else
+            ret = JS_ThrowTypeError(ctx, "Invalid nackHistory value");
+        JS_FreeCString(ctx, mode);
+    } else if (JS_IsNumber(nackVal)) {
+        JS_ToUint32(ctx, &opts->nackHistory, nackVal);
+        if (opts->nackHistory > NACK_HISTORY_MAX_PACKETS)
+            ret = JS_ThrowRangeError(ctx, "nackHistory should be at most %d packets", NACK_HISTORY_MAX_PACKETS);
+    } else if (!JS_IsUndefined(nackVal)) {
+        ret = JS_ThrowTypeError(ctx, "Invalid nackHistory value");
+    }
+    JS_FreeValue(ctx, nackVal);
+    if (JS_IsException(ret))
+        return ret;
+    if (JS_GetOptionalUint32Prop(ctx, val, "maxBitrate", &opts->maxBitrate))
+        return JS_ThrowTypeError(ctx, "Invalid maxBitrate value");
+    uint32_t rtt = 0;
+    if (JS_GetOptionalUint32Prop(ctx, val, "rtt", &rtt))
+        return JS_ThrowTypeError(ctx, "Invalid rtt value");
+    if (rtt > MAX_TRACK_RTT)
+        return JS_ThrowRangeError(ctx, "rtt should be at most %d ms", MAX_TRACK_RTT);
+    opts->rtt = (int)rtt;
+    return JS_UNDEFINED;
+}
+
+static JSValue fromJsPacingOption(JSContext *ctx, JSValue val, AddTrackOptions *opts) {
+    JSValue pacingVal = JS_GetPropertyStr(ctx, val, "pacing");
+    JSValue ret = JS_UNDEFINED;
+    opts->pacingRate = 0;
+    opts->pacingBurst = DEFAULT_PACING_BURST;
+    if (JS_IsObject(pacingVal)) {
+        if (JS_GetOptionalUint32Prop(ctx, pacingVal, "rate", &opts->pacingRate) || opts->pacingRate == 0)
+            ret = JS_ThrowTypeError(ctx, "Invalid pacing rate value");
+        else if (JS_GetOptionalUint32Prop(ctx, pacingVal, "burst", &opts->pacingBurst))
+            ret = JS_ThrowTypeError(ctx, "Invalid pacing burst value");
+    } else if (!JS_IsUndefined(pacingVal)) {
+        ret = JS_ThrowTypeError(ctx, "The pacing option should be an object");
+    }
+    JS_FreeValue(ctx, pacingVal);
+    return ret;
+}
+
+static JSValue fromJsLayer(JSContext *ctx, JSValue layerVal, AddTrackOptions *opts) {
+    RTCTrack_Layer *layer = &opts->layers[opts->layersLen];
+    JSValue ridVal = JS_GetPropertyStr(ctx, layerVal, "rid");
+    JSValue ret = JS_UNDEFINED;
+    size_t ridLen;
+    const char *rid = JS_IsString(ridVal) ? JS_ToCStringLen(ctx, &ridLen, ridVal) : NULL;
+    JS_FreeValue(ctx, ridVal);
+    if (rid == NULL || ridLen == 0 || ridLen >= RTC_TRACK_MAX_RID_LEN || strcmp(rid, "auto") == 0) {
+        ret = JS_ThrowTypeError(ctx, "Invalid layer rid value");
+    } else {
+        for (int i = 0; i < opts->layersLen; i++) {
+            if (strcmp(opts->layers[i].rid, rid) == 0)
+                ret = JS_ThrowTypeError(ctx, "Duplicate layer rid %s", rid);
+        }
+        strcpy(layer->rid, rid);
+    }
+    JS_FreeCString(ctx, rid);
+    if (JS_IsException(ret))
+        return ret;
+    layer->maxBitrate = 0;
+    if (JS_GetOptionalUint32Prop(ctx, layerVal, "maxBitrate", &layer->maxBitrate))
+        return JS_ThrowTypeError(ctx, "Invalid layer maxBitrate value");
+    opts->layersLen++;
+    return JS_UNDEFINED;
+}
+
+static JSValue fromJsLayersOption(JSContext *ctx, JSValue val, AddTrackOptions *opts) {
+    JSValue layersVal = JS_GetPropertyStr(ctx, val, "layers");
+    JSValue ret = JS_UNDEFINED;
+    opts->layersLen = 0;
+    if (JS_IsArray(ctx, layersVal)) {
+        uint32_t len = JS_GetArrayLength(ctx, layersVal);
+        if (len == 0 || len > RTC_TRACK_MAX_LAYERS)
+            ret = JS_ThrowRangeError(ctx, "A track takes 1 to %d layers", RTC_TRACK_MAX_LAYERS);
+        for (uint32_t i = 0; i < len && !JS_IsException(ret); i++) {
+            JSValue layerVal = JS_GetPropertyUint32(ctx, layersVal, i);
+            ret = JS_IsObject(layerVal)
+                ? fromJsLayer(ctx, layerVal, opts)
+                : JS_ThrowTypeError(ctx, "Each layer should be an object");
+            JS_FreeValue(ctx, layerVal);
+        }
+    } else if (!JS_IsUndefined(layersVal)) {
+        ret = JS_ThrowTypeError(ctx, "The layers option should be an array");
+    }
+    JS_FreeValue(ctx, layersVal);
+    return ret;
+}
+
+// delay is a hold time in ms or 'adaptive'
+static JSValue fromJsJitterDelay(JSContext *ctx, JSValue jitterVal, jitterBufferConfig *jitter) {
+    JSValue delayVal = JS_GetPropertyStr(ctx, jitterVal, "delay");
+    JSValue ret = JS_UNDEFINED;
+    if (JS_IsString(delayVal)) {
+        const char *mode = JS_ToCString(ctx, delayVal);
+        if (strcmp(mode, "adaptive") == 0)
+            jitter->adaptive = 1;
+        else
+            ret = JS_ThrowTypeError(ctx, "Invalid jitterBuffer delay value");
+        JS_FreeCString(ctx, mode);
+    } else if (JS_IsNumber(delayVal)) {
+        JS_ToUint32(ctx, &jitter->delayMs, delayVal);
+    } else if (!JS_IsUndefined(delayVal)) {
+        ret = JS_ThrowTypeError(ctx, "Invalid jitterBuffer delay value");
+    }
+    JS_FreeValue(ctx, delayVal);
+    return ret;
+}
+
+static JSValue fromJsJitterBufferOption(JSContext *ctx, JSValue val, AddTrackOptions *opts) {
+    JSValue jitterVal = JS_GetPropertyStr(ctx, val, "jitterBuffer");
+    JSValue ret = JS_UNDEFINED;
+    jitterBufferConfig *jitter = &opts->jitter;
+    opts->jitterBuffer = 0;
+    jitter->adaptive = 0;
+    jitter->delayMs = JITTER_BUFFER_DEFAULT_DELAY_MS;
+    jitter->minDelayMs = JITTER_BUFFER_DEFAULT_MIN_DELAY_MS;
+    jitter->maxDelayMs = JITTER_BUFFER_DEFAULT_MAX_DELAY_MS;
+    jitter->clockRate = opts->codec == RTC_CODEC_OPUS ? 48000 : 90000;
+    if (JS_IsObject(jitterVal)) {
+        opts->jitterBuffer = 1;
+        if (JS_IsException(fromJsJitterDelay(ctx, jitterVal, jitter)))
+            ret = JS_EXCEPTION;
+        else if (JS_GetOptionalUint32Prop(ctx, jitterVal, "minDelay", &jitter->minDelayMs))
+            ret = JS_ThrowTypeError(ctx, "Invalid jitterBuffer minDelay value");
+        else if (JS_GetOptionalUint32Prop(ctx, jitterVal, "maxDelay", &jitter->maxDelayMs))
+            ret = JS_ThrowTypeError(ctx, "Invalid jitterBuffer maxDelay value");
+        else if (jitter->minDelayMs > jitter->maxDelayMs)
+            ret = JS_ThrowRangeError(ctx, "jitterBuffer minDelay should not exceed maxDelay");
+    } else if (!JS_IsUndefined(jitterVal)) {
+        ret = JS_ThrowTypeError(ctx, "The jitterBuffer option should be an object");
+    }
+    JS_FreeValue(ctx, jitterVal);
+    return ret;
 }
 
 static JSValue fromJsAddTrackOptions(JSContext *ctx, JSValue val, AddTrackOptions *opts) {
@@ -389,6 +967,21 @@ static JSValue fromJsAddTrackOptions(JSContext *ctx, JSValue val, AddTrackOption
         return JS_ThrowTypeError(ctx, "Invalid ssrc value");
     if (JS_GetInt32Prop(ctx, val, "payloadType", &opts->payloadType))
         return JS_ThrowTypeError(ctx, "Invalid payloadType value");
+    opts->keyframeRequestInterval = DEFAULT_KEYFRAME_REQUEST_INTERVAL;
+    if (JS_GetOptionalUint32Prop(ctx, val, "keyframeRequestInterval", &opts->keyframeRequestInterval))
+        return JS_ThrowTypeError(ctx, "Invalid keyframeRequestInterval value");
+    if (JS_IsException(fromJsPacingOption(ctx, val, opts)))
+        return JS_EXCEPTION;
+    if (JS_IsException(fromJsLayersOption(ctx, val, opts)))
+        return JS_EXCEPTION;
+    if (JS_IsException(fromJsJitterBufferOption(ctx, val, opts)))
+        return JS_EXCEPTION;
+    JSValue packetizationVal = JS_GetPropertyStr(ctx, val, "packetization");
+    opts->packetization = JS_IsUndefined(packetizationVal) || JS_ToBool(ctx, packetizationVal);
+    JS_FreeValue(ctx, packetizationVal);
+    if (!opts->packetization && opts->pacingRate > 0)
+        return JS_ThrowTypeError(ctx, "Pacing needs packetization");
+    return fromJsNackHistoryOption(ctx, val, opts);
 }
 
 static int addTrackWithOptions(int peerConn, AddTrackOptions *opts) {
@@ -424,7 +1017,8 @@ static JSValue RTCPeerConnection_addTrack(
     int argc, JSValueConst *argv)
 {
     RTCPeerConnection_ClassData *state = getRTCPeerConnectionClassData(this_val);
-    AddTrackOptions opts;
+    AddTrackOptions opts = {0};
+    RTCTrack_Config trackConfig;
     JSValue convRes;
     int trackId;
     if (argc == 0 || !JS_IsObject(argv[0]))
@@ -435,11 +1029,31 @@ static JSValue RTCPeerConnection_addTrack(
     trackId = addTrackWithOptions(state->peerConn, &opts);
     if (trackId < 0)
         return JS_ThrowInternalError(ctx, "Error adding track. Status code: %x", trackId);
-    if (setTrackPacketizationHandler(trackId, &opts) < 0)
-        return JS_ThrowInternalError(ctx, "Error setting up packetization handler");
-    rtcChainRtcpSrReporter(trackId);
-    rtcChainRtcpNackResponder(trackId, 128);
-    return createRTCTrackClass(ctx, trackId);
+    // without packetization the track sends RTP as given, which forwardTo()
+    // needs. Paced tracks packetize in the pacer to release single packets.
+    if (opts.packetization && opts.pacingRate == 0) {
+        if (setTrackPacketizationHandler(trackId, &opts) < 0)
+            return JS_ThrowInternalError(ctx, "Error setting up packetization handler");
+        rtcChainRtcpSrReporter(trackId);
+    }
+    trackConfig = (RTCTrack_Config) {
+        .ssrc = opts.ssrc,
+        .payloadType = opts.payloadType,
+        .nalUnitSeparator = opts.nalUnitSeparator,
+        .nackMode = opts.nackMode,
+        .nackHistory = opts.nackHistory,
+        .maxBitrate = opts.maxBitrate,
+        .rtt = opts.rtt,
+        .keyframeRequestInterval = opts.keyframeRequestInterval,
+        .pacingRate = opts.pacingRate,
+        .pacingBurst = opts.pacingBurst,
+        .layersLen = opts.layersLen,
+        .packetization = opts.packetization,
+        .jitterBuffer = opts.jitterBuffer,
+        .jitter = opts.jitter
+    };
+    memcpy(trackConfig.layers, opts.layers, sizeof(trackConfig.layers));
+    return attachImpairment(state, createRTCTrackClass(ctx, trackId, &trackConfig));
 }
 
 static JSValue RTCPeerConnection_EventGet(
@@ -462,14 +1076,35 @@ static JSValue RTCPeerConnection_EventSet(
     return JS_UNDEFINED;
 }
 
+static JSValue RTCPeerConnection_getTestNetworkStats(JSContext *ctx, JSValueConst this_val)
+{
+    RTCPeerConnection_ClassData *state = getRTCPeerConnectionClassData(this_val);
+    netImpairmentStats stats;
+    if (state->impairment == NULL)
+        return JS_NULL;
+    netImpairmentGetStats(state->impairment, &stats);
+    JSValue ret = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, ret, "received", JS_NewFloat64(ctx, (double)stats.received));
+    JS_SetPropertyStr(ctx, ret, "delivered", JS_NewFloat64(ctx, (double)stats.delivered));
+    JS_SetPropertyStr(ctx, ret, "lost", JS_NewFloat64(ctx, (double)stats.lost));
+    JS_SetPropertyStr(ctx, ret, "reordered", JS_NewFloat64(ctx, (double)stats.reordered));
+    JS_SetPropertyStr(ctx, ret, "overflowed", JS_NewFloat64(ctx, (double)stats.overflowed));
+    JS_SetPropertyStr(ctx, ret, "queued", JS_NewUint32(ctx, stats.queued));
+    JS_SetPropertyStr(ctx, ret, "queuedBytes", JS_NewFloat64(ctx, (double)stats.queuedBytes));
+    return ret;
+}
+
 static JSCFunctionListEntry RTCPeerConnection_Methods[] = {
     JS_CFUNC_DEF("createOffer", 0, RTCPeerConnection_createOffer),
     JS_CFUNC_DEF("createAnswer", 0, RTCPeerConnection_createAnswer),
     JS_CGETSET_DEF("localDescription", RTCPeerConnection_getLocalDescription, NULL),
+    JS_CGETSET_DEF("iceGatheringState", RTCPeerConnection_getIceGatheringState, NULL),
     JS_CFUNC_DEF("setRemoteDescription", 1, RTCPeerConnection_setRemoteDescription),
     JS_CFUNC_DEF("addIceCandidate", 1, RTCPeerConnection_addIceCandidate),
-    JS_CFUNC_DEF("createDataChannel", 1, RTCPeerConnection_createDataChannel),
+    JS_CFUNC_DEF("createDataChannel", 2, RTCPeerConnection_createDataChannel),
     JS_CFUNC_DEF("addTrack", 1, RTCPeerConnection_addTrack),
+    JS_CFUNC_DEF("close", 0, RTCPeerConnection_close),
+    JS_CGETSET_DEF("testNetworkStats", RTCPeerConnection_getTestNetworkStats, NULL),
     JS_CGETSET_MAGIC_DEF("onicecandidate", 
         RTCPeerConnection_EventGet, 
         RTCPeerConnection_EventSet, 
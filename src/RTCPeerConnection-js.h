@@ -4,5 +4,10 @@
 #include "js-utils.h"
 
 extern JSFullClassDef RTCPeerConnection_Class;
+JSValue createRTCPeerConnection(JSContext *ctx, int argc, JSValueConst *argv);
+int getRTCPeerConnectionId(JSValueConst this_val);
+int isRTCPeerConnectionGatheringComplete(JSValueConst this_val);
+JSValue preloadWebRtc(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+JSValue setSctpSettings(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include "RTCPeerConnectionPool-js.h"
+#include "RTCPeerConnection-js.h"
+#include "event-queue.h"
+#include "logger.h"
+#include "timer-wheel.h"
+#include <rtc/rtc.h>
+
+#define POOL_MAX_SIZE 4096
+#define POOL_REFILL_INTERVAL_US 1000
+#define POOL_REFILL_MAX_BACKOFF_US 1000000
+
+typedef struct {
+    JSContext *ctx;
+    JSValue thisObj;
+    eventTarget *target;
+    JSValue configuration;
+    JSValue prepare;
+    int gather;
+    uint32_t size;
+    uint32_t count;
+    JSValue *entries;
+    int refillPending;
+    uint64_t refillBackoffUs; // 0 until a refill fails
+    uint32_t created;
+    uint32_t acquired;
+    uint32_t misses;
+} RTCPeerConnectionPool_ClassData;
+
+static RTCPeerConnectionPool_ClassData* getRTCPeerConnectionPoolClassData(JSValueConst this_val) {
+    return JS_GetOpaque(this_val, RTCPeerConnectionPool_Class.id);
+}
+
+// Creates a connection, lets the prepare callback add channels or tracks and
+// sets the local offer so ICE gathering runs while it sits in the pool.
+static JSValue createPooledConnection(JSContext *ctx, RTCPeerConnectionPool_ClassData *state) {
+    JSValue pc = createRTCPeerConnection(ctx, JS_IsUndefined(state->configuration) ? 0 : 1, &state->configuration);
+    if (JS_IsException(pc))
+        return pc;
+    if (JS_IsFunction(ctx, state->prepare)) {
+        JSValue ret = JS_Call(ctx, state->prepare, state->thisObj, 1, &pc);
+        if (JS_IsException(ret)) {
+            JS_FreeValue(ctx, pc);
+            return ret;
+        }
+        JS_FreeValue(ctx, ret);
+    }
+    int pcId = getRTCPeerConnectionId(pc);
+    if (state->gather && rtcGetLocalDescriptionType(pcId, NULL, 0) <= 0)
+        rtcSetLocalDescription(pcId, "offer");
+    state->created++;
+    return pc;
+}
+
+static void scheduleRefill(RTCPeerConnectionPool_ClassData *state, uint64_t delayUs);
+
+static void RTCPeerConnectionPool_onRefill(JSContext *ctx, JSValue this_val, void *data) {
+    RTCPeerConnectionPool_ClassData *state = getRTCPeerConnectionPoolClassData(this_val);
+    state->refillPending = 0;
+    if (state->count >= state->size)
+        return;
+    JSValue pc = createPooledConnection(ctx, state);
+    if (JS_IsException(pc)) {
+        // Nobody can catch it here, retry with a doubling delay
+        JSValue exception = JS_GetException(ctx);
+        const char *message = JS_ToCString(ctx, exception);
+        state->refillBackoffUs = state->refillBackoffUs
+            ? state->refillBackoffUs * 2 : POOL_REFILL_INTERVAL_US * 10;
+        if (state->refillBackoffUs > POOL_REFILL_MAX_BACKOFF_US)
+            state->refillBackoffUs = POOL_REFILL_MAX_BACKOFF_US;
+        logMessage(RTC_LOG_WARNING, "Pool refill failed, retrying in %llu ms: %s",
+            (unsigned long long)(state->refillBackoffUs / 1000), message ? message : "unknown error");
+        JS_FreeCString(ctx, message);
+        JS_FreeValue(ctx, exception);
+        scheduleRefill(state, state->refillBackoffUs);
+        return;
+    }
+    state->refillBackoffUs = 0;
+    state->entries[state->count++] = pc;
+    scheduleRefill(state, POOL_REFILL_INTERVAL_US);
+}
+
+// The timer only holds the event target, the pool may be gone by now
+static void fireRefill(void *opaque) {
+    eventTarget *target = opaque;
+    enqueueTargetEvent(target, RTCPeerConnectionPool_onRefill, NULL, NULL);
+    eventTargetRelease(target);
+}
+
+// A refill creates one connection. The next one waits for a timer wheel
+// tick, so the os loop runs its timers and I/O in between.
+static void scheduleRefill(RTCPeerConnectionPool_ClassData *state, uint64_t delayUs) {
+    if (state->refillPending || state->count >= state->size)
+        return;
+    state->refillPending = 1;
+    if (delayUs == 0) {
+        enqueueTargetEvent(state->target, RTCPeerConnectionPool_onRefill, NULL, NULL);
+        return;
+    }
+    eventTargetRetain(state->target);
+    timerWheelSchedule(delayUs, fireRefill, state->target);
+}
+
+static JSValue RTCPeerConnectionPool_Constructor(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCPeerConnectionPool_ClassData *state;
+    uint32_t size;
+    JSValue sizeVal, gatherVal;
+    if (argc == 0 || !JS_IsObject(argv[0]))
+        return JS_ThrowTypeError(ctx, "The pool options should be an object");
+    sizeVal = JS_GetPropertyStr(ctx, argv[0], "size");
+    if (!JS_IsNumber(sizeVal) || JS_ToUint32(ctx, &size, sizeVal) || size == 0 || size > POOL_MAX_SIZE) {
+        JS_FreeValue(ctx, sizeVal);
+        return JS_ThrowRangeError(ctx, "The pool size should be between 1 and %d", POOL_MAX_SIZE);
+    }
+    JSValue obj = JS_NewObjectClass(ctx, RTCPeerConnectionPool_Class.id);
+    state = js_mallocz(ctx, sizeof(*state));
+    state->ctx = ctx;
+    state->thisObj = obj;
+    state->target = eventTargetCreate(obj);
+    state->size = size;
+    state->entries = js_mallocz(ctx, sizeof(JSValue) * size);
+    state->configuration = JS_GetPropertyStr(ctx, argv[0], "configuration");
+    state->prepare = JS_GetPropertyStr(ctx, argv[0], "prepare");
+    gatherVal = JS_GetPropertyStr(ctx, argv[0], "gather");
+    state->gather = JS_IsUndefined(gatherVal) || JS_ToBool(ctx, gatherVal);
+    JS_FreeValue(ctx, gatherVal);
+    JS_SetOpaque(obj, state);
+    scheduleRefill(state, 0);
+    return obj;
+}
+
+static void RTCPeerConnectionPool_Finalizer(JSRuntime *rt, JSValue val)
+{
+    RTCPeerConnectionPool_ClassData *state = getRTCPeerConnectionPoolClassData(val);
+    if (state) {
+        for (uint32_t i = 0; i < state->count; i++)
+            JS_FreeValueRT(rt, state->entries[i]);
+        JS_FreeValueRT(rt, state->configuration);
+        JS_FreeValueRT(rt, state->prepare);
+        eventTargetClose(state->target);
+        eventTargetRelease(state->target);
+        js_free(state->ctx, state->entries);
+        js_free(state->ctx, state);
+    }
+}
+
+static void RTCPeerConnectionPool_GcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
+{
+    RTCPeerConnectionPool_ClassData *state = getRTCPeerConnectionPoolClassData(val);
+    if (state) {
+        for (uint32_t i = 0; i < state->count; i++)
+            JS_MarkValue(rt, state->entries[i], mark_func);
+        JS_MarkValue(rt, state->configuration, mark_func);
+        JS_MarkValue(rt, state->prepare, mark_func);
+    }
+}
+
+// Hands out the oldest connection that finished gathering, or the oldest one
+// if none has. Events raised while pooled are not replayed, localDescription
+// and iceGatheringState tell what happened.
+static JSValue RTCPeerConnectionPool_acquire(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCPeerConnectionPool_ClassData *state = getRTCPeerConnectionPoolClassData(this_val);
+    JSValue pc;
+    uint32_t index = 0;
+    if (state->count == 0) {
+        state->misses++;
+        pc = createPooledConnection(ctx, state);
+    } else {
+        while (index < state->count && !isRTCPeerConnectionGatheringComplete(state->entries[index]))
+            index++;
+        if (index == state->count)
+            index = 0;
+        pc = state->entries[index];
+        state->count--;
+        for (uint32_t i = index; i < state->count; i++)
+            state->entries[i] = state->entries[i + 1];
+    }
+    if (!JS_IsException(pc))
+        state->acquired++;
+    scheduleRefill(state, 0);
+    return pc;
+}
+
+static JSValue RTCPeerConnectionPool_getStats(JSContext *ctx, JSValueConst this_val)
+{
+    RTCPeerConnectionPool_ClassData *state = getRTCPeerConnectionPoolClassData(this_val);
+    uint32_t ready = 0;
+    for (uint32_t i = 0; i < state->count; i++)
+        ready += isRTCPeerConnectionGatheringComplete(state->entries[i]);
+    JSValue stats = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, stats, "size", JS_NewUint32(ctx, state->size));
+    JS_SetPropertyStr(ctx, stats, "available", JS_NewUint32(ctx, state->count));
+    JS_SetPropertyStr(ctx, stats, "ready", JS_NewUint32(ctx, ready));
+    JS_SetPropertyStr(ctx, stats, "created", JS_NewUint32(ctx, state->created));
+    JS_SetPropertyStr(ctx, stats, "acquired", JS_NewUint32(ctx, state->acquired));
+    JS_SetPropertyStr(ctx, stats, "misses", JS_NewUint32(ctx, state->misses));
+    return stats;
+}
+
+static JSCFunctionListEntry RTCPeerConnectionPool_Methods[] = {
+    JS_CFUNC_DEF("acquire", 0, RTCPeerConnectionPool_acquire),
+    JS_CGETSET_DEF("stats", RTCPeerConnectionPool_getStats, NULL)
+};
+
+JSFullClassDef RTCPeerConnectionPool_Class = {
+    .def = {
+        .class_name = "RTCPeerConnectionPool",
+        .finalizer = RTCPeerConnectionPool_Finalizer,
+        .gc_mark = RTCPeerConnectionPool_GcMark,
+    },
+    .constructor = { RTCPeerConnectionPool_Constructor, .args_count = 1 },
+    .funcs_len = sizeof(RTCPeerConnectionPool_Methods),
+    .funcs = RTCPeerConnectionPool_Methods
+};
@@ -0,0 +1,8 @@
+#ifndef __RTC_PEER_CONNECTION_POOL_JS_H
+#define __RTC_PEER_CONNECTION_POOL_JS_H
+
+#include "js-utils.h"
+
+extern JSFullClassDef RTCPeerConnectionPool_Class;
+
+#endif
@@ -1,13 +1,608 @@
 #include "RTCDataChannelBase-js.h"
 #include "RTCTrack-js.h"
 #include "event-queue.h"
+#include "frame-ring.h"
+#include "h264-utils.h"
+#include "jitter-buffer.h"
+#include "nack-history.h"
+#include "pacer.h"
+#include "rtcp-parser.h"
+#include "rtp-forwarder.h"
+#include "timer-wheel.h"
+#include "time-utils.h"
+#include "trace.h"
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-static void RTCTrack_Finalizer(JSRuntime *rt, JSValue val) {
-    int trackId = getRTCDataChannelId(val);
+#define RTP_HEADER_SIZE 12
+#define BITRATE_WINDOW_US 1000000
+#define REMB_VALIDITY_US 2000000
+#define LOSS_HIGH_FRACTION 26 // ~10%, out of 256
+#define LOSS_LOW_FRACTION 5   // ~2%, out of 256
+
+enum {
+    RTC_TRACK_EVENTS_ONKEYFRAMEREQUEST,
+    RTC_TRACK_EVENTS_ONBITRATEESTIMATE,
+    RTC_TRACK_EVENTS_ONPLAYOUT,
+    RTC_TRACK_EVENTS_MAX,
+};
+
+typedef struct {
+    int trackId;
+    int closed;
+    eventTarget *target;
+    JSValue events[RTC_TRACK_EVENTS_MAX];
+    RTCTrack_Config config;
+    uint16_t maxFragmentSize;
+    uint32_t packetSize;
+    uint32_t nackPackets;
+    uint64_t windowStart;
+    uint64_t windowBytes;
+    atomic_uint bitrate;
+    uint32_t reportedPli;
+    uint32_t reportedFir;
+    pacer *pacer;
+    jitterBuffer *jitter;
+    // inbound RTP relayed to other tracks, and this track's side as an output
+    rtpForwarder *forwarder;
+    rtpForwardOutput forwardOutput;
+    // frames pulled from a SharedArrayBuffer on the reader thread
+    JSValue ring;
+    frameRingReader *ringReader;
+    int ringWaitKeyframe;
+    atomic_uint ringFramesSent;
+    atomic_uint ringFramesSkipped;
+    // written on the libdatachannel thread
+    atomic_uint sentPackets;
+    atomic_uint nackRequests;
+    atomic_uint retransmitHits;
+    atomic_uint retransmitMisses;
+    atomic_int rtt;
+    atomic_uint pliRequests;
+    atomic_uint firRequests;
+    atomic_bool keyframeRequestPending;
+    atomic_uint_fast64_t lastKeyframeRequest;
+    atomic_bool trailingKeyframeRequest;
+    atomic_uint bitrateEstimate;
+    atomic_bool bitrateEstimatePending;
+    atomic_uint_fast64_t lastRemb;
+    // simulcast, JS thread only. Switches wait for a keyframe on the target.
+    int activeLayer;
+    int pendingLayer;
+    int autoLayer;
+    uint32_t layerFramesSent[RTC_TRACK_MAX_LAYERS];
+    uint32_t layerFramesDropped[RTC_TRACK_MAX_LAYERS];
+    uint32_t layerSwitches;
+} RTCTrack_State;
+
+static const RTCDataChannelBase_Hooks RTCTrack_Hooks;
+
+static RTCTrack_State *getRTCTrackState(JSValueConst this_val) {
+    return getRTCDataChannelOpaque(this_val);
+}
+
+static void RTCTrack_close(int trackId, void *opaque) {
+    RTCTrack_State *track = (RTCTrack_State *)opaque;
+    track->closed = 1;
+    // the reader sends through the pacer, stop it first
+    if (track->ringReader)
+        frameRingReaderDestroy(track->ringReader);
+    track->ringReader = NULL;
+    // no message callback runs once the track is deleted, so the feedback
+    // handlers can't reach what is destroyed below
+    rtcClose(trackId);
     rtcDeleteTrack(trackId);
+    if (track->pacer)
+        pacerDestroy(track->pacer);
+    track->pacer = NULL;
+    if (track->jitter)
+        jitterBufferDestroy(track->jitter);
+    track->jitter = NULL;
+    if (track->forwardOutput.source)
+        rtpForwarderRemove(track->forwardOutput.source, &track->forwardOutput);
+    rtpForwarderDestroy(track->forwarder);
+    track->forwarder = NULL;
+    nackHistoryRelease(track->nackPackets, track->packetSize);
+    track->nackPackets = 0;
+}
+
+static void RTCTrack_Finalizer(JSRuntime *rt, JSValue val) {
+    RTCTrack_State *track = getRTCTrackState(val);
+    for (int i = 0 ; i < RTC_TRACK_EVENTS_MAX; i++)
+        JS_FreeValueRT(rt, track->events[i]);
+    JS_FreeValueRT(rt, track->ring);
+}
+
+static void RTCTrack_GcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func) {
+    RTCTrack_State *track = getRTCTrackState(val);
+    for (int i = 0 ; i < RTC_TRACK_EVENTS_MAX; i++)
+        JS_MarkValue(rt, track->events[i], mark_func);
+    JS_MarkValue(rt, track->ring, mark_func);
+}
+
+static void RTCTrack_onKeyframeRequest(JSContext *ctx, JSValue this_val, void *data) {
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    uint32_t pli = atomic_load(&track->pliRequests);
+    uint32_t fir = atomic_load(&track->firRequests);
+    JSValue fn = track->events[RTC_TRACK_EVENTS_ONKEYFRAMEREQUEST];
+    atomic_store(&track->keyframeRequestPending, false);
+    if (JS_IsFunction(ctx, fn)) {
+        JSValue arg = JS_NewObject(ctx);
+        JS_SetPropertyStr(ctx, arg, "pli", JS_NewUint32(ctx, pli - track->reportedPli));
+        JS_SetPropertyStr(ctx, arg, "fir", JS_NewUint32(ctx, fir - track->reportedFir));
+        if (track->pendingLayer >= 0 && track->pendingLayer != track->activeLayer)
+            JS_SetPropertyStr(ctx, arg, "rid", JS_NewString(ctx, track->config.layers[track->pendingLayer].rid));
+        JS_FreeValue(ctx, JS_Call(ctx, fn, this_val, 1, &arg));
+        JS_FreeValue(ctx, arg);
+    }
+    track->reportedPli = pli;
+    track->reportedFir = fir;
+    // a forwarded output has no encoder, the source's sender makes keyframes
+    if (track->forwardOutput.source)
+        rtpForwarderRequestKeyframe(track->forwardOutput.source);
+}
+
+static void RTCTrack_onBitrateEstimate(JSContext *ctx, JSValue this_val, void *data) {
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    JSValue fn = track->events[RTC_TRACK_EVENTS_ONBITRATEESTIMATE];
+    atomic_store(&track->bitrateEstimatePending, false);
+    if (JS_IsFunction(ctx, fn)) {
+        JSValue arg = JS_NewUint32(ctx, atomic_load(&track->bitrateEstimate));
+        JS_FreeValue(ctx, JS_Call(ctx, fn, this_val, 1, &arg));
+    }
+}
+
+static void freeArrayBufferPacket(JSRuntime *rt, void *opaque, void *ptr) {
+    free(ptr);
+}
+
+// The packets of one batch are handed over to JS without copies
+static void RTCTrack_onPlayout(JSContext *ctx, JSValue this_val, void *data) {
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    jitterBatch *batch = data;
+    JSValue fn = track->events[RTC_TRACK_EVENTS_ONPLAYOUT];
+    if (!JS_IsFunction(ctx, fn))
+        return;
+    JSValue packets = JS_NewArray(ctx);
+    for (size_t i = 0; i < batch->count; i++) {
+        jitterPacket *packet = &batch->packets[i];
+        JS_SetPropertyUint32(ctx, packets, i, JS_NewArrayBuffer(ctx, packet->buf, packet->len,
+            freeArrayBufferPacket, NULL, 0));
+        packet->buf = NULL;
+    }
+    JS_FreeValue(ctx, JS_Call(ctx, fn, this_val, 1, &packets));
+    JS_FreeValue(ctx, packets);
+}
+
+static void freePlayoutBatch(void *data) {
+    jitterBufferFreeBatch(data);
+}
+
+static void RTCTrack_onJitterRelease(jitterBatch *batch, void *opaque) {
+    RTCTrack_State *track = opaque;
+    enqueueTargetEvent(track->target, RTCTrack_onPlayout, batch, freePlayoutBatch);
+}
+
+static void requestKeyframe(RTCTrack_State *track) {
+    if (!atomic_exchange(&track->keyframeRequestPending, true))
+        enqueueTargetEvent(track->target, RTCTrack_onKeyframeRequest, NULL, NULL);
+}
+
+// Raises the requests that were throttled, unless an event in the meantime
+// already reported them
+static void RTCTrack_onTrailingKeyframeRequest(JSContext *ctx, JSValue this_val, void *data) {
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    atomic_store(&track->trailingKeyframeRequest, false);
+    if (atomic_load(&track->pliRequests) == track->reportedPli
+        && atomic_load(&track->firRequests) == track->reportedFir)
+        return;
+    atomic_store(&track->lastKeyframeRequest, monotonicTimeUs());
+    RTCTrack_onKeyframeRequest(ctx, this_val, NULL);
+}
+
+// The timer only holds the event target, the track may be gone by now
+static void fireTrailingKeyframeRequest(void *opaque) {
+    eventTarget *target = opaque;
+    enqueueTargetEvent(target, RTCTrack_onTrailingKeyframeRequest, NULL, NULL);
+    eventTargetRelease(target);
+}
+
+// Requests from every receiver collapse into a single pending event, and no
+// more than one event is raised per keyframeRequestInterval. Requests inside
+// the interval are raised once it ends, so a lost keyframe is never stuck.
+static void handleKeyframeRequest(RTCTrack_State *track, int isFir) {
+    uint64_t now = monotonicTimeUs();
+    uint64_t interval = track->config.keyframeRequestInterval * 1000ull;
+    uint64_t elapsed = now - atomic_load(&track->lastKeyframeRequest);
+    atomic_fetch_add(isFir ? &track->firRequests : &track->pliRequests, 1);
+    if (elapsed < interval) {
+        if (!atomic_exchange(&track->trailingKeyframeRequest, true)) {
+            eventTargetRetain(track->target);
+            timerWheelSchedule(interval - elapsed, fireTrailingKeyframeRequest, track->target);
+        }
+        return;
+    }
+    atomic_store(&track->lastKeyframeRequest, now);
+    requestKeyframe(track);
+}
+
+static void updateBitrateEstimate(RTCTrack_State *track, uint32_t bitrate) {
+    if (atomic_exchange(&track->bitrateEstimate, bitrate) == bitrate)
+        return;
+    if (!atomic_exchange(&track->bitrateEstimatePending, true))
+        enqueueTargetEvent(track->target, RTCTrack_onBitrateEstimate, NULL, NULL);
+}
+
+static void handlePayloadFeedback(RTCTrack_State *track, const RtcpPacket *packet) {
+    uint64_t remb;
+    if (packet->bodyLen < 8)
+        return;
+    switch (packet->count) {
+        case RTCP_PSFB_FMT_PLI:
+            if (rtcpReadU32(packet->body + 4) == track->config.ssrc)
+                handleKeyframeRequest(track, 0);
+            break;
+        case RTCP_PSFB_FMT_FIR:
+            for (int offset = 8; offset + 8 <= packet->bodyLen; offset += 8) {
+                if (rtcpReadU32(packet->body + offset) == track->config.ssrc)
+                    handleKeyframeRequest(track, 1);
+            }
+            break;
+        case RTCP_PSFB_FMT_AFB:
+            if (rtcpGetRembBitrate(packet, &remb) == 0) {
+                atomic_store(&track->lastRemb, monotonicTimeUs());
+                updateBitrateEstimate(track, remb > UINT32_MAX ? UINT32_MAX : (uint32_t)remb);
+            }
+            break;
+    }
+}
+
+// Loss based estimate in the spirit of the GCC loss controller, only used
+// while the receiver is not sending REMB.
+static void estimateFromLoss(RTCTrack_State *track, const RtcpReportBlock *block) {
+    uint32_t bitrate = atomic_load(&track->bitrate);
+    if (bitrate == 0 || monotonicTimeUs() - atomic_load(&track->lastRemb) < REMB_VALIDITY_US)
+        return;
+    if (block->fractionLost > LOSS_HIGH_FRACTION)
+        updateBitrateEstimate(track, (uint32_t)(bitrate * (1.0 - 0.5 * block->fractionLost / 256.0)));
+    else if (block->fractionLost < LOSS_LOW_FRACTION)
+        updateBitrateEstimate(track, (uint32_t)(bitrate * 1.08));
+}
+
+// The packetizer numbers packets from 0, so the count of packets sent so far
+// tells whether a requested sequence number is still in the NACK history.
+// Paced tracks have no NACK responder and retransmit from the pacer.
+static void handleNack(RTCTrack_State *track, const RtcpPacket *packet) {
+    uint16_t lastSeq = (uint16_t)(atomic_load(&track->sentPackets) - 1);
+    if (packet->bodyLen < 8 || rtcpReadU32(packet->body + 4) != track->config.ssrc)
+        return;
+    for (int offset = 8; offset + 4 <= packet->bodyLen; offset += 4) {
+        uint16_t pid = rtcpReadU16(packet->body + offset);
+        uint16_t blp = rtcpReadU16(packet->body + offset + 2);
+        for (int bit = -1; bit < 16; bit++) {
+            if (bit >= 0 && !(blp & (1 << bit)))
+                continue;
+            uint16_t seq = (uint16_t)(pid + bit + 1);
+            atomic_fetch_add(&track->nackRequests, 1);
+            if (track->pacer ? pacerRetransmit(track->pacer, seq) == 0 : (uint16_t)(lastSeq - seq) < track->nackPackets)
+                atomic_fetch_add(&track->retransmitHits, 1);
+            else
+                atomic_fetch_add(&track->retransmitMisses, 1);
+        }
+    }
+}
+
+static void handleReceiverReport(RTCTrack_State *track, const RtcpPacket *packet) {
+    RtcpReportBlock block;
+    uint32_t now = rtcpNtpMiddleNow();
+    for (int i = 0; rtcpGetReportBlock(packet, i, &block) == 0; i++) {
+        if (block.ssrc != track->config.ssrc)
+            continue;
+        int rtt = rtcpRoundTripMs(&block, now);
+        if (rtt >= 0) {
+            atomic_store(&track->rtt, rtt);
+            nackHistoryObserve(0, rtt);
+        }
+        estimateFromLoss(track, &block);
+    }
+}
+
+// Incoming RTCP is passed through the media handler chain to the track
+// message callback, so feedback is read here before it is queued for JS.
+// RTP is relayed to the forwarding outputs and then taken over by the jitter
+// buffer when the track has one. Forwarded packets never reach JS otherwise.
+static int RTCTrack_messageFilter(int trackId, const char *message, int size, void *opaque) {
+    RTCTrack_State *track = opaque;
+    const uint8_t *buf = (const uint8_t *)message;
+    RtcpPacket packet;
+    if (size < 0)
+        return 0;
+    if (!rtcpIsControlPacket(buf, size)) {
+        int forwarded = rtpForwarderPush(track->forwarder, buf, size);
+        if (track->jitter == NULL)
+            return forwarded > 0;
+        jitterBufferPush(track->jitter, buf, size);
+        return 1;
+    }
+    while (rtcpNextPacket(&buf, &size, &packet)) {
+        if (packet.type == RTCP_TYPE_RTPFB && packet.count == RTCP_RTPFB_FMT_NACK)
+            handleNack(track, &packet);
+        else if (packet.type == RTCP_TYPE_RR || packet.type == RTCP_TYPE_SR)
+            handleReceiverReport(track, &packet);
+        else if (packet.type == RTCP_TYPE_PSFB)
+            handlePayloadFeedback(track, &packet);
+    }
+    return 0;
+}
+
+static void updateBitrate(RTCTrack_State *track, size_t len) {
+    uint64_t now = monotonicTimeUs();
+    uint64_t elapsed = now - track->windowStart;
+    track->windowBytes += len;
+    if (elapsed < BITRATE_WINDOW_US)
+        return;
+    uint32_t bitrate = (uint32_t)(track->windowBytes * 8 * 1000000 / elapsed);
+    atomic_store(&track->bitrate, bitrate);
+    track->windowStart = now;
+    track->windowBytes = 0;
+    nackHistoryObserve(bitrate, -1);
+}
+
+static void RTCTrack_onFrameSent(const uint8_t *buf, size_t len, void *opaque) {
+    RTCTrack_State *track = opaque;
+    if (!track->config.packetization) {
+        atomic_fetch_add(&track->sentPackets, 1);
+        return;
+    }
+    atomic_fetch_add(&track->sentPackets, h264CountRtpPackets(buf, len,
+        track->config.nalUnitSeparator, track->maxFragmentSize));
+}
+
+static void RTCTrack_onPacketSent(const uint8_t *packet, size_t len, void *opaque) {
+    RTCTrack_State *track = opaque;
+    atomic_fetch_add(&track->sentPackets, 1);
+}
+
+static JSValue sendFrame(JSContext *ctx, RTCTrack_State *track, const uint8_t *buf, size_t len) {
+    if (track->closed)
+        return JS_ThrowTypeError(ctx, "The track is closed");
+    if (track->ringReader)
+        return JS_ThrowTypeError(ctx, "The track is fed by a frame ring");
+    if (track->pacer) {
+        if (pacerSend(track->pacer, buf, len, NULL) < 0)
+            return JS_ThrowInternalError(ctx, "Error sending data");
+    } else {
+        uint64_t start = traceNow();
+        int result = rtcSendMessage(track->trackId, (const char *)buf, len);
+        traceComplete("sendFrame", start, "bytes", len);
+        if (result < 0)
+            return JS_ThrowInternalError(ctx, "Error sending data");
+        RTCTrack_onFrameSent(buf, len, track);
+    }
+    updateBitrate(track, len);
+    return JS_UNDEFINED;
+}
+
+static JSValue RTCTrack_send(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    size_t len;
+    uint8_t *buf;
+    if (argc == 0 || (buf = JS_GetArrayBuffer(ctx, &len, argv[0])) == NULL)
+        return JS_ThrowTypeError(ctx, "Invalid frame argument");
+    return sendFrame(ctx, track, buf, len);
+}
+
+static void findKeyframeNalUnit(const uint8_t *nal, size_t len, void *opaque) {
+    int type = len > 0 ? nal[0] & 0x1f : 0;
+    if (type == 5 || type == 7) // IDR slice or SPS
+        *(int *)opaque = 1;
+}
+
+static int isKeyframe(RTCTrack_State *track, const uint8_t *buf, size_t len) {
+    int found = 0;
+    h264ForEachNalUnit(buf, len, track->config.nalUnitSeparator, findKeyframeNalUnit, &found);
+    return found;
+}
+
+static int findLayer(RTCTrack_State *track, const char *rid) {
+    for (int i = 0; i < track->config.layersLen; i++) {
+        if (strcmp(track->config.layers[i].rid, rid) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Highest layer that fits the receiver estimate, the lowest one otherwise.
+// -1 when the track has no layers.
+static int chooseLayer(RTCTrack_State *track) {
+    const RTCTrack_Layer *layers = track->config.layers;
+    uint32_t estimate = atomic_load(&track->bitrateEstimate);
+    int best = -1, lowest = 0;
+    if (track->config.layersLen == 0)
+        return -1;
+    for (int i = 0; i < track->config.layersLen; i++) {
+        if (layers[i].maxBitrate < layers[lowest].maxBitrate)
+            lowest = i;
+        if (estimate && layers[i].maxBitrate <= estimate
+            && (best < 0 || layers[i].maxBitrate > layers[best].maxBitrate))
+            best = i;
+    }
+    return best >= 0 ? best : lowest;
+}
+
+static void switchLayer(RTCTrack_State *track, int layer) {
+    if (layer == track->pendingLayer)
+        return;
+    track->pendingLayer = layer;
+    if (layer != track->activeLayer)
+        requestKeyframe(track);
+}
+
+static JSValue RTCTrack_sendLayer(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    size_t len;
+    uint8_t *buf;
+    if (argc < 2 || !JS_IsString(argv[0]))
+        return JS_ThrowTypeError(ctx, "Invalid rid argument");
+    if ((buf = JS_GetArrayBuffer(ctx, &len, argv[1])) == NULL)
+        return JS_ThrowTypeError(ctx, "Invalid frame argument");
+    const char *rid = JS_ToCString(ctx, argv[0]);
+    int layer = findLayer(track, rid);
+    JS_FreeCString(ctx, rid);
+    if (layer < 0)
+        return JS_ThrowRangeError(ctx, "Unknown layer");
+    if (track->autoLayer)
+        switchLayer(track, chooseLayer(track));
+    if (layer == track->pendingLayer && layer != track->activeLayer && isKeyframe(track, buf, len)) {
+        track->activeLayer = layer;
+        track->layerSwitches++;
+    }
+    if (layer != track->activeLayer) {
+        track->layerFramesDropped[layer]++;
+        return JS_UNDEFINED;
+    }
+    track->layerFramesSent[layer]++;
+    return sendFrame(ctx, track, buf, len);
+}
+
+static JSValue RTCTrack_selectLayer(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    if (track->config.layersLen == 0)
+        return JS_ThrowTypeError(ctx, "The track has no layers");
+    if (argc == 0 || !JS_IsString(argv[0]))
+        return JS_ThrowTypeError(ctx, "Invalid rid argument");
+    const char *rid = JS_ToCString(ctx, argv[0]);
+    int layer = strcmp(rid, "auto") == 0 ? chooseLayer(track) : findLayer(track, rid);
+    track->autoLayer = strcmp(rid, "auto") == 0;
+    JS_FreeCString(ctx, rid);
+    if (layer < 0)
+        return JS_ThrowRangeError(ctx, "Unknown layer");
+    switchLayer(track, layer);
+    return JS_UNDEFINED;
+}
+
+static RTCTrack_State *toRTCTrackState(JSValueConst val) {
+    return getRTCDataChannelHooks(val) == &RTCTrack_Hooks ? getRTCDataChannelOpaque(val) : NULL;
+}
+
+static JSValue RTCTrack_forwardTo(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    RTCTrack_State *output = argc > 0 ? toRTCTrackState(argv[0]) : NULL;
+    if (output == NULL)
+        return JS_ThrowTypeError(ctx, "Invalid track argument");
+    if (output == track)
+        return JS_ThrowTypeError(ctx, "A track can't forward to itself");
+    if (track->closed || output->closed)
+        return JS_ThrowTypeError(ctx, "The track is closed");
+    if (output->config.packetization)
+        return JS_ThrowTypeError(ctx, "The output track should be added with packetization: false");
+    rtpForwarderAdd(track->forwarder, &output->forwardOutput);
+    return JS_UNDEFINED;
+}
+
+static JSValue RTCTrack_unforward(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    RTCTrack_State *output;
+    if (track->closed)
+        return JS_UNDEFINED;
+    if (argc == 0 || JS_IsUndefined(argv[0])) {
+        rtpForwarderClear(track->forwarder);
+        return JS_UNDEFINED;
+    }
+    if ((output = toRTCTrackState(argv[0])) == NULL)
+        return JS_ThrowTypeError(ctx, "Invalid track argument");
+    if (output->forwardOutput.source == track->forwarder)
+        rtpForwarderRemove(track->forwarder, &output->forwardOutput);
+    return JS_UNDEFINED;
+}
+
+// Runs on the ring reader thread. Frames carry their own RTP timestamp, and after
+// the producer overran the ring the track waits for the next keyframe.
+static void RTCTrack_onRingFrame(const uint8_t *buf, size_t len, uint32_t timestamp, uint32_t flags, void *opaque) {
+    RTCTrack_State *track = opaque;
+    if (flags & FRAME_RING_GAP) {
+        track->ringWaitKeyframe = 1;
+        requestKeyframe(track);
+    }
+    if (track->ringWaitKeyframe && !(flags & FRAME_RING_KEYFRAME)) {
+        atomic_fetch_add(&track->ringFramesSkipped, 1);
+        return;
+    }
+    track->ringWaitKeyframe = 0;
+    if (track->pacer) {
+        if (pacerSend(track->pacer, buf, len, &timestamp) < 0)
+            return;
+    } else {
+        rtcSetTrackRtpTimestamp(track->trackId, timestamp);
+        if (rtcSendMessage(track->trackId, (const char *)buf, len) < 0)
+            return;
+        RTCTrack_onFrameSent(buf, len, track);
+    }
+    atomic_fetch_add(&track->ringFramesSent, 1);
+}
+
+static void detachRing(JSContext *ctx, RTCTrack_State *track) {
+    if (track->ringReader)
+        frameRingReaderDestroy(track->ringReader);
+    track->ringReader = NULL;
+    JS_FreeValue(ctx, track->ring);
+    track->ring = JS_UNDEFINED;
+}
+
+static JSValue RTCTrack_attachFrameRing(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    size_t len;
+    uint8_t *mem = argc > 0 ? JS_GetArrayBuffer(ctx, &len, argv[0]) : NULL;
+    if (mem == NULL || frameRingValidate(mem, len) == 0) {
+        if (mem == NULL && argc > 0)
+            JS_FreeValue(ctx, JS_GetException(ctx));
+        return JS_ThrowTypeError(ctx, "Invalid frame ring argument");
+    }
+    if (track->closed)
+        return JS_ThrowTypeError(ctx, "The track is closed");
+    detachRing(ctx, track);
+    track->ringWaitKeyframe = 0;
+    track->ringReader = frameRingReaderCreate(mem, RTCTrack_onRingFrame, track);
+    if (track->ringReader == NULL)
+        return JS_ThrowTypeError(ctx, "The frame ring is attached to another track");
+    track->ring = JS_DupValue(ctx, argv[0]);
+    return JS_UNDEFINED;
+}
+
+static JSValue RTCTrack_detachFrameRing(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    detachRing(ctx, getRTCTrackState(this_val));
+    return JS_UNDEFINED;
+}
+
+static JSValue RTCTrack_getLayer(JSContext *ctx, JSValueConst this_val)
+{
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    if (track->activeLayer < 0)
+        return JS_NULL;
+    return JS_NewString(ctx, track->config.layers[track->activeLayer].rid);
 }
 
 static JSValue RTCTrack_setStartTime(
@@ -20,9 +615,14 @@ static JSValue RTCTrack_setStartTime(
         .since1970 = true,
         .timestamp = rand()
     };
+    RTCTrack_State *track = getRTCTrackState(this_val);
     if (argc == 0 || !JS_IsNumber(argv[0]))
         return JS_ThrowTypeError(ctx, "Invalid argument");
     JS_ToFloat64(ctx, &startTime.seconds, argv[0]);
+    if (track->pacer) {
+        pacerSetStartTime(track->pacer, startTime.seconds, startTime.since1970, startTime.timestamp);
+        return JS_UNDEFINED;
+    }
     if (rtcSetRtpConfigurationStartTime(trackId, &startTime) < 0)
         return JS_ThrowInternalError(ctx, "setStartTime failed");
     return JS_UNDEFINED;
@@ -33,6 +633,11 @@ static JSValue RTCTrack_startRecording(
     int argc, JSValueConst *argv)
 {
     int trackId = getRTCDataChannelId(this_val);
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    if (track->pacer) {
+        pacerStartRecording(track->pacer);
+        return JS_UNDEFINED;
+    }
     if (rtcStartRtcpSenderReporterRecording(trackId) < 0)
         return JS_ThrowInternalError(ctx, "startRecording failed");
     return JS_UNDEFINED;
@@ -43,6 +648,11 @@ static JSValue RTCTrack_setNeedsToReport(
     int argc, JSValueConst *argv)
 {
     int trackId = getRTCDataChannelId(this_val);
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    if (track->pacer) {
+        pacerRequestReport(track->pacer);
+        return JS_UNDEFINED;
+    }
     if (rtcSetNeedsToSendRtcpSr(trackId) < 0)
         return JS_ThrowInternalError(ctx, "setNeedsToReport failed");
     return JS_UNDEFINED;
@@ -53,11 +663,14 @@ static JSValue RTCTrack_secondsToTimestamp(
     int argc, JSValueConst *argv)
 {
     int trackId = getRTCDataChannelId(this_val);
+    RTCTrack_State *track = getRTCTrackState(this_val);
     double secs;
     uint32_t timestamp;
     if (argc == 0 || !JS_IsNumber(argv[0]))
         return JS_ThrowTypeError(ctx, "Invalid seconds argument");
     JS_ToFloat64(ctx, &secs, argv[0]);
+    if (track->pacer)
+        return JS_NewUint32(ctx, pacerSecondsToTimestamp(track->pacer, secs));
     if (rtcTransformSecondsToTimestamp(trackId, secs, &timestamp) < 0)
         return JS_ThrowInternalError(ctx, "secondsToTimestamp failed");
     return JS_NewUint32(ctx, timestamp);
@@ -68,11 +681,14 @@ static JSValue RTCTrack_timestampToSeconds(
     int argc, JSValueConst *argv)
 {
     int trackId = getRTCDataChannelId(this_val);
+    RTCTrack_State *track = getRTCTrackState(this_val);
     double secs;
     uint32_t timestamp;
     if (argc == 0 || !JS_IsNumber(argv[0]))
         return JS_ThrowTypeError(ctx, "Invalid timestamp argument");
     JS_ToUint32(ctx, &timestamp, argv[0]);
+    if (track->pacer)
+        return JS_NewFloat64(ctx, pacerTimestampToSeconds(track->pacer, timestamp));
     if (rtcTransformTimestampToSeconds(trackId, timestamp, &secs) < 0)
         return JS_ThrowInternalError(ctx, "timestampToSeconds failed");
     return JS_NewFloat64(ctx, secs);
@@ -81,7 +697,10 @@ static JSValue RTCTrack_timestampToSeconds(
 static JSValue RTCTrack_getStartTimestamp(JSContext *ctx, JSValueConst this_val)
 {   
     int trackId = getRTCDataChannelId(this_val);
+    RTCTrack_State *track = getRTCTrackState(this_val);
     uint32_t timestamp;
+    if (track->pacer)
+        return JS_NewUint32(ctx, pacerGetStartTimestamp(track->pacer));
     if (rtcGetTrackStartTimestamp(trackId, &timestamp) < 0)
         return JS_ThrowInternalError(ctx, "Failed to get startTimestamp");
     return JS_NewUint32(ctx, timestamp); 
@@ -90,7 +709,10 @@ static JSValue RTCTrack_getStartTimestamp(JSContext *ctx, JSValueConst this_val)
 static JSValue RTCTrack_getPreviousReportedTimestamp(JSContext *ctx, JSValueConst this_val)
 {   
     int trackId = getRTCDataChannelId(this_val);
+    RTCTrack_State *track = getRTCTrackState(this_val);
     uint32_t timestamp;
+    if (track->pacer)
+        return JS_NewUint32(ctx, pacerGetReportedTimestamp(track->pacer));
     if (rtcGetPreviousTrackSenderReportTimestamp(trackId, &timestamp) < 0)
         return JS_ThrowInternalError(ctx, "Failed to get previousReportedTimestamp");
     return JS_NewUint32(ctx, timestamp); 
@@ -99,7 +721,10 @@ static JSValue RTCTrack_getPreviousReportedTimestamp(JSContext *ctx, JSValueCons
 static JSValue RTCTrack_getCurrentTimestamp(JSContext *ctx, JSValueConst this_val)
 {   
     int trackId = getRTCDataChannelId(this_val);
+    RTCTrack_State *track = getRTCTrackState(this_val);
     uint32_t timestamp;
+    if (track->pacer)
+        return JS_NewUint32(ctx, pacerGetTimestamp(track->pacer));
     if (rtcGetCurrentTrackTimestamp(trackId, &timestamp) < 0)
         return JS_ThrowInternalError(ctx, "Failed to get currentTimestamp");
     return JS_NewUint32(ctx, timestamp); 
@@ -108,16 +733,125 @@ static JSValue RTCTrack_getCurrentTimestamp(JSContext *ctx, JSValueConst this_va
 static JSValue RTCTrack_setCurrentTimestamp(JSContext *ctx, JSValueConst this_val, JSValueConst value)
 {   
     int trackId = getRTCDataChannelId(this_val);
+    RTCTrack_State *track = getRTCTrackState(this_val);
     uint32_t timestamp;
     if (!JS_IsNumber(value))
         return JS_ThrowTypeError(ctx, "Invalid timestamp value");
     JS_ToUint32(ctx, &timestamp, value);
+    if (track->pacer) {
+        pacerSetTimestamp(track->pacer, timestamp);
+        return JS_UNDEFINED;
+    }
     if (rtcSetTrackRtpTimestamp(trackId, timestamp) < 0)
         return JS_ThrowInternalError(ctx, "Failed to set currentTimestamp");
     return JS_UNDEFINED; 
 }
 
+static JSValue RTCTrack_EventGet(
+    JSContext *ctx, JSValueConst this_val, int magic)
+{
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    return JS_DupValue(ctx, track->events[magic]);
+}
+
+static JSValue RTCTrack_EventSet(
+    JSContext *ctx, JSValueConst this_val, JSValueConst value, int magic)
+{
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    JSValue ev = track->events[magic];
+    if (!JS_IsUndefined(ev)) JS_FreeValue(ctx, ev);
+    if (JS_IsFunction(ctx, value))
+        track->events[magic] = JS_DupValue(ctx, value);
+    else
+        track->events[magic] = JS_UNDEFINED;
+    return JS_UNDEFINED;
+}
+
+static JSValue RTCTrack_getStats(JSContext *ctx, JSValueConst this_val)
+{
+    RTCTrack_State *track = getRTCTrackState(this_val);
+    int rtt = atomic_load(&track->rtt);
+    uint32_t bitrate = atomic_load(&track->bitrate);
+    uint32_t bitrateEstimate = atomic_load(&track->bitrateEstimate);
+    JSValue stats = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, stats, "packetsSent", JS_NewUint32(ctx, atomic_load(&track->sentPackets)));
+    JS_SetPropertyStr(ctx, stats, "bitrate", JS_NewUint32(ctx, bitrate));
+    JS_SetPropertyStr(ctx, stats, "rtt", rtt >= 0 ? JS_NewInt32(ctx, rtt) : JS_NULL);
+    JS_SetPropertyStr(ctx, stats, "nackHistoryPackets", JS_NewUint32(ctx, track->nackPackets));
+    JS_SetPropertyStr(ctx, stats, "nackBufferBytes",
+        JS_NewFloat64(ctx, (double)track->nackPackets * track->packetSize));
+    JS_SetPropertyStr(ctx, stats, "nackRequests", JS_NewUint32(ctx, atomic_load(&track->nackRequests)));
+    JS_SetPropertyStr(ctx, stats, "retransmitHits", JS_NewUint32(ctx, atomic_load(&track->retransmitHits)));
+    JS_SetPropertyStr(ctx, stats, "retransmitMisses", JS_NewUint32(ctx, atomic_load(&track->retransmitMisses)));
+    JS_SetPropertyStr(ctx, stats, "recommendedNackHistory", JS_NewUint32(ctx,
+        nackHistoryAdaptiveSize(bitrate, rtt, track->packetSize)));
+    JS_SetPropertyStr(ctx, stats, "pliRequests", JS_NewUint32(ctx, atomic_load(&track->pliRequests)));
+    JS_SetPropertyStr(ctx, stats, "firRequests", JS_NewUint32(ctx, atomic_load(&track->firRequests)));
+    JS_SetPropertyStr(ctx, stats, "bitrateEstimate",
+        bitrateEstimate ? JS_NewUint32(ctx, bitrateEstimate) : JS_NULL);
+    if (track->pacer) {
+        pacerStats pacing;
+        pacerGetStats(track->pacer, &pacing);
+        JS_SetPropertyStr(ctx, stats, "pacerQueuedPackets", JS_NewUint32(ctx, pacing.queuedPackets));
+        JS_SetPropertyStr(ctx, stats, "pacerQueuedBytes", JS_NewFloat64(ctx, (double)pacing.queuedBytes));
+        JS_SetPropertyStr(ctx, stats, "pacedPackets", JS_NewFloat64(ctx, (double)pacing.pacedPackets));
+        JS_SetPropertyStr(ctx, stats, "pacerDroppedFrames", JS_NewFloat64(ctx, (double)pacing.droppedFrames));
+        JS_SetPropertyStr(ctx, stats, "pacerMaxDelay", JS_NewUint32(ctx, pacing.maxDelayMs));
+    }
+    if (!track->closed)
+        JS_SetPropertyStr(ctx, stats, "forwardTargets", JS_NewInt32(ctx, rtpForwarderCount(track->forwarder)));
+    if (!track->config.packetization) {
+        JS_SetPropertyStr(ctx, stats, "forwardedPackets",
+            JS_NewUint32(ctx, atomic_load(&track->forwardOutput.forwardedPackets)));
+        JS_SetPropertyStr(ctx, stats, "forwardFailures",
+            JS_NewUint32(ctx, atomic_load(&track->forwardOutput.failedPackets)));
+    }
+    if (!JS_IsUndefined(track->ring)) {
+        size_t len;
+        frameRingStats ring;
+        frameRingGetStats(JS_GetArrayBuffer(ctx, &len, track->ring), &ring);
+        JS_SetPropertyStr(ctx, stats, "ringFramesSent", JS_NewUint32(ctx, atomic_load(&track->ringFramesSent)));
+        JS_SetPropertyStr(ctx, stats, "ringFramesSkipped", JS_NewUint32(ctx, atomic_load(&track->ringFramesSkipped)));
+        JS_SetPropertyStr(ctx, stats, "ringOverruns", JS_NewUint32(ctx, ring.overruns));
+        JS_SetPropertyStr(ctx, stats, "ringPendingBytes", JS_NewUint32(ctx, ring.pendingBytes));
+    }
+    if (track->jitter) {
+        jitterBufferStats jitter;
+        jitterBufferGetStats(track->jitter, &jitter);
+        JS_SetPropertyStr(ctx, stats, "jitterBufferReceived", JS_NewFloat64(ctx, (double)jitter.received));
+        JS_SetPropertyStr(ctx, stats, "jitterBufferEmitted", JS_NewFloat64(ctx, (double)jitter.emitted));
+        JS_SetPropertyStr(ctx, stats, "jitterBufferLate", JS_NewFloat64(ctx, (double)jitter.late));
+        JS_SetPropertyStr(ctx, stats, "jitterBufferLost", JS_NewFloat64(ctx, (double)jitter.lost));
+        JS_SetPropertyStr(ctx, stats, "jitterBufferDuplicates", JS_NewFloat64(ctx, (double)jitter.duplicates));
+        JS_SetPropertyStr(ctx, stats, "jitterBufferPackets", JS_NewUint32(ctx, jitter.buffered));
+        JS_SetPropertyStr(ctx, stats, "jitterBufferDelay", JS_NewUint32(ctx, jitter.delayMs));
+        JS_SetPropertyStr(ctx, stats, "jitter", JS_NewFloat64(ctx, jitter.jitterMs));
+    }
+    if (track->config.layersLen > 0) {
+        JSValue layers = JS_NewArray(ctx);
+        for (int i = 0; i < track->config.layersLen; i++) {
+            JSValue layer = JS_NewObject(ctx);
+            JS_SetPropertyStr(ctx, layer, "rid", JS_NewString(ctx, track->config.layers[i].rid));
+            JS_SetPropertyStr(ctx, layer, "maxBitrate", JS_NewUint32(ctx, track->config.layers[i].maxBitrate));
+            JS_SetPropertyStr(ctx, layer, "framesSent", JS_NewUint32(ctx, track->layerFramesSent[i]));
+            JS_SetPropertyStr(ctx, layer, "framesDropped", JS_NewUint32(ctx, track->layerFramesDropped[i]));
+            JS_SetPropertyUint32(ctx, layers, i, layer);
+        }
+        JS_SetPropertyStr(ctx, stats, "layers", layers);
+        JS_SetPropertyStr(ctx, stats, "layerSwitches", JS_NewUint32(ctx, track->layerSwitches));
+    }
+    return stats;
+}
+
 static JSCFunctionListEntry RTCTrack_Methods[] = {
+    JS_CFUNC_DEF("send", 1, RTCTrack_send),
+    JS_CFUNC_DEF("sendLayer", 2, RTCTrack_sendLayer),
+    JS_CFUNC_DEF("selectLayer", 1, RTCTrack_selectLayer),
+    JS_CGETSET_DEF("layer", RTCTrack_getLayer, NULL),
+    JS_CFUNC_DEF("forwardTo", 1, RTCTrack_forwardTo),
+    JS_CFUNC_DEF("unforward", 0, RTCTrack_unforward),
+    JS_CFUNC_DEF("attachFrameRing", 1, RTCTrack_attachFrameRing),
+    JS_CFUNC_DEF("detachFrameRing", 0, RTCTrack_detachFrameRing),
     JS_CFUNC_DEF("setStartTime", 1, RTCTrack_setStartTime),
     JS_CFUNC_DEF("startRecording", 0, RTCTrack_startRecording),
     JS_CFUNC_DEF("setNeedsToReport", 0, RTCTrack_setNeedsToReport),
@@ -125,11 +859,120 @@ static JSCFunctionListEntry RTCTrack_Methods[] = {
     JS_CFUNC_DEF("timestampToSeconds", 1, RTCTrack_timestampToSeconds),
     JS_CGETSET_DEF("startTimestamp", RTCTrack_getStartTimestamp, NULL),
     JS_CGETSET_DEF("previousReportedTimestamp", RTCTrack_getPreviousReportedTimestamp, NULL),
-    JS_CGETSET_DEF("currentTimestamp", RTCTrack_getCurrentTimestamp, RTCTrack_setCurrentTimestamp)
+    JS_CGETSET_DEF("currentTimestamp", RTCTrack_getCurrentTimestamp, RTCTrack_setCurrentTimestamp),
+    JS_CGETSET_DEF("stats", RTCTrack_getStats, NULL),
+    JS_CGETSET_MAGIC_DEF("onkeyframerequest",
+        RTCTrack_EventGet,
+        RTCTrack_EventSet,
+        RTC_TRACK_EVENTS_ONKEYFRAMEREQUEST),
+    JS_CGETSET_MAGIC_DEF("onbitrateestimate",
+        RTCTrack_EventGet,
+        RTCTrack_EventSet,
+        RTC_TRACK_EVENTS_ONBITRATEESTIMATE),
+    JS_CGETSET_MAGIC_DEF("onplayout",
+        RTCTrack_EventGet,
+        RTCTrack_EventSet,
+        RTC_TRACK_EVENTS_ONPLAYOUT)
 };
 
-JSValue createRTCTrackClass(JSContext *ctx, int trackId) {
-    JSValue obj = createRTCDataChannelBaseClass(ctx, trackId, RTCTrack_Finalizer);
-    JS_SetPropertyFunctionList(ctx, obj, RTCTrack_Methods, countof(RTCTrack_Methods));
-    return obj;
+static uint32_t reserveNackHistory(RTCTrack_State *track) {
+    const RTCTrack_Config *config = &track->config;
+    // the responder hangs off the packetizer chain
+    if (!config->packetization)
+        return 0;
+    if (config->nackMode == RTC_TRACK_NACK_FIXED)
+        return nackHistoryReserve(config->nackHistory, track->packetSize, 0);
+    return nackHistoryReserve(
+        nackHistoryAdaptiveSize(config->maxBitrate, config->rtt, track->packetSize),
+        track->packetSize, 1);
+}
+
+static int RTCTrack_init(JSContext *ctx, JSValueConst obj, int trackId, void *opaque, const void *arg) {
+    RTCTrack_State *track = opaque;
+    const RTCTrack_Config *config = arg;
+    track->trackId = trackId;
+    track->target = getRTCDataChannelEventTarget(obj);
+    track->config = *config;
+    track->maxFragmentSize = RTC_DEFAULT_MAXIMUM_FRAGMENT_SIZE;
+    track->packetSize = track->maxFragmentSize + RTP_HEADER_SIZE;
+    track->windowStart = monotonicTimeUs();
+    atomic_init(&track->rtt, -1);
+    track->activeLayer = -1;
+    track->pendingLayer = chooseLayer(track);
+    track->autoLayer = 1;
+    for (int i = 0 ; i < RTC_TRACK_EVENTS_MAX; i++)
+        track->events[i] = JS_UNDEFINED;
+    track->ring = JS_UNDEFINED;
+    track->forwarder = rtpForwarderCreate(trackId, config->ssrc);
+    rtpForwardOutputInit(&track->forwardOutput, trackId, config->ssrc);
+    track->nackPackets = reserveNackHistory(track);
+    if (config->pacingRate > 0) {
+        pacerConfig pacing = {
+            .rate = config->pacingRate,
+            .burst = config->pacingBurst,
+            .ssrc = config->ssrc,
+            .payloadType = config->payloadType,
+            .clockRate = 90 * 1000,
+            .timestamp = rand(),
+            .separator = config->nalUnitSeparator,
+            .maxFragmentSize = track->maxFragmentSize,
+            .historyPackets = track->nackPackets
+        };
+        track->pacer = pacerCreate(trackId, &pacing, RTCTrack_onPacketSent, track);
+    } else if (track->nackPackets > 0 && rtcChainRtcpNackResponder(trackId, track->nackPackets) < 0) {
+        nackHistoryRelease(track->nackPackets, track->packetSize);
+        track->nackPackets = 0;
+        JS_ThrowInternalError(ctx, "Error setting up nack responder");
+        return -1;
+    }
+    if (config->jitterBuffer)
+        track->jitter = jitterBufferCreate(&config->jitter, RTCTrack_onJitterRelease, track);
+    return 0;
+}
+
+JSFullClassDef RTCTrack_Class = {
+    .def = {
+        .class_name = "RTCTrack",
+    },
+    .constructor = { NULL, 0 },
+    .funcs_len = sizeof(RTCTrack_Methods),
+    .funcs = RTCTrack_Methods
+};
+
+static const RTCDataChannelBase_Hooks RTCTrack_Hooks = {
+    .classDef = &RTCTrack_Class,
+    .opaqueSize = sizeof(RTCTrack_State),
+    .init = RTCTrack_init,
+    .close = RTCTrack_close,
+    .finalizer = RTCTrack_Finalizer,
+    .gcMark = RTCTrack_GcMark,
+    .messageFilter = RTCTrack_messageFilter,
+};
+
+JSValue createRTCTrackClass(JSContext *ctx, int trackId, const RTCTrack_Config *config) {
+    return createRTCDataChannelBaseClass(ctx, trackId, &RTCTrack_Hooks, config);
+}
+
+JSValue setNackMemoryBudget(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    double bytes;
+    if (argc == 0 || !JS_IsNumber(argv[0]))
+        return JS_ThrowTypeError(ctx, "Invalid budget argument");
+    JS_ToFloat64(ctx, &bytes, argv[0]);
+    if (bytes < 0)
+        return JS_ThrowRangeError(ctx, "The budget should not be negative");
+    nackHistorySetBudget((size_t)bytes);
+    return JS_UNDEFINED;
+}
+
+JSValue getNackMemoryUsage(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    JSValue usage = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, usage, "budget", JS_NewFloat64(ctx, (double)nackHistoryGetBudget()));
+    JS_SetPropertyStr(ctx, usage, "used", JS_NewFloat64(ctx, (double)nackHistoryGetUsage()));
+    return usage;
 }
\ No newline at end of file
@@ -2,9 +2,44 @@
 #define __RTC_TRACK_JS_H
 
 #include "js-utils.h"
+#include "jitter-buffer.h"
 #include <rtc/rtc.h>
 
+#define RTC_TRACK_MAX_LAYERS 4
+#define RTC_TRACK_MAX_RID_LEN 16
+
+enum {
+    RTC_TRACK_NACK_FIXED,
+    RTC_TRACK_NACK_ADAPTIVE,
+};
+
+// One simulcast encoding fed through sendLayer()
+typedef struct {
+    char rid[RTC_TRACK_MAX_RID_LEN];
+    uint32_t maxBitrate; // bps, used by automatic selection
+} RTCTrack_Layer;
+
+typedef struct {
+    uint32_t ssrc;
+    int payloadType;
+    rtcNalUnitSeparator nalUnitSeparator;
+    int nackMode;
+    uint32_t nackHistory; // packets, fixed mode only
+    uint32_t maxBitrate;  // bps, adaptive mode hint
+    int rtt;              // ms, adaptive mode hint
+    uint32_t keyframeRequestInterval; // ms between onkeyframerequest events
+    uint32_t pacingRate;  // bps, 0 disables pacing
+    uint32_t pacingBurst; // bytes
+    int layersLen;        // 0 when the track isn't simulcast
+    RTCTrack_Layer layers[RTC_TRACK_MAX_LAYERS];
+    int packetization;    // 0 when send() and forwardTo() take whole RTP packets
+    int jitterBuffer;     // inbound RTP goes to onplayout instead of onmessage
+    jitterBufferConfig jitter;
+} RTCTrack_Config;
+
 extern JSFullClassDef RTCTrack_Class;
-JSValue createRTCTrackClass(JSContext *ctx, int trackId);
+JSValue createRTCTrackClass(JSContext *ctx, int trackId, const RTCTrack_Config *config);
+JSValue setNackMemoryBudget(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+JSValue getNackMemoryUsage(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
 
 #endif
\ No newline at end of file
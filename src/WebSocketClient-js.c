@@ -2,8 +2,8 @@
 #include "RTCDataChannelBase-js.h"
 #include <rtc/rtc.h>
 
-static void WebSocketClient_Finalizer(JSRuntime *rt, JSValue val) {
-    int id = getRTCDataChannelId(val);
+static void WebSocketClient_close(int id, void *opaque) {
+    rtcClose(id);
     rtcDeleteWebSocket(id);
 }
 
@@ -32,6 +32,24 @@ static JSCFunctionListEntry WebSocketClient_Methods[] = {
     JS_CGETSET_DEF("remoteAddress", WebSocketClient_getRemoteAddress, NULL)
 };
 
+JSFullClassDef WebSocketClient_Class = {
+    .def = {
+        .class_name = "WebSocketClient",
+    },
+    .constructor = { NULL, 0 },
+    .funcs_len = sizeof(WebSocketClient_Methods),
+    .funcs = WebSocketClient_Methods
+};
+
+static const RTCDataChannelBase_Hooks WebSocketClient_Hooks = {
+    .classDef = &WebSocketClient_Class,
+    .close = WebSocketClient_close,
+};
+
+JSValue createWebSocketClientObject(JSContext *ctx, int id) {
+    return createRTCDataChannelBaseClass(ctx, id, &WebSocketClient_Hooks, NULL);
+}
+
 JSValue createWebSocketClient(
     JSContext *ctx, JSValueConst this_val,
     int argc, JSValueConst *argv) 
@@ -41,13 +59,10 @@ JSValue createWebSocketClient(
     const char *url = JS_ToCString(ctx, argv[0]);
     JSValue ret;
     int id = rtcCreateWebSocket(url);
-    if (id < 0) {
+    if (id < 0)
         ret = JS_ThrowTypeError(ctx, "Error creating websocket client. Status: %x", id);
-        JS_FreeCString(ctx, url);
-    } else {
-        ret = createRTCDataChannelBaseClass(ctx, id, WebSocketClient_Finalizer);
-        JS_SetPropertyFunctionList(ctx, ret, WebSocketClient_Methods, countof(WebSocketClient_Methods));
-    }
+    else
+        ret = createWebSocketClientObject(ctx, id);
     JS_FreeCString(ctx, url);
     return ret;
 }
\ No newline at end of file
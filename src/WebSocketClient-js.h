@@ -3,6 +3,8 @@
 
 #include "js-utils.h"
 
+extern JSFullClassDef WebSocketClient_Class;
 JSValue createWebSocketClient(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+JSValue createWebSocketClientObject(JSContext *ctx, int id);
 
 #endif
\ No newline at end of file
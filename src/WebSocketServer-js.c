@@ -0,0 +1,211 @@
+#include "WebSocketServer-js.h"
+#include "WebSocketClient-js.h"
+#include "event-queue.h"
+#include <stdlib.h>
+#include <rtc/rtc.h>
+
+enum {
+    WEBSOCKET_SERVER_EVENTS_ONCLIENT,
+    WEBSOCKET_SERVER_EVENTS_MAX,
+};
+
+typedef struct {
+    JSContext *ctx;
+    int serverId;
+    JSValue thisObj;
+    eventTarget *target;
+    JSValue events[WEBSOCKET_SERVER_EVENTS_MAX];
+} WebSocketServer_ClassData;
+
+static WebSocketServer_ClassData* getWebSocketServerClassData(JSValueConst this_val) {
+    return JS_GetOpaque(this_val, WebSocketServer_Class.id);
+}
+
+static void WebSocketServer_onClient(JSContext *ctx, JSValue this_val, void *data) {
+    WebSocketServer_ClassData *state = getWebSocketServerClassData(this_val);
+    int *clientId = data;
+    JSValue fn = state->events[WEBSOCKET_SERVER_EVENTS_ONCLIENT];
+    // without a handler the client object is collected, which closes it
+    JSValue clientVal = createWebSocketClientObject(ctx, *clientId);
+    *clientId = -1;
+    if (JS_IsFunction(ctx, fn))
+        JS_FreeValue(ctx, JS_Call(ctx, fn, this_val, 1, &clientVal));
+    JS_FreeValue(ctx, clientVal);
+}
+
+// Clients still queued when the server object goes away are never wrapped
+static void freeClientId(void *data) {
+    int *clientId = data;
+    if (*clientId >= 0)
+        rtcDeleteWebSocket(*clientId);
+    free(clientId);
+}
+
+static void handleOnClient(int wsserver, int ws, void *ptr) {
+    WebSocketServer_ClassData *state = (WebSocketServer_ClassData *)ptr;
+    if (state == NULL) {
+        // connected before createWebSocketServer returned
+        rtcDeleteWebSocket(ws);
+        return;
+    }
+    int *clientId = malloc(sizeof(int));
+    *clientId = ws;
+    enqueueTargetEvent(state->target, WebSocketServer_onClient, clientId, freeClientId);
+}
+
+static void WebSocketServer_Finalizer(JSRuntime *rt, JSValue val)
+{
+    WebSocketServer_ClassData *state = getWebSocketServerClassData(val);
+    if (state) {
+        if (state->serverId >= 0)
+            rtcDeleteWebSocketServer(state->serverId);
+        eventTargetClose(state->target);
+        eventTargetRelease(state->target);
+        for (int i = 0 ; i < WEBSOCKET_SERVER_EVENTS_MAX; i++)
+            JS_FreeValueRT(rt, state->events[i]);
+        js_free(state->ctx, state);
+    }
+}
+
+static void WebSocketServer_GcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
+{
+    WebSocketServer_ClassData *state = getWebSocketServerClassData(val);
+    if (state) {
+        for (int i = 0 ; i < WEBSOCKET_SERVER_EVENTS_MAX; i++)
+            JS_MarkValue(rt, state->events[i], mark_func);
+    }
+}
+
+static JSValue WebSocketServer_EventGet(
+    JSContext *ctx, JSValueConst this_val, int magic)
+{
+    WebSocketServer_ClassData *state = getWebSocketServerClassData(this_val);
+    return JS_DupValue(ctx, state->events[magic]);
+}
+
+static JSValue WebSocketServer_EventSet(
+    JSContext *ctx, JSValueConst this_val, JSValueConst value, int magic)
+{
+    WebSocketServer_ClassData *state = getWebSocketServerClassData(this_val);
+    JSValue ev = state->events[magic];
+    if (!JS_IsUndefined(ev)) JS_FreeValue(ctx, ev);
+    if (JS_IsFunction(ctx, value))
+        state->events[magic] = JS_DupValue(ctx, value);
+    else
+        state->events[magic] = JS_UNDEFINED;
+    return JS_UNDEFINED;
+}
+
+static JSValue WebSocketServer_getPort(JSContext *ctx, JSValueConst this_val)
+{
+    WebSocketServer_ClassData *state = getWebSocketServerClassData(this_val);
+    if (state->serverId < 0)
+        return JS_NULL;
+    int port = rtcGetWebSocketServerPort(state->serverId);
+    if (port < 0)
+        return JS_ThrowInternalError(ctx, "Error getting websocket server port. Status code: %x", port);
+    return JS_NewInt32(ctx, port);
+}
+
+static JSValue WebSocketServer_close(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    WebSocketServer_ClassData *state = getWebSocketServerClassData(this_val);
+    if (state->serverId >= 0) {
+        rtcDeleteWebSocketServer(state->serverId);
+        state->serverId = -1;
+    }
+    return JS_UNDEFINED;
+}
+
+static JSCFunctionListEntry WebSocketServer_Methods[] = {
+    JS_CFUNC_DEF("close", 0, WebSocketServer_close),
+    JS_CGETSET_DEF("port", WebSocketServer_getPort, NULL),
+    JS_CGETSET_MAGIC_DEF("onclient",
+        WebSocketServer_EventGet,
+        WebSocketServer_EventSet,
+        WEBSOCKET_SERVER_EVENTS_ONCLIENT)
+};
+
+JSFullClassDef WebSocketServer_Class = {
+    .def = {
+        .class_name = "WebSocketServer",
+        .finalizer = WebSocketServer_Finalizer,
+        .gc_mark = WebSocketServer_GcMark,
+    },
+    .constructor = { NULL, 0 },
+    .funcs_len = sizeof(WebSocketServer_Methods),
+    .funcs = WebSocketServer_Methods
+};
+
+static const char* JS_GetOptionalCStringProp(JSContext *ctx, JSValueConst obj, const char *prop, int *invalid) {
+    JSValue val = JS_GetPropertyStr(ctx, obj, prop);
+    const char *str = NULL;
+    if (JS_IsString(val))
+        str = JS_ToCString(ctx, val);
+    else if (!JS_IsUndefined(val))
+        *invalid = 1;
+    JS_FreeValue(ctx, val);
+    return str;
+}
+
+static void freeServerConfiguration(JSContext *ctx, rtcWsServerConfiguration *config) {
+    JS_FreeCString(ctx, config->bindAddress);
+    JS_FreeCString(ctx, config->certificatePemFile);
+    JS_FreeCString(ctx, config->keyPemFile);
+    JS_FreeCString(ctx, config->keyPemPass);
+}
+
+static JSValue fromJsServerConfiguration(JSContext *ctx, JSValueConst val, rtcWsServerConfiguration *config) {
+    int invalid = 0;
+    uint32_t port = 0;
+    JSValue portVal = JS_GetPropertyStr(ctx, val, "port");
+    JSValue tlsVal = JS_GetPropertyStr(ctx, val, "enableTls");
+    if (!JS_IsUndefined(portVal) && (!JS_IsNumber(portVal) || JS_ToUint32(ctx, &port, portVal) || port > 65535))
+        invalid = 1;
+    config->port = port;
+    config->enableTls = JS_ToBool(ctx, tlsVal);
+    JS_FreeValue(ctx, portVal);
+    JS_FreeValue(ctx, tlsVal);
+    if (invalid)
+        return JS_ThrowRangeError(ctx, "Invalid port value");
+    config->bindAddress = JS_GetOptionalCStringProp(ctx, val, "bindAddress", &invalid);
+    config->certificatePemFile = JS_GetOptionalCStringProp(ctx, val, "certificatePemFile", &invalid);
+    config->keyPemFile = JS_GetOptionalCStringProp(ctx, val, "keyPemFile", &invalid);
+    config->keyPemPass = JS_GetOptionalCStringProp(ctx, val, "keyPemPass", &invalid);
+    if (invalid) {
+        freeServerConfiguration(ctx, config);
+        return JS_ThrowTypeError(ctx, "Invalid websocket server option");
+    }
+    return JS_UNDEFINED;
+}
+
+JSValue createWebSocketServer(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    rtcWsServerConfiguration config = { 0 };
+    WebSocketServer_ClassData *state;
+    if (argc > 0 && !JS_IsObject(argv[0]))
+        return JS_ThrowTypeError(ctx, "The websocket server options should be an object");
+    if (argc > 0 && JS_IsException(fromJsServerConfiguration(ctx, argv[0], &config)))
+        return JS_EXCEPTION;
+    JSValue obj = JS_NewObjectClass(ctx, WebSocketServer_Class.id);
+    state = js_mallocz(ctx, sizeof(*state));
+    state->ctx = ctx;
+    state->thisObj = obj;
+    state->target = eventTargetCreate(obj);
+    for (int i = 0 ; i < WEBSOCKET_SERVER_EVENTS_MAX; i++)
+        state->events[i] = JS_UNDEFINED;
+    JS_SetOpaque(obj, state);
+    state->serverId = rtcCreateWebSocketServer(&config, handleOnClient);
+    freeServerConfiguration(ctx, &config);
+    if (state->serverId < 0) {
+        int status = state->serverId;
+        JS_FreeValue(ctx, obj);
+        return JS_ThrowInternalError(ctx, "Error creating websocket server. Status code: %x", status);
+    }
+    rtcSetUserPointer(state->serverId, state);
+    return obj;
+}
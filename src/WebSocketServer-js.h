@@ -0,0 +1,9 @@
+#ifndef __WEBSOCKET_SERVER_JS_H
+#define __WEBSOCKET_SERVER_JS_H
+
+#include "js-utils.h"
+
+extern JSFullClassDef WebSocketServer_Class;
+JSValue createWebSocketServer(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+
+#endif
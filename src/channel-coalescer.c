@@ -0,0 +1,129 @@
+#include "channel-coalescer.h"
+#include "logger.h"
+#include "task-queue.h"
+#include "timer-wheel.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rtc/rtc.h>
+
+struct channelCoalescer {
+    int channelId;
+    channelCodec *codec;
+    uint64_t intervalUs;
+    uint32_t maxBytes;
+    pthread_mutex_t lock;
+    channelBatch pending;
+    int timerArmed;
+    int destroyed;
+    channelCoalescerStats stats;
+};
+
+typedef struct {
+    int channelId;
+    channelCodec *codec;
+    channelBatch batch;
+} coalescedFrame;
+
+static void sendCoalesced(void *opaque) {
+    coalescedFrame *frame = opaque;
+    uint64_t start = traceNow();
+    size_t len;
+    uint8_t *out = channelCodecEncodeBatch(frame->codec, &frame->batch, &len);
+    if (out == NULL || rtcSendMessage(frame->channelId, (const char *)out, len) < 0)
+        logMessage(RTC_LOG_WARNING, "Channel %d failed to send %u coalesced messages",
+            frame->channelId, frame->batch.count);
+    traceComplete("sendCoalesced", start, "messages", frame->batch.count);
+    channelCodecRelease(frame->codec);
+    channelBatchFree(&frame->batch);
+    free(out);
+    free(frame);
+}
+
+// Called with the lock held, so frames are posted in order
+static void postPending(channelCoalescer *c) {
+    if (c->pending.count == 0)
+        return;
+    coalescedFrame *frame = malloc(sizeof(coalescedFrame));
+    frame->channelId = c->channelId;
+    frame->codec = c->codec;
+    frame->batch = c->pending;
+    channelCodecRetain(c->codec);
+    memset(&c->pending, 0, sizeof(c->pending));
+    c->stats.frames++;
+    c->stats.pendingMessages = 0;
+    c->stats.pendingBytes = 0;
+    taskQueuePost(sendCoalesced, frame);
+}
+
+static void freeCoalescer(channelCoalescer *c) {
+    channelBatchFree(&c->pending);
+    channelCodecRelease(c->codec);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+static void flushOnTimer(void *opaque) {
+    channelCoalescer *c = opaque;
+    pthread_mutex_lock(&c->lock);
+    c->timerArmed = 0;
+    if (c->destroyed) {
+        pthread_mutex_unlock(&c->lock);
+        freeCoalescer(c);
+        return;
+    }
+    postPending(c);
+    pthread_mutex_unlock(&c->lock);
+}
+
+channelCoalescer *channelCoalescerCreate(int channelId, channelCodec *codec) {
+    const channelCodecConfig *config = channelCodecGetConfig(codec);
+    channelCoalescer *c = calloc(1, sizeof(channelCoalescer));
+    c->channelId = channelId;
+    c->codec = codec;
+    c->intervalUs = config->coalesceIntervalMs * 1000ull;
+    c->maxBytes = config->coalesceMaxBytes;
+    channelCodecRetain(codec);
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+void channelCoalescerPush(channelCoalescer *c, const uint8_t *data, size_t len, int flags) {
+    pthread_mutex_lock(&c->lock);
+    channelBatchAppend(&c->pending, data, len, flags);
+    c->stats.messages++;
+    c->stats.pendingMessages = c->pending.count;
+    c->stats.pendingBytes = c->pending.len;
+    if (c->pending.len >= c->maxBytes) {
+        postPending(c);
+    } else if (!c->timerArmed) {
+        // the interval bounds the delay of the first message of a batch
+        c->timerArmed = 1;
+        timerWheelSchedule(c->intervalUs, flushOnTimer, c);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+void channelCoalescerFlush(channelCoalescer *c) {
+    pthread_mutex_lock(&c->lock);
+    postPending(c);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void channelCoalescerGetStats(channelCoalescer *c, channelCoalescerStats *stats) {
+    pthread_mutex_lock(&c->lock);
+    *stats = c->stats;
+    pthread_mutex_unlock(&c->lock);
+}
+
+// If a flush is scheduled the timer thread frees the coalescer, otherwise
+// it is freed right away.
+void channelCoalescerDestroy(channelCoalescer *c) {
+    pthread_mutex_lock(&c->lock);
+    c->destroyed = 1;
+    int armed = c->timerArmed;
+    pthread_mutex_unlock(&c->lock);
+    if (!armed)
+        freeCoalescer(c);
+}
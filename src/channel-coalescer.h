@@ -0,0 +1,27 @@
+#ifndef __CHANNEL_COALESCER_H
+#define __CHANNEL_COALESCER_H
+
+#include "channel-codec.h"
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct channelCoalescer channelCoalescer;
+
+typedef struct {
+    uint64_t messages;
+    uint64_t frames;
+    uint32_t pendingMessages;
+    uint32_t pendingBytes;
+} channelCoalescerStats;
+
+// Packs the messages sent within the codec's coalesce interval, or until
+// coalesceMaxBytes are pending, into one batch frame. Frames are encoded
+// and sent on the task queue, in the order the messages were pushed.
+channelCoalescer *channelCoalescerCreate(int channelId, channelCodec *codec);
+void channelCoalescerPush(channelCoalescer *c, const uint8_t *data, size_t len, int flags);
+void channelCoalescerFlush(channelCoalescer *c);
+void channelCoalescerGetStats(channelCoalescer *c, channelCoalescerStats *stats);
+// Pending messages are dropped
+void channelCoalescerDestroy(channelCoalescer *c);
+
+#endif
@@ -0,0 +1,188 @@
+#include "channel-codec.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+struct channelCodec {
+    atomic_int refs;
+    channelCodecConfig config;
+    pthread_mutex_t deflateLock;
+    pthread_mutex_t inflateLock;
+    z_stream deflater;
+    z_stream inflater;
+};
+
+int channelCodecConfigEnabled(const channelCodecConfig *config) {
+    return config->framed || config->compression != CHANNEL_COMPRESSION_NONE || config->coalesceIntervalMs > 0;
+}
+
+channelCodec *channelCodecCreate(const channelCodecConfig *config) {
+    channelCodec *codec = calloc(1, sizeof(channelCodec));
+    codec->config = *config;
+    atomic_init(&codec->refs, 1);
+    pthread_mutex_init(&codec->deflateLock, NULL);
+    pthread_mutex_init(&codec->inflateLock, NULL);
+    // raw streams, the frame header replaces the zlib one
+    if (deflateInit2(&codec->deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK
+        || inflateInit2(&codec->inflater, -MAX_WBITS) != Z_OK) {
+        channelCodecRelease(codec);
+        return NULL;
+    }
+    return codec;
+}
+
+void channelCodecRetain(channelCodec *codec) {
+    atomic_fetch_add(&codec->refs, 1);
+}
+
+void channelCodecRelease(channelCodec *codec) {
+    if (atomic_fetch_sub(&codec->refs, 1) != 1)
+        return;
+    deflateEnd(&codec->deflater);
+    inflateEnd(&codec->inflater);
+    pthread_mutex_destroy(&codec->deflateLock);
+    pthread_mutex_destroy(&codec->inflateLock);
+    free(codec->config.dictionary);
+    free(codec);
+}
+
+const channelCodecConfig *channelCodecGetConfig(channelCodec *codec) {
+    return &codec->config;
+}
+
+static size_t deflateMessage(channelCodec *codec, const uint8_t *data, size_t len, uint8_t *out, size_t outLen) {
+    z_stream *strm = &codec->deflater;
+    size_t written = 0;
+    pthread_mutex_lock(&codec->deflateLock);
+    deflateReset(strm);
+    if (codec->config.dictionary)
+        deflateSetDictionary(strm, codec->config.dictionary, codec->config.dictionaryLen);
+    strm->next_in = (Bytef *)data;
+    strm->avail_in = len;
+    strm->next_out = out;
+    strm->avail_out = outLen;
+    if (deflate(strm, Z_FINISH) == Z_STREAM_END)
+        written = outLen - strm->avail_out;
+    pthread_mutex_unlock(&codec->deflateLock);
+    return written;
+}
+
+static uint8_t *encodeFrame(channelCodec *codec, uint8_t flags, const uint8_t *data, size_t len, size_t *outLen) {
+    size_t compressed = 0;
+    uint8_t *out;
+    if (len > CHANNEL_CODEC_MAX_MESSAGE)
+        return NULL;
+    if (codec->config.compression == CHANNEL_COMPRESSION_DEFLATE && len >= codec->config.threshold) {
+        size_t bound = deflateBound(&codec->deflater, len);
+        out = malloc(1 + bound);
+        compressed = deflateMessage(codec, data, len, out + 1, bound);
+        // incompressible payloads go out as they are
+        if (compressed > 0 && compressed < len) {
+            out[0] = flags | CHANNEL_FRAME_DEFLATE;
+            *outLen = 1 + compressed;
+            return out;
+        }
+        free(out);
+    }
+    out = malloc(1 + len);
+    out[0] = flags;
+    memcpy(out + 1, data, len);
+    *outLen = 1 + len;
+    return out;
+}
+
+uint8_t *channelCodecEncode(channelCodec *codec, const uint8_t *data, size_t len, int flags, size_t *outLen) {
+    return encodeFrame(codec, flags & (CHANNEL_FRAME_TEXT | CHANNEL_FRAME_VALUE), data, len, outLen);
+}
+
+uint8_t *channelCodecEncodeBatch(channelCodec *codec, const channelBatch *batch, size_t *outLen) {
+    return encodeFrame(codec, CHANNEL_FRAME_BATCH, batch->data, batch->len, outLen);
+}
+
+static uint8_t *inflateMessage(channelCodec *codec, const uint8_t *data, size_t len, size_t *outLen) {
+    z_stream *strm = &codec->inflater;
+    size_t cap = len * 4 < 4096 ? 4096 : len * 4;
+    uint8_t *out = malloc(cap);
+    int status;
+    pthread_mutex_lock(&codec->inflateLock);
+    inflateReset(strm);
+    if (codec->config.dictionary)
+        inflateSetDictionary(strm, codec->config.dictionary, codec->config.dictionaryLen);
+    strm->next_in = (Bytef *)data;
+    strm->avail_in = len;
+    strm->next_out = out;
+    strm->avail_out = cap;
+    while ((status = inflate(strm, Z_FINISH)) == Z_BUF_ERROR && strm->avail_out == 0 && cap < CHANNEL_CODEC_MAX_MESSAGE) {
+        size_t used = cap;
+        cap = cap * 2 > CHANNEL_CODEC_MAX_MESSAGE ? CHANNEL_CODEC_MAX_MESSAGE : cap * 2;
+        out = realloc(out, cap);
+        strm->next_out = out + used;
+        strm->avail_out = cap - used;
+    }
+    *outLen = cap - strm->avail_out;
+    pthread_mutex_unlock(&codec->inflateLock);
+    if (status != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+uint8_t *channelCodecDecode(channelCodec *codec, const uint8_t *data, size_t len, int *flags, size_t *outLen) {
+    if (len == 0)
+        return NULL;
+    *flags = data[0] & (CHANNEL_FRAME_TEXT | CHANNEL_FRAME_BATCH | CHANNEL_FRAME_VALUE);
+    if (data[0] & CHANNEL_FRAME_DEFLATE)
+        return inflateMessage(codec, data + 1, len - 1, outLen);
+    uint8_t *out = malloc(len > 1 ? len - 1 : 1);
+    memcpy(out, data + 1, len - 1);
+    *outLen = len - 1;
+    return out;
+}
+
+void channelBatchAppend(channelBatch *batch, const uint8_t *data, size_t len, int flags) {
+    // flags byte and up to 5 bytes of length
+    if (batch->len + 6 + len > batch->cap) {
+        batch->cap = (batch->len + 6 + len) * 2;
+        batch->data = realloc(batch->data, batch->cap);
+    }
+    batch->data[batch->len++] = flags & (CHANNEL_FRAME_TEXT | CHANNEL_FRAME_VALUE);
+    size_t rest = len;
+    do {
+        uint8_t byte = rest & 0x7f;
+        rest >>= 7;
+        batch->data[batch->len++] = rest ? byte | 0x80 : byte;
+    } while (rest);
+    memcpy(batch->data + batch->len, data, len);
+    batch->len += len;
+    batch->count++;
+}
+
+void channelBatchFree(channelBatch *batch) {
+    free(batch->data);
+    memset(batch, 0, sizeof(*batch));
+}
+
+int channelBatchNext(const uint8_t **data, size_t *len, const uint8_t **msg, size_t *msgLen, int *flags) {
+    const uint8_t *p = *data, *end = *data + *len;
+    size_t value = 0;
+    int shift = 0;
+    if (p == end)
+        return 0;
+    *flags = *p++ & (CHANNEL_FRAME_TEXT | CHANNEL_FRAME_VALUE);
+    do {
+        if (p == end || shift > 28)
+            return -1;
+        value |= (size_t)(*p & 0x7f) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    if (value > (size_t)(end - p))
+        return -1;
+    *msg = p;
+    *msgLen = value;
+    *data = p + value;
+    *len = end - *data;
+    return 1;
+}
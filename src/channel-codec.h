@@ -0,0 +1,70 @@
+#ifndef __CHANNEL_CODEC_H
+#define __CHANNEL_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Every message on a channel with a codec starts with one flags byte
+#define CHANNEL_FRAME_DEFLATE 0x01
+#define CHANNEL_FRAME_TEXT 0x02
+// The payload is a run of records, each a flags byte (CHANNEL_FRAME_TEXT,
+// CHANNEL_FRAME_VALUE or 0), a LEB128 length and the message
+#define CHANNEL_FRAME_BATCH 0x04
+// The message is a MessagePack value from sendValue()
+#define CHANNEL_FRAME_VALUE 0x08
+
+// Channels created with codec options announce it with this protocol
+#define CHANNEL_CODEC_PROTOCOL "x-qjs-framed"
+
+#define CHANNEL_CODEC_DEFAULT_THRESHOLD 1024
+#define CHANNEL_CODEC_MAX_MESSAGE (16 * 1024 * 1024)
+#define CHANNEL_CODEC_DEFAULT_COALESCE_BYTES 16384
+
+enum {
+    CHANNEL_COMPRESSION_NONE,
+    CHANNEL_COMPRESSION_DEFLATE,
+};
+
+typedef struct {
+    int framed; // frames messages even without compression or coalescing
+    int compression;
+    uint32_t threshold;
+    uint8_t *dictionary;
+    size_t dictionaryLen;
+    uint32_t coalesceIntervalMs; // 0 sends every message on its own
+    uint32_t coalesceMaxBytes;
+} channelCodecConfig;
+
+// Messages packed for one CHANNEL_FRAME_BATCH frame
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+    uint32_t count;
+} channelBatch;
+
+typedef struct channelCodec channelCodec;
+
+// Zero when messages can go out as they are, without a codec
+int channelCodecConfigEnabled(const channelCodecConfig *config);
+// Takes ownership of the dictionary, the codec starts with one reference
+channelCodec *channelCodecCreate(const channelCodecConfig *config);
+void channelCodecRetain(channelCodec *codec);
+void channelCodecRelease(channelCodec *codec);
+const channelCodecConfig *channelCodecGetConfig(channelCodec *codec);
+
+// Both return a malloc'd buffer, or NULL when the message can't be handled.
+// flags is CHANNEL_FRAME_TEXT, CHANNEL_FRAME_VALUE or 0.
+uint8_t *channelCodecEncode(channelCodec *codec, const uint8_t *data, size_t len, int flags, size_t *outLen);
+uint8_t *channelCodecEncodeBatch(channelCodec *codec, const channelBatch *batch, size_t *outLen);
+// flags gets the CHANNEL_FRAME_TEXT, CHANNEL_FRAME_VALUE and
+// CHANNEL_FRAME_BATCH bits of the frame
+uint8_t *channelCodecDecode(channelCodec *codec, const uint8_t *data, size_t len, int *flags, size_t *outLen);
+
+void channelBatchAppend(channelBatch *batch, const uint8_t *data, size_t len, int flags);
+void channelBatchFree(channelBatch *batch);
+// Walks a decoded batch payload. Returns 1 per message, 0 at the end and
+// -1 when the payload is malformed.
+int channelBatchNext(const uint8_t **data, size_t *len, const uint8_t **msg, size_t *msgLen, int *flags);
+
+#endif
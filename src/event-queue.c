@@ -1,13 +1,28 @@
 #include "event-queue.h"
+#include "js-utils.h"
+#include "time-utils.h"
+#include "trace.h"
 #include <quickjs/quickjs-libc.h>
 #include <string.h>
+#include <stdatomic.h>
 #include <pthread.h>
+#include <fcntl.h>
 #include <unistd.h>
 
+struct eventTarget {
+    atomic_int refs;
+    int closed;
+    JSValue obj;
+};
+
 typedef struct {
     eventHandler handler;
     JSValue obj;
     void *data;
+    eventDataFree freeData;
+    eventTarget *target;
+    uint64_t traceId;
+    uint64_t queuedAt;
 } eventData;
 
 typedef struct s_eventQueueNode {
@@ -20,12 +35,55 @@ typedef struct {
     eventQueueNode *tail;
     pthread_mutex_t lock;
     int eventPipe[2];
+    size_t pending;
 } eventQueue;
 
+// Dispatch budget per pollEvents pass, 0 disables a limit. Only touched on
+// the JS thread.
+typedef struct {
+    uint32_t maxEvents;
+    uint32_t maxTimeUs;
+    uint64_t dispatched;
+    uint64_t passes;
+    uint64_t yields;
+    uint64_t longestPassUs;
+} dispatchBudget;
+
 static eventQueue *eventQueuePtr = NULL;
+static atomic_uint_fast64_t nextTraceId;
+static dispatchBudget budget = {
+    .maxEvents = DEFAULT_DISPATCH_MAX_EVENTS,
+    .maxTimeUs = DEFAULT_DISPATCH_MAX_TIME_US,
+};
+
+eventTarget *eventTargetCreate(JSValue obj) {
+    eventTarget *target = malloc(sizeof(eventTarget));
+    atomic_init(&target->refs, 1);
+    target->closed = 0;
+    target->obj = obj;
+    return target;
+}
+
+void eventTargetClose(eventTarget *target) {
+    target->closed = 1;
+}
+
+void eventTargetRetain(eventTarget *target) {
+    atomic_fetch_add(&target->refs, 1);
+}
+
+void eventTargetRelease(eventTarget *target) {
+    if (atomic_fetch_sub(&target->refs, 1) == 1)
+        free(target);
+}
 
 static void freeEventData(eventData *event) {
-    free(event->data);
+    if (event->freeData)
+        event->freeData(event->data);
+    else
+        free(event->data);
+    if (event->target)
+        eventTargetRelease(event->target);
     free(event);
 }
 
@@ -34,9 +92,22 @@ static eventData *createEventData(eventHandler handler, JSValue obj, void *data)
     event->handler = handler;
     event->obj = obj;
     event->data = data;
+    event->freeData = NULL;
+    event->target = NULL;
+    event->queuedAt = traceNow();
+    if (event->queuedAt) {
+        event->traceId = atomic_fetch_add(&nextTraceId, 1);
+        traceFlow('s', "event", event->traceId, event->queuedAt);
+    }
     return event;
 }
 
+static int isEventLive(JSContext *ctx, eventData *event) {
+    if (event->target)
+        return !event->target->closed;
+    return JS_VALUE_GET_PTR(event->obj) != NULL && JS_IsLiveObject(JS_GetRuntime(ctx), event->obj);
+}
+
 static eventQueueNode *createEventQueueNode(eventData *value) {
     eventQueueNode *eventNode = malloc(sizeof(eventQueueNode));
     eventNode->value = value;
@@ -52,6 +123,8 @@ static void enqueueEventInternal(eventQueue *eventQueue, eventData *event) {
     else
         eventQueue->tail->next = queueNode;
     eventQueue->tail = queueNode;
+    eventQueue->pending++;
+    // a full pipe already wakes the JS thread, EAGAIN is fine
     write(eventQueue->eventPipe[1], "1", 1); // dummy value
     pthread_mutex_unlock(&eventQueue->lock);
 }
@@ -67,6 +140,7 @@ static eventData *dequeueEvent(eventQueue *eventQueue) {
     eventNode = eventQueue->head;
     if (eventNode != NULL) {
         eventQueue->head = eventNode->next;
+        eventQueue->pending--;
         event = eventNode->value;
         free(eventNode);
     }
@@ -79,10 +153,14 @@ static eventQueue *createEventQueue() {
     queue = malloc(sizeof(*queue));
     queue->head = NULL;
     queue->tail = NULL;
+    queue->pending = 0;
     if (pipe(queue->eventPipe) == -1) {
         perror("error creating event queue pipe");
         exit(EXIT_FAILURE);
     }
+    // the JS thread drains the pipe until EAGAIN and must never block on it
+    fcntl(queue->eventPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(queue->eventPipe[1], F_SETFL, O_NONBLOCK);
     if (pthread_mutex_init(&queue->lock, NULL) != 0) {
         perror("event queue mutex init has failed\n");
         exit(EXIT_FAILURE);
@@ -99,34 +177,107 @@ static void freeEventQueue(eventQueue *eventQueue) {
 }
 
 void flushEventPipe() {
-    char buf[10];
-    size_t bufLen = sizeof(buf);
-    while (read(eventQueuePtr->eventPipe[0], buf, bufLen) == bufLen) {}
+    char buf[256];
+    while (read(eventQueuePtr->eventPipe[0], buf, sizeof(buf)) > 0) {}
+}
+
+static int budgetExhausted(uint32_t dispatched, uint64_t start, uint64_t *now) {
+    if (budget.maxEvents && dispatched >= budget.maxEvents)
+        return 1;
+    if (!budget.maxTimeUs)
+        return 0;
+    *now = monotonicTimeUs();
+    return *now - start >= budget.maxTimeUs;
+}
+
+// Leftover events wait for the next pass, the pipe write makes the os loop
+// call us again after it ran its timers.
+static void yieldDispatch() {
+    budget.yields++;
+    write(eventQueuePtr->eventPipe[1], "1", 1);
 }
 
 static JSValue pollEvents(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     eventData *event;
+    uint32_t dispatched = 0;
+    uint64_t start = monotonicTimeUs(), now = start;
     flushEventPipe();
+    budget.passes++;
     while (hasEvents(eventQueuePtr)) {
+        if (budgetExhausted(dispatched, start, &now)) {
+            yieldDispatch();
+            break;
+        }
         event = dequeueEvent(eventQueuePtr);
-        if (JS_VALUE_GET_PTR(event->obj) != NULL && JS_IsLiveObject(JS_GetRuntime(ctx), event->obj)) {
+        if (isEventLive(ctx, event)) {
+            uint64_t handlerStart = traceNow();
+            traceFlow('f', "event", event->traceId, event->queuedAt ? handlerStart : 0);
             event->handler(ctx, event->obj, event->data);
+            traceComplete("dispatch", handlerStart, "queuedUs", event->queuedAt ? handlerStart - event->queuedAt : -1);
         }
         freeEventData(event);
+        dispatched++;
+    }
+    budget.dispatched += dispatched;
+    if (budget.maxTimeUs == 0)
+        now = monotonicTimeUs();
+    if (now - start > budget.longestPassUs)
+        budget.longestPassUs = now - start;
+    return JS_UNDEFINED;
+}
+
+static int JS_GetBudgetProp(JSContext *ctx, JSValueConst obj, const char *prop, uint32_t *res) {
+    JSValue val = JS_GetPropertyStr(ctx, obj, prop);
+    int status = 0;
+    if (!JS_IsUndefined(val))
+        status = !JS_IsNumber(val) || JS_ToUint32(ctx, res, val) ? -1 : 0;
+    JS_FreeValue(ctx, val);
+    return status;
+}
+
+JSValue setEventBudget(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    uint32_t maxEvents = budget.maxEvents, maxTimeUs = budget.maxTimeUs;
+    if (argc == 0 || !JS_IsObject(argv[0]))
+        return JS_ThrowTypeError(ctx, "The event budget should be an object");
+    if (JS_GetBudgetProp(ctx, argv[0], "maxEvents", &maxEvents))
+        return JS_ThrowRangeError(ctx, "Invalid maxEvents value");
+    if (JS_GetBudgetProp(ctx, argv[0], "maxTimeUs", &maxTimeUs))
+        return JS_ThrowRangeError(ctx, "Invalid maxTimeUs value");
+    budget.maxEvents = maxEvents;
+    budget.maxTimeUs = maxTimeUs;
+    return JS_UNDEFINED;
+}
+
+JSValue getEventStats(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    size_t pending = 0;
+    if (eventQueuePtr) {
+        pthread_mutex_lock(&eventQueuePtr->lock);
+        pending = eventQueuePtr->pending;
+        pthread_mutex_unlock(&eventQueuePtr->lock);
     }
+    JSValue stats = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, stats, "maxEvents", JS_NewUint32(ctx, budget.maxEvents));
+    JS_SetPropertyStr(ctx, stats, "maxTimeUs", JS_NewUint32(ctx, budget.maxTimeUs));
+    JS_SetPropertyStr(ctx, stats, "pending", JS_NewFloat64(ctx, (double)pending));
+    JS_SetPropertyStr(ctx, stats, "dispatched", JS_NewFloat64(ctx, (double)budget.dispatched));
+    JS_SetPropertyStr(ctx, stats, "passes", JS_NewFloat64(ctx, (double)budget.passes));
+    JS_SetPropertyStr(ctx, stats, "yields", JS_NewFloat64(ctx, (double)budget.yields));
+    JS_SetPropertyStr(ctx, stats, "longestPassUs", JS_NewFloat64(ctx, (double)budget.longestPassUs));
+    return stats;
 }
 
 static JSValue initEventQueueJob(JSContext *ctx, int argc, JSValueConst *argv) {
-    JSValue global = JS_GetGlobalObject(ctx);
-    JSValue os = JS_GetPropertyStr(ctx, global, "os");
-    JSValue setReadHandler = JS_GetPropertyStr(ctx, os, "setReadHandler");
     JSValue pollEventsFn = JS_NewCFunction(ctx, pollEvents, "", 0);
-    JSValue setReadHandlerArgs[] = { JS_NewInt32(ctx, eventQueuePtr->eventPipe[0]), pollEventsFn };
-    JS_Call(ctx, setReadHandler, JS_UNDEFINED, 2, setReadHandlerArgs);
-    JS_FreeValue(ctx, os);
-    JS_FreeValue(ctx, global);
-    JS_FreeValue(ctx, setReadHandler);
+    int status = JS_SetOsReadHandler(ctx, eventQueuePtr->eventPipe[0], pollEventsFn);
     JS_FreeValue(ctx, pollEventsFn);
+    // reported by the job loop, without the handler no event is ever delivered
+    return status < 0 ? JS_EXCEPTION : JS_UNDEFINED;
 }
 
 void initEventQueue(JSContext *ctx) {
@@ -138,4 +289,12 @@ void initEventQueue(JSContext *ctx) {
 void enqueueEvent(eventHandler handler, JSValue obj, void *data) {
     eventData *event = createEventData(handler, obj, data);
     enqueueEventInternal(eventQueuePtr, event);
-}
\ No newline at end of file
+}
+
+void enqueueTargetEvent(eventTarget *target, eventHandler handler, void *data, eventDataFree freeData) {
+    eventData *event = createEventData(handler, target->obj, data);
+    event->freeData = freeData;
+    event->target = target;
+    atomic_fetch_add(&target->refs, 1);
+    enqueueEventInternal(eventQueuePtr, event);
+}
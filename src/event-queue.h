@@ -1,7 +1,30 @@
+#ifndef __EVENT_QUEUE_H
+#define __EVENT_QUEUE_H
+
 #include <quickjs/quickjs.h>
 
+#define DEFAULT_DISPATCH_MAX_EVENTS 1024
+#define DEFAULT_DISPATCH_MAX_TIME_US 8000
+
 typedef void(*eventHandler)(JSContext *ctx, JSValue obj, void *data);
+typedef void(*eventDataFree)(void *data);
+
+// Stands in for a JS object in the queue. Once closed, the events still
+// queued for it are dropped without looking at the object.
+typedef struct eventTarget eventTarget;
 
 void enqueueEvent(eventHandler handler, JSValue obj, void *data);
+// freeData releases data whether or not the handler ran, NULL means free()
+void enqueueTargetEvent(eventTarget *target, eventHandler handler, void *data, eventDataFree freeData);
+eventTarget *eventTargetCreate(JSValue obj);
+// JS thread only
+void eventTargetClose(eventTarget *target);
+// Keeps the target alive while it is referenced outside the queue
+void eventTargetRetain(eventTarget *target);
+void eventTargetRelease(eventTarget *target);
+JSValue setEventBudget(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+JSValue getEventStats(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
 void flushEvents(JSContext *ctx);
-void initEventQueue(JSContext *ctx);
\ No newline at end of file
+void initEventQueue(JSContext *ctx);
+
+#endif
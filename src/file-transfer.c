@@ -0,0 +1,298 @@
+#include "file-transfer.h"
+#include "logger.h"
+#include "time-utils.h"
+#include "trace.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <rtc/rtc.h>
+
+#define FILE_TRANSFER_WAIT_US 100000
+
+struct fileSender {
+    int channelId;
+    int fd;
+    uint64_t offset;
+    uint64_t length;
+    uint32_t chunkSize;
+    channelCodec *codec;
+    fileTransferCallback callback;
+    void *opaque;
+    atomic_int cancelled;
+    pthread_mutex_t lock;
+    pthread_cond_t drained;
+    pthread_t thread;
+};
+
+typedef struct s_receivedChunk {
+    size_t len;
+    struct s_receivedChunk *next;
+    uint8_t data[];
+} receivedChunk;
+
+struct fileReceiver {
+    int fd;
+    uint64_t length;
+    uint64_t accepted;
+    fileTransferCallback callback;
+    void *opaque;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    receivedChunk *head;
+    receivedChunk *tail;
+    size_t queuedBytes;
+    int ended;
+    int failed;
+    int cancelled;
+    pthread_t thread;
+};
+
+static void waitForDrain(fileSender *sender) {
+    pthread_mutex_lock(&sender->lock);
+    while (!atomic_load(&sender->cancelled) && rtcGetBufferedAmount(sender->channelId) > FILE_TRANSFER_HIGH_WATERMARK) {
+        // the timeout covers a notification racing with the check above
+        uint64_t deadline = monotonicTimeUs() + FILE_TRANSFER_WAIT_US;
+        struct timespec ts = { .tv_sec = deadline / 1000000, .tv_nsec = (deadline % 1000000) * 1000 };
+        pthread_cond_timedwait(&sender->drained, &sender->lock, &ts);
+    }
+    pthread_mutex_unlock(&sender->lock);
+}
+
+static int sendChunk(fileSender *sender, const uint8_t *chunk, size_t len) {
+    uint64_t start = traceNow();
+    int result;
+    if (sender->codec == NULL) {
+        result = rtcSendMessage(sender->channelId, (const char *)chunk, len);
+    } else {
+        size_t frameLen;
+        uint8_t *frame = channelCodecEncode(sender->codec, chunk, len, 0, &frameLen);
+        result = frame ? rtcSendMessage(sender->channelId, (const char *)frame, frameLen) : -1;
+        free(frame);
+    }
+    traceComplete("sendFileChunk", start, "bytes", len);
+    return result;
+}
+
+static void *fileSenderThread(void *arg) {
+    fileSender *sender = (fileSender *)arg;
+    uint8_t *chunk = malloc(sender->chunkSize);
+    uint64_t sent = 0;
+    traceSetThreadName("file-reader");
+    int status = FILE_TRANSFER_RUNNING;
+    while (status == FILE_TRANSFER_RUNNING) {
+        waitForDrain(sender);
+        if (atomic_load(&sender->cancelled)) {
+            status = FILE_TRANSFER_FAILED;
+            break;
+        }
+        size_t want = sender->length - sent < sender->chunkSize ? sender->length - sent : sender->chunkSize;
+        ssize_t got = pread(sender->fd, chunk, want, sender->offset + sent);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0 || (got == 0 && want > 0)) {
+            logMessage(RTC_LOG_WARNING, "Channel %d file read failed at byte %llu", sender->channelId, (unsigned long long)sent);
+            status = FILE_TRANSFER_FAILED;
+        } else if (got > 0 && sendChunk(sender, chunk, got) < 0) {
+            logMessage(RTC_LOG_WARNING, "Channel %d file send failed at byte %llu", sender->channelId, (unsigned long long)sent);
+            status = FILE_TRANSFER_FAILED;
+        } else {
+            sent += got;
+            if (sent == sender->length)
+                status = FILE_TRANSFER_DONE;
+            else
+                sender->callback(sender->opaque, sent, sender->length, FILE_TRANSFER_RUNNING);
+        }
+    }
+    free(chunk);
+    sender->callback(sender->opaque, sent, sender->length, status);
+    return NULL;
+}
+
+fileSender *fileSenderStart(
+    int channelId, int fd, uint64_t offset, uint64_t length, uint32_t chunkSize,
+    channelCodec *codec, fileTransferCallback callback, void *opaque)
+{
+    fileSender *sender = calloc(1, sizeof(fileSender));
+    sender->channelId = channelId;
+    sender->fd = fd;
+    sender->offset = offset;
+    sender->length = length;
+    sender->chunkSize = chunkSize;
+    sender->codec = codec;
+    sender->callback = callback;
+    sender->opaque = opaque;
+    atomic_init(&sender->cancelled, 0);
+    pthread_mutex_init(&sender->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sender->drained, &attr);
+    pthread_condattr_destroy(&attr);
+    if (codec)
+        channelCodecRetain(codec);
+    rtcSetBufferedAmountLowThreshold(channelId, FILE_TRANSFER_LOW_WATERMARK);
+    if (pthread_create(&sender->thread, NULL, fileSenderThread, sender) != 0) {
+        sender->thread = 0;
+        fileSenderStop(sender);
+        return NULL;
+    }
+    return sender;
+}
+
+void fileSenderNotify(fileSender *sender) {
+    pthread_mutex_lock(&sender->lock);
+    pthread_cond_signal(&sender->drained);
+    pthread_mutex_unlock(&sender->lock);
+}
+
+void fileSenderStop(fileSender *sender) {
+    atomic_store(&sender->cancelled, 1);
+    fileSenderNotify(sender);
+    if (sender->thread)
+        pthread_join(sender->thread, NULL);
+    if (sender->codec)
+        channelCodecRelease(sender->codec);
+    // back to the libdatachannel default, nothing else sets a threshold
+    rtcSetBufferedAmountLowThreshold(sender->channelId, 0);
+    close(sender->fd);
+    pthread_mutex_destroy(&sender->lock);
+    pthread_cond_destroy(&sender->drained);
+    free(sender);
+}
+
+static receivedChunk *nextReceivedChunk(fileReceiver *receiver, int *status) {
+    receivedChunk *chunk;
+    pthread_mutex_lock(&receiver->lock);
+    while (receiver->head == NULL && !receiver->ended && !receiver->failed && !receiver->cancelled)
+        pthread_cond_wait(&receiver->ready, &receiver->lock);
+    chunk = receiver->failed || receiver->cancelled ? NULL : receiver->head;
+    if (chunk) {
+        receiver->head = chunk->next;
+        if (receiver->head == NULL)
+            receiver->tail = NULL;
+    } else {
+        // without a length the transfer ends with the channel
+        *status = receiver->failed || receiver->cancelled || receiver->length ? FILE_TRANSFER_FAILED : FILE_TRANSFER_DONE;
+    }
+    pthread_mutex_unlock(&receiver->lock);
+    return chunk;
+}
+
+static int writeChunk(int fd, const uint8_t *pos, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, pos, len);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0)
+            return -1;
+        pos += written;
+        len -= written;
+    }
+    return 0;
+}
+
+static void *fileReceiverThread(void *arg) {
+    fileReceiver *receiver = (fileReceiver *)arg;
+    receivedChunk *chunk;
+    uint64_t written = 0;
+    traceSetThreadName("file-writer");
+    int status = FILE_TRANSFER_RUNNING;
+    while (status == FILE_TRANSFER_RUNNING && (chunk = nextReceivedChunk(receiver, &status)) != NULL) {
+        uint64_t start = traceNow();
+        if (writeChunk(receiver->fd, chunk->data, chunk->len) < 0) {
+            logMessage(RTC_LOG_WARNING, "File write failed at byte %llu", (unsigned long long)written);
+            status = FILE_TRANSFER_FAILED;
+        } else {
+            traceComplete("writeFileChunk", start, "bytes", chunk->len);
+            written += chunk->len;
+            if (receiver->length && written == receiver->length)
+                status = FILE_TRANSFER_DONE;
+            else
+                receiver->callback(receiver->opaque, written, receiver->length, FILE_TRANSFER_RUNNING);
+        }
+        pthread_mutex_lock(&receiver->lock);
+        receiver->queuedBytes -= chunk->len;
+        if (status == FILE_TRANSFER_FAILED)
+            receiver->failed = 1;
+        pthread_mutex_unlock(&receiver->lock);
+        free(chunk);
+    }
+    receiver->callback(receiver->opaque, written, receiver->length, status);
+    return NULL;
+}
+
+fileReceiver *fileReceiverStart(int fd, uint64_t length, fileTransferCallback callback, void *opaque) {
+    fileReceiver *receiver = calloc(1, sizeof(fileReceiver));
+    receiver->fd = fd;
+    receiver->length = length;
+    receiver->callback = callback;
+    receiver->opaque = opaque;
+    pthread_mutex_init(&receiver->lock, NULL);
+    pthread_cond_init(&receiver->ready, NULL);
+    if (pthread_create(&receiver->thread, NULL, fileReceiverThread, receiver) != 0) {
+        receiver->thread = 0;
+        fileReceiverStop(receiver);
+        return NULL;
+    }
+    return receiver;
+}
+
+// Only copies the chunk. A full queue fails the transfer rather than
+// stalling the thread that delivers messages for every channel.
+int fileReceiverWrite(fileReceiver *receiver, const void *data, size_t len) {
+    int consumed = 1;
+    pthread_mutex_lock(&receiver->lock);
+    if (receiver->ended || (receiver->length && receiver->accepted == receiver->length)) {
+        consumed = 0;
+    } else if (receiver->failed) {
+        // the rest of a failed transfer is dropped
+    } else if ((receiver->length && len > receiver->length - receiver->accepted)
+        || receiver->queuedBytes + len > FILE_TRANSFER_MAX_QUEUED_BYTES)
+    {
+        receiver->failed = 1;
+        pthread_cond_signal(&receiver->ready);
+    } else {
+        receivedChunk *chunk = malloc(sizeof(receivedChunk) + len);
+        chunk->len = len;
+        chunk->next = NULL;
+        memcpy(chunk->data, data, len);
+        if (receiver->tail)
+            receiver->tail->next = chunk;
+        else
+            receiver->head = chunk;
+        receiver->tail = chunk;
+        receiver->accepted += len;
+        receiver->queuedBytes += len;
+        pthread_cond_signal(&receiver->ready);
+    }
+    pthread_mutex_unlock(&receiver->lock);
+    return consumed;
+}
+
+void fileReceiverEnd(fileReceiver *receiver) {
+    pthread_mutex_lock(&receiver->lock);
+    receiver->ended = 1;
+    pthread_cond_signal(&receiver->ready);
+    pthread_mutex_unlock(&receiver->lock);
+}
+
+void fileReceiverStop(fileReceiver *receiver) {
+    pthread_mutex_lock(&receiver->lock);
+    receiver->cancelled = 1;
+    pthread_cond_signal(&receiver->ready);
+    pthread_mutex_unlock(&receiver->lock);
+    if (receiver->thread)
+        pthread_join(receiver->thread, NULL);
+    while (receiver->head) {
+        receivedChunk *next = receiver->head->next;
+        free(receiver->head);
+        receiver->head = next;
+    }
+    close(receiver->fd);
+    pthread_mutex_destroy(&receiver->lock);
+    pthread_cond_destroy(&receiver->ready);
+    free(receiver);
+}
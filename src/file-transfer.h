@@ -0,0 +1,50 @@
+#ifndef __FILE_TRANSFER_H
+#define __FILE_TRANSFER_H
+
+#include "channel-codec.h"
+#include <stdint.h>
+
+#define FILE_TRANSFER_DEFAULT_CHUNK_SIZE 16384
+#define FILE_TRANSFER_MAX_CHUNK_SIZE 262144
+// the reader pauses above the high watermark until the channel drains
+// below the low one
+#define FILE_TRANSFER_HIGH_WATERMARK (1024 * 1024)
+#define FILE_TRANSFER_LOW_WATERMARK (256 * 1024)
+// received chunks waiting for the writer
+#define FILE_TRANSFER_MAX_QUEUED_BYTES (16 * 1024 * 1024)
+
+enum {
+    FILE_TRANSFER_RUNNING,
+    FILE_TRANSFER_DONE,
+    FILE_TRANSFER_FAILED,
+};
+
+// Called from the reader or writer thread for every chunk, and once more with
+// DONE or FAILED as its last call
+typedef void (*fileTransferCallback)(void *opaque, uint64_t bytes, uint64_t total, int status);
+
+typedef struct fileSender fileSender;
+typedef struct fileReceiver fileReceiver;
+
+// Takes ownership of fd. codec may be NULL, otherwise a reference is taken.
+// The channel buffered amount low threshold is set for the transfer and reset
+// to 0 when the sender stops.
+fileSender *fileSenderStart(
+    int channelId, int fd, uint64_t offset, uint64_t length, uint32_t chunkSize,
+    channelCodec *codec, fileTransferCallback callback, void *opaque);
+// Wakes the reader after the channel buffered amount went low
+void fileSenderNotify(fileSender *sender);
+// Cancels the transfer if it's still running, waits for the reader and frees it
+void fileSenderStop(fileSender *sender);
+
+// Takes ownership of fd, length 0 means the transfer ends with the channel
+fileReceiver *fileReceiverStart(int fd, uint64_t length, fileTransferCallback callback, void *opaque);
+// Queues the chunk for the writer, 0 when it comes after the whole length and
+// isn't part of the transfer
+int fileReceiverWrite(fileReceiver *receiver, const void *data, size_t len);
+// The channel closed, the writer finishes what is queued
+void fileReceiverEnd(fileReceiver *receiver);
+// Cancels the transfer if it's still running, waits for the writer and frees it
+void fileReceiverStop(fileReceiver *receiver);
+
+#endif
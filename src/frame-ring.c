@@ -0,0 +1,369 @@
+#include "frame-ring.h"
+#include "time-utils.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAME_RING_MAGIC_OFFSET 0
+#define FRAME_RING_CAPACITY_OFFSET 4
+#define FRAME_RING_WRITE_OFFSET 8
+#define FRAME_RING_READ_OFFSET 12
+#define FRAME_RING_FRAMES_OFFSET 16
+#define FRAME_RING_OVERRUNS_OFFSET 20
+
+#define FRAME_RING_READER_OFFSET 24
+
+// Producers that write the ring from JS don't wake the reader, it looks at
+// the rings this often while any is attached
+#define FRAME_RING_IDLE_POLL_US 10000
+
+struct s_frameRingReader {
+    uint8_t *mem;
+    frameRingFrameCallback onFrame;
+    void *opaque;
+    uint32_t lastOverruns;
+    struct s_frameRingReader *next;
+};
+
+// One thread reads every attached ring
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    pthread_t thread;
+    int started;
+    atomic_int sleeping;
+    frameRingReader *head;
+    frameRingReader *active; // being read without the lock
+} frameRingReaders;
+
+static frameRingReaders readers = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+};
+
+static _Atomic uint32_t *ringField(const uint8_t *mem, size_t offset) {
+    return (_Atomic uint32_t *)(mem + offset);
+}
+
+static uint32_t loadField(const uint8_t *mem, size_t offset, memory_order order) {
+    return atomic_load_explicit(ringField(mem, offset), order);
+}
+
+static uint32_t recordSize(size_t len) {
+    return (FRAME_RING_RECORD_HEADER_SIZE + len + 3) & ~3u;
+}
+
+uint32_t frameRingValidate(const uint8_t *mem, size_t len) {
+    if (mem == NULL || len < FRAME_RING_HEADER_SIZE || ((uintptr_t)mem & 3) != 0)
+        return 0;
+    uint32_t capacity = loadField(mem, FRAME_RING_CAPACITY_OFFSET, memory_order_relaxed);
+    if (loadField(mem, FRAME_RING_MAGIC_OFFSET, memory_order_relaxed) != FRAME_RING_MAGIC
+        || capacity < FRAME_RING_MIN_CAPACITY || (capacity & (capacity - 1)) != 0
+        || capacity > len - FRAME_RING_HEADER_SIZE)
+        return 0;
+    return capacity;
+}
+
+// Positions run freely and wrap at 2^32, a power of two capacity keeps
+// position % capacity consistent across that wrap.
+int frameRingWrite(uint8_t *mem, const uint8_t *buf, size_t len, uint32_t timestamp, uint32_t flags) {
+    uint32_t capacity = loadField(mem, FRAME_RING_CAPACITY_OFFSET, memory_order_relaxed);
+    uint32_t writePos = loadField(mem, FRAME_RING_WRITE_OFFSET, memory_order_relaxed);
+    uint32_t readPos = loadField(mem, FRAME_RING_READ_OFFSET, memory_order_acquire);
+    uint8_t *data = mem + FRAME_RING_HEADER_SIZE;
+    if (len > capacity - FRAME_RING_RECORD_HEADER_SIZE) {
+        atomic_fetch_add_explicit(ringField(mem, FRAME_RING_OVERRUNS_OFFSET), 1, memory_order_relaxed);
+        return -1;
+    }
+    uint32_t size = recordSize(len);
+    uint32_t offset = writePos & (capacity - 1);
+    uint32_t skip = capacity - offset < size ? capacity - offset : 0;
+    if (size + skip > capacity - (writePos - readPos)) {
+        atomic_fetch_add_explicit(ringField(mem, FRAME_RING_OVERRUNS_OFFSET), 1, memory_order_relaxed);
+        return -1;
+    }
+    if (skip) {
+        // records are 4 byte aligned so there is always room for the marker
+        uint32_t wrap = FRAME_RING_WRAP;
+        memcpy(data + offset, &wrap, sizeof(wrap));
+        writePos += skip;
+        offset = 0;
+    }
+    uint32_t header[3] = { (uint32_t)len, timestamp, flags };
+    memcpy(data + offset, header, sizeof(header));
+    memcpy(data + offset + FRAME_RING_RECORD_HEADER_SIZE, buf, len);
+    atomic_store_explicit(ringField(mem, FRAME_RING_WRITE_OFFSET), writePos + size, memory_order_release);
+    atomic_fetch_add_explicit(ringField(mem, FRAME_RING_FRAMES_OFFSET), 1, memory_order_relaxed);
+    // pairs with the fence in frameRingReaderThread, either the reader sees
+    // the new write position or this sees it sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&readers.sleeping, memory_order_relaxed)) {
+        pthread_mutex_lock(&readers.lock);
+        pthread_cond_signal(&readers.wake);
+        pthread_mutex_unlock(&readers.lock);
+    }
+    return 0;
+}
+
+void frameRingGetStats(const uint8_t *mem, frameRingStats *stats) {
+    stats->capacity = loadField(mem, FRAME_RING_CAPACITY_OFFSET, memory_order_relaxed);
+    stats->pendingBytes = loadField(mem, FRAME_RING_WRITE_OFFSET, memory_order_acquire)
+        - loadField(mem, FRAME_RING_READ_OFFSET, memory_order_acquire);
+    stats->framesWritten = loadField(mem, FRAME_RING_FRAMES_OFFSET, memory_order_relaxed);
+    stats->overruns = loadField(mem, FRAME_RING_OVERRUNS_OFFSET, memory_order_relaxed);
+}
+
+// The read position is published after every frame so the producer can
+// reuse the space while the rest of the backlog is sent.
+static void readFrames(frameRingReader *r) {
+    uint8_t *mem = r->mem;
+    uint8_t *data = mem + FRAME_RING_HEADER_SIZE;
+    uint32_t capacity = loadField(mem, FRAME_RING_CAPACITY_OFFSET, memory_order_relaxed);
+    uint32_t readPos = loadField(mem, FRAME_RING_READ_OFFSET, memory_order_relaxed);
+    uint32_t writePos = loadField(mem, FRAME_RING_WRITE_OFFSET, memory_order_acquire);
+    uint32_t overruns = loadField(mem, FRAME_RING_OVERRUNS_OFFSET, memory_order_relaxed);
+    uint32_t gap = overruns != r->lastOverruns ? FRAME_RING_GAP : 0;
+    r->lastOverruns = overruns;
+    while (readPos != writePos) {
+        uint32_t offset = readPos & (capacity - 1);
+        uint32_t header[3];
+        memcpy(header, data + offset, sizeof(uint32_t));
+        if (header[0] == FRAME_RING_WRAP) {
+            readPos += capacity - offset;
+            continue;
+        }
+        memcpy(header, data + offset, sizeof(header));
+        // a corrupt size from a foreign producer resets the ring to empty
+        if (header[0] > capacity - FRAME_RING_RECORD_HEADER_SIZE || recordSize(header[0]) > writePos - readPos
+            || recordSize(header[0]) > capacity - offset) {
+            readPos = writePos;
+            break;
+        }
+        r->onFrame(data + offset + FRAME_RING_RECORD_HEADER_SIZE, header[0], header[1], header[2] | gap, r->opaque);
+        gap = 0;
+        readPos += recordSize(header[0]);
+        atomic_store_explicit(ringField(mem, FRAME_RING_READ_OFFSET), readPos, memory_order_release);
+    }
+    atomic_store_explicit(ringField(mem, FRAME_RING_READ_OFFSET), readPos, memory_order_release);
+}
+
+static int hasFrames(frameRingReader *r) {
+    return loadField(r->mem, FRAME_RING_WRITE_OFFSET, memory_order_acquire)
+        != loadField(r->mem, FRAME_RING_READ_OFFSET, memory_order_relaxed);
+}
+
+// Called with the lock held
+static int anyHasFrames(void) {
+    for (frameRingReader *r = readers.head; r != NULL; r = r->next) {
+        if (hasFrames(r))
+            return 1;
+    }
+    return 0;
+}
+
+// Frames are packetized and sent from here, which is too slow for the
+// shared timer thread. A ring being read stays linked, destroying its reader
+// waits for it.
+static void *frameRingReaderThread(void *arg) {
+    traceSetThreadName("frame-ring");
+    pthread_mutex_lock(&readers.lock);
+    while (1) {
+        int read = 0;
+        frameRingReader *r = readers.head;
+        while (r != NULL) {
+            if (!hasFrames(r)) {
+                r = r->next;
+                continue;
+            }
+            readers.active = r;
+            pthread_mutex_unlock(&readers.lock);
+            readFrames(r);
+            pthread_mutex_lock(&readers.lock);
+            readers.active = NULL;
+            pthread_cond_broadcast(&readers.idle);
+            r = r->next;
+            read = 1;
+        }
+        if (read)
+            continue;
+        atomic_store_explicit(&readers.sleeping, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (readers.head == NULL) {
+            pthread_cond_wait(&readers.wake, &readers.lock);
+        } else if (!anyHasFrames()) {
+            uint64_t deadline = monotonicTimeUs() + FRAME_RING_IDLE_POLL_US;
+            struct timespec ts = { .tv_sec = deadline / 1000000, .tv_nsec = (deadline % 1000000) * 1000 };
+            pthread_cond_timedwait(&readers.wake, &readers.lock, &ts);
+        }
+        atomic_store_explicit(&readers.sleeping, 0, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static void startReaderThread() {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&readers.wake, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&readers.thread, NULL, frameRingReaderThread, NULL) != 0) {
+        perror("error creating frame ring reader thread");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(readers.thread);
+    readers.started = 1;
+}
+
+frameRingReader *frameRingReaderCreate(uint8_t *mem, frameRingFrameCallback onFrame, void *opaque) {
+    uint32_t unclaimed = 0;
+    // the claim lives in the ring, so it also holds against readers of
+    // other runtimes the buffer was posted to
+    if (!atomic_compare_exchange_strong(ringField(mem, FRAME_RING_READER_OFFSET), &unclaimed, 1))
+        return NULL;
+    frameRingReader *r = calloc(1, sizeof(frameRingReader));
+    r->mem = mem;
+    r->onFrame = onFrame;
+    r->opaque = opaque;
+    r->lastOverruns = loadField(mem, FRAME_RING_OVERRUNS_OFFSET, memory_order_relaxed);
+    pthread_mutex_lock(&readers.lock);
+    if (!readers.started)
+        startReaderThread();
+    r->next = readers.head;
+    readers.head = r;
+    pthread_cond_signal(&readers.wake);
+    pthread_mutex_unlock(&readers.lock);
+    return r;
+}
+
+// Once this returns the reader no longer touches the ring or calls onFrame,
+// and the ring can be attached again. Not to be called from onFrame.
+void frameRingReaderDestroy(frameRingReader *r) {
+    pthread_mutex_lock(&readers.lock);
+    while (readers.active == r)
+        pthread_cond_wait(&readers.idle, &readers.lock);
+    frameRingReader **link = &readers.head;
+    while (*link != r)
+        link = &(*link)->next;
+    *link = r->next;
+    pthread_mutex_unlock(&readers.lock);
+    atomic_store(ringField(r->mem, FRAME_RING_READER_OFFSET), 0);
+    free(r);
+}
+
+static uint8_t *getRingMemory(JSContext *ctx, JSValueConst val) {
+    size_t len;
+    uint8_t *mem = JS_GetArrayBuffer(ctx, &len, val);
+    if (mem == NULL || frameRingValidate(mem, len) == 0) {
+        if (mem == NULL)
+            JS_FreeValue(ctx, JS_GetException(ctx));
+        JS_ThrowTypeError(ctx, "Invalid frame ring argument");
+        return NULL;
+    }
+    return mem;
+}
+
+// Same ArrayBuffer or typed array fallback as the msgpack encoder
+static uint8_t *getFrameBytes(JSContext *ctx, JSValueConst val, size_t *len) {
+    size_t offset, elementSize, bufLen;
+    uint8_t *data = JS_GetArrayBuffer(ctx, len, val);
+    if (data != NULL)
+        return data;
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    JSValue arrayBuffer = JS_GetTypedArrayBuffer(ctx, val, &offset, len, &elementSize);
+    if (JS_IsException(arrayBuffer)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return NULL;
+    }
+    data = JS_GetArrayBuffer(ctx, &bufLen, arrayBuffer);
+    JS_FreeValue(ctx, arrayBuffer);
+    return data != NULL ? data + offset : NULL;
+}
+
+// The buffer comes from the global constructor so the runtime's shared
+// allocator backs it and postMessage hands the same memory to workers.
+JSValue createFrameRing(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    uint32_t capacity = FRAME_RING_DEFAULT_CAPACITY;
+    if (argc > 0 && !JS_IsUndefined(argv[0])) {
+        if (!JS_IsNumber(argv[0]) || JS_ToUint32(ctx, &capacity, argv[0])
+            || capacity < FRAME_RING_MIN_CAPACITY || capacity > FRAME_RING_MAX_CAPACITY)
+            return JS_ThrowRangeError(ctx, "Invalid capacity argument");
+    }
+    uint32_t rounded = FRAME_RING_MIN_CAPACITY;
+    while (rounded < capacity)
+        rounded <<= 1;
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue ctor = JS_GetPropertyStr(ctx, global, "SharedArrayBuffer");
+    JS_FreeValue(ctx, global);
+    if (!JS_IsFunction(ctx, ctor)) {
+        JS_FreeValue(ctx, ctor);
+        return JS_ThrowInternalError(ctx, "SharedArrayBuffer is not available");
+    }
+    JSValue size = JS_NewUint32(ctx, FRAME_RING_HEADER_SIZE + rounded);
+    JSValue ring = JS_CallConstructor(ctx, ctor, 1, &size);
+    JS_FreeValue(ctx, ctor);
+    if (JS_IsException(ring))
+        return ring;
+    size_t len;
+    uint8_t *mem = JS_GetArrayBuffer(ctx, &len, ring);
+    if (mem == NULL) {
+        JS_FreeValue(ctx, ring);
+        return JS_EXCEPTION;
+    }
+    // the constructor zeroed the positions and counters
+    atomic_store_explicit(ringField(mem, FRAME_RING_CAPACITY_OFFSET), rounded, memory_order_relaxed);
+    atomic_store_explicit(ringField(mem, FRAME_RING_MAGIC_OFFSET), FRAME_RING_MAGIC, memory_order_release);
+    return ring;
+}
+
+JSValue writeFrameRing(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    uint32_t timestamp = 0, flags = 0;
+    size_t len;
+    uint8_t *mem = argc > 0 ? getRingMemory(ctx, argv[0]) : NULL;
+    const uint8_t *buf;
+    if (mem == NULL)
+        return argc > 0 ? JS_EXCEPTION : JS_ThrowTypeError(ctx, "Invalid frame ring argument");
+    if (argc < 2 || (buf = getFrameBytes(ctx, argv[1], &len)) == NULL)
+        return JS_ThrowTypeError(ctx, "Invalid frame argument");
+    if (argc > 2 && !JS_IsUndefined(argv[2])) {
+        if (!JS_IsObject(argv[2]))
+            return JS_ThrowTypeError(ctx, "Invalid options argument");
+        JSValue val = JS_GetPropertyStr(ctx, argv[2], "timestamp");
+        int invalid = !JS_IsUndefined(val) && (!JS_IsNumber(val) || JS_ToUint32(ctx, &timestamp, val));
+        JS_FreeValue(ctx, val);
+        if (invalid)
+            return JS_ThrowRangeError(ctx, "Invalid timestamp value");
+        val = JS_GetPropertyStr(ctx, argv[2], "keyframe");
+        if (JS_ToBool(ctx, val))
+            flags |= FRAME_RING_KEYFRAME;
+        JS_FreeValue(ctx, val);
+    }
+    return JS_NewBool(ctx, frameRingWrite(mem, buf, len, timestamp, flags) == 0);
+}
+
+JSValue getFrameRingStats(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    frameRingStats stats;
+    uint8_t *mem = argc > 0 ? getRingMemory(ctx, argv[0]) : NULL;
+    if (mem == NULL)
+        return argc > 0 ? JS_EXCEPTION : JS_ThrowTypeError(ctx, "Invalid frame ring argument");
+    frameRingGetStats(mem, &stats);
+    JSValue obj = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, obj, "capacity", JS_NewUint32(ctx, stats.capacity));
+    JS_SetPropertyStr(ctx, obj, "pendingBytes", JS_NewUint32(ctx, stats.pendingBytes));
+    JS_SetPropertyStr(ctx, obj, "framesWritten", JS_NewUint32(ctx, stats.framesWritten));
+    JS_SetPropertyStr(ctx, obj, "overruns", JS_NewUint32(ctx, stats.overruns));
+    return obj;
+}
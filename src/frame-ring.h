@@ -0,0 +1,65 @@
+#ifndef __FRAME_RING_H
+#define __FRAME_RING_H
+
+#include "js-utils.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Single producer, single consumer ring of frames in a SharedArrayBuffer.
+// All fields are native endian uint32 so a plain Int32Array producer with
+// Atomics can share the ring with the native one.
+//
+//   0  magic 'FRNG'
+//   4  capacity of the data region, a power of two
+//   8  write position, free running, only stored by the producer (release)
+//  12  read position, free running, only stored by the consumer (release)
+//  16  frames written
+//  20  overruns, frames the producer dropped because the ring was full
+//  24  reader, nonzero while a track reads the ring
+//  64  data region
+//
+// A record is a 12 byte header (size, timestamp, flags) followed by the
+// frame, padded to 4 bytes. A record never wraps: when it does not fit in
+// front of the end the producer writes FRAME_RING_WRAP as size and starts
+// over at offset 0.
+#define FRAME_RING_MAGIC 0x474e5246
+#define FRAME_RING_HEADER_SIZE 64
+#define FRAME_RING_RECORD_HEADER_SIZE 12
+#define FRAME_RING_WRAP 0xffffffffu
+#define FRAME_RING_DEFAULT_CAPACITY (1024 * 1024)
+#define FRAME_RING_MIN_CAPACITY 1024
+#define FRAME_RING_MAX_CAPACITY (256 * 1024 * 1024)
+
+#define FRAME_RING_KEYFRAME 0x01
+// Set by the reader on the first frame after the producer reported overruns
+#define FRAME_RING_GAP 0x80000000u
+
+typedef struct s_frameRingReader frameRingReader;
+
+// Called on the reader thread for every frame, buf points into the ring
+typedef void (*frameRingFrameCallback)(const uint8_t *buf, size_t len, uint32_t timestamp, uint32_t flags, void *opaque);
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t pendingBytes;
+    uint32_t framesWritten;
+    uint32_t overruns;
+} frameRingStats;
+
+// Returns the capacity of a valid ring or 0
+uint32_t frameRingValidate(const uint8_t *mem, size_t len);
+// Returns -1 and counts an overrun when the frame does not fit
+int frameRingWrite(uint8_t *mem, const uint8_t *buf, size_t len, uint32_t timestamp, uint32_t flags);
+void frameRingGetStats(const uint8_t *mem, frameRingStats *stats);
+
+// Reads the ring on the shared reader thread until destroyed, which
+// frameRingWrite wakes. NULL when the ring already has a reader. The memory
+// must stay alive until frameRingReaderDestroy returned.
+frameRingReader *frameRingReaderCreate(uint8_t *mem, frameRingFrameCallback onFrame, void *opaque);
+void frameRingReaderDestroy(frameRingReader *r);
+
+JSValue createFrameRing(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+JSValue writeFrameRing(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+JSValue getFrameRingStats(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+
+#endif
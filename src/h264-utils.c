@@ -0,0 +1,99 @@
+#include "h264-utils.h"
+
+static size_t findStartSequence(const uint8_t *buf, size_t len, size_t from, size_t *seqLen) {
+    for (size_t i = from; i + 3 <= len; i++) {
+        if (buf[i] != 0 || buf[i + 1] != 0)
+            continue;
+        if (buf[i + 2] == 1) {
+            *seqLen = 3;
+            return i;
+        }
+        if (i + 4 <= len && buf[i + 2] == 0 && buf[i + 3] == 1) {
+            *seqLen = 4;
+            return i;
+        }
+    }
+    *seqLen = 0;
+    return len;
+}
+
+void h264ForEachNalUnit(const uint8_t *buf, size_t len, rtcNalUnitSeparator separator,
+    h264NalUnitVisitor visitor, void *opaque)
+{
+    if (separator == RTC_NAL_SEPARATOR_LENGTH) {
+        size_t pos = 0;
+        while (pos + 4 <= len) {
+            size_t nalLen = (size_t)buf[pos] << 24 | buf[pos + 1] << 16 | buf[pos + 2] << 8 | buf[pos + 3];
+            pos += 4;
+            if (nalLen > len - pos)
+                break;
+            visitor(buf + pos, nalLen, opaque);
+            pos += nalLen;
+        }
+        return;
+    }
+    size_t seqLen, next;
+    size_t start = findStartSequence(buf, len, 0, &seqLen);
+    while (start < len) {
+        size_t nalStart = start + seqLen;
+        next = findStartSequence(buf, len, nalStart, &seqLen);
+        if (next > nalStart)
+            visitor(buf + nalStart, next - nalStart, opaque);
+        start = next;
+    }
+}
+
+typedef struct {
+    uint16_t maxFragmentSize;
+    uint32_t count;
+} packetCount;
+
+static void countNalUnitPackets(const uint8_t *nal, size_t len, void *opaque) {
+    packetCount *pc = opaque;
+    size_t fragmentPayload = pc->maxFragmentSize - 2; // FU indicator and header
+    if (len <= pc->maxFragmentSize)
+        pc->count++;
+    else
+        pc->count += (len - 1 + fragmentPayload - 1) / fragmentPayload;
+}
+
+// Mirrors the fragmentation done by the libdatachannel H264 packetizer so the
+// caller can follow the RTP sequence numbers it produces.
+uint32_t h264CountRtpPackets(const uint8_t *buf, size_t len, rtcNalUnitSeparator separator,
+    uint16_t maxFragmentSize)
+{
+    packetCount pc = { .maxFragmentSize = maxFragmentSize, .count = 0 };
+    h264ForEachNalUnit(buf, len, separator, countNalUnitPackets, &pc);
+    return pc.count;
+}
+
+typedef struct {
+    uint16_t maxFragmentSize;
+    h264RtpPayloadVisitor visitor;
+    void *opaque;
+} payloadSplit;
+
+static void splitNalUnit(const uint8_t *nal, size_t len, void *opaque) {
+    payloadSplit *split = opaque;
+    size_t fragmentPayload = split->maxFragmentSize - 2;
+    uint8_t fu[2];
+    if (len <= split->maxFragmentSize) {
+        split->visitor(NULL, 0, nal, len, split->opaque);
+        return;
+    }
+    fu[0] = (nal[0] & 0xe0) | 28; // FU-A keeps the F and NRI bits
+    for (size_t pos = 1; pos < len; pos += fragmentPayload) {
+        size_t chunk = len - pos < fragmentPayload ? len - pos : fragmentPayload;
+        fu[1] = (nal[0] & 0x1f) | (pos == 1 ? 0x80 : 0) | (pos + chunk == len ? 0x40 : 0);
+        split->visitor(fu, sizeof(fu), nal + pos, chunk, split->opaque);
+    }
+}
+
+// Same single NAL unit and FU-A split as h264CountRtpPackets, for senders
+// that build their own RTP packets
+void h264ForEachRtpPayload(const uint8_t *buf, size_t len, rtcNalUnitSeparator separator,
+    uint16_t maxFragmentSize, h264RtpPayloadVisitor visitor, void *opaque)
+{
+    payloadSplit split = { .maxFragmentSize = maxFragmentSize, .visitor = visitor, .opaque = opaque };
+    h264ForEachNalUnit(buf, len, separator, splitNalUnit, &split);
+}
@@ -0,0 +1,20 @@
+#ifndef __H264_UTILS_H
+#define __H264_UTILS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <rtc/rtc.h>
+
+typedef void (*h264NalUnitVisitor)(const uint8_t *nal, size_t len, void *opaque);
+// One RTP payload, prefix holds the FU-A indicator and header of fragments
+typedef void (*h264RtpPayloadVisitor)(const uint8_t *prefix, size_t prefixLen,
+    const uint8_t *payload, size_t len, void *opaque);
+
+void h264ForEachNalUnit(const uint8_t *buf, size_t len, rtcNalUnitSeparator separator,
+    h264NalUnitVisitor visitor, void *opaque);
+uint32_t h264CountRtpPackets(const uint8_t *buf, size_t len, rtcNalUnitSeparator separator,
+    uint16_t maxFragmentSize);
+void h264ForEachRtpPayload(const uint8_t *buf, size_t len, rtcNalUnitSeparator separator,
+    uint16_t maxFragmentSize, h264RtpPayloadVisitor visitor, void *opaque);
+
+#endif
@@ -0,0 +1,234 @@
+#include "jitter-buffer.h"
+#include "rtcp-parser.h"
+#include "timer-wheel.h"
+#include "time-utils.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JITTER_BUFFER_TICK_US 5000
+#define RTP_MIN_HEADER_SIZE 12
+// Late packets in a row taken as the sender restarting its sequence numbers
+#define JITTER_BUFFER_RESYNC_LATE 16
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    uint16_t seq;
+    uint64_t arrival;
+} jitterSlot;
+
+struct s_jitterBuffer {
+    jitterBufferConfig config;
+    jitterBufferEmit emit;
+    void *opaque;
+    pthread_mutex_t lock;
+    int started;
+    uint16_t nextSeq;
+    uint16_t firstSeq; // lowest buffered sequence number, while buffered > 0
+    uint32_t lateRun;
+    uint64_t lastArrival;
+    uint32_t lastTimestamp;
+    double jitterUs; // RFC 3550 interarrival jitter
+    uint64_t delayUs;
+    int timerArmed;
+    int destroyed;
+    jitterBufferStats stats;
+    jitterSlot slots[JITTER_BUFFER_SLOTS];
+};
+
+static jitterSlot *slotFor(jitterBuffer *jb, uint16_t seq) {
+    return &jb->slots[seq % JITTER_BUFFER_SLOTS];
+}
+
+static void clearSlot(jitterBuffer *jb, jitterSlot *slot) {
+    free(slot->buf);
+    slot->buf = NULL;
+    jb->stats.buffered--;
+}
+
+static void freeJitterBuffer(jitterBuffer *jb) {
+    for (int i = 0; i < JITTER_BUFFER_SLOTS; i++)
+        free(jb->slots[i].buf);
+    pthread_mutex_destroy(&jb->lock);
+    free(jb);
+}
+
+static void updateDelay(jitterBuffer *jb, uint64_t now, uint32_t timestamp) {
+    if (jb->lastArrival) {
+        double transit = (double)(now - jb->lastArrival)
+            - (double)(int32_t)(timestamp - jb->lastTimestamp) * 1000000.0 / jb->config.clockRate;
+        jb->jitterUs += (fabs(transit) - jb->jitterUs) / 16;
+    }
+    jb->lastArrival = now;
+    jb->lastTimestamp = timestamp;
+    if (!jb->config.adaptive)
+        return;
+    // hold for a few jitter deviations, within the configured bounds
+    uint64_t delay = (uint64_t)(jb->jitterUs * 4);
+    if (delay < jb->config.minDelayMs * 1000ull)
+        delay = jb->config.minDelayMs * 1000ull;
+    if (delay > jb->config.maxDelayMs * 1000ull)
+        delay = jb->config.maxDelayMs * 1000ull;
+    jb->delayUs = delay;
+}
+
+// Called with the lock held while something is buffered. Every buffered
+// packet is within JITTER_BUFFER_SLOTS of nextSeq, and each sequence number
+// is only walked over once, as nextSeq moves past it.
+static uint16_t nextBuffered(jitterBuffer *jb, uint16_t seq) {
+    for (int i = 0; i < JITTER_BUFFER_SLOTS; i++) {
+        jitterSlot *slot = slotFor(jb, seq + i);
+        if (slot->buf && slot->seq == (uint16_t)(seq + i))
+            return seq + i;
+    }
+    return seq;
+}
+
+// Called with the lock held
+static void clearAll(jitterBuffer *jb) {
+    for (int i = 0; i < JITTER_BUFFER_SLOTS; i++) {
+        if (jb->slots[i].buf) {
+            clearSlot(jb, &jb->slots[i]);
+            jb->stats.lost++;
+        }
+    }
+}
+
+static jitterBatch *collectReleased(jitterBuffer *jb, uint64_t now) {
+    jitterBatch *batch = NULL;
+    size_t cap = 0;
+    while (jb->stats.buffered > 0) {
+        jitterSlot *slot = slotFor(jb, jb->firstSeq);
+        if (slot->arrival + jb->delayUs > now)
+            break;
+        // a gap whose successor is due won't be filled in time
+        jb->stats.lost += (uint16_t)(slot->seq - jb->nextSeq);
+        if (batch == NULL) {
+            cap = 16;
+            batch = malloc(sizeof(jitterBatch) + cap * sizeof(jitterPacket));
+            batch->count = 0;
+        } else if (batch->count == cap) {
+            cap *= 2;
+            batch = realloc(batch, sizeof(jitterBatch) + cap * sizeof(jitterPacket));
+        }
+        batch->packets[batch->count++] = (jitterPacket) { slot->buf, slot->len };
+        slot->buf = NULL;
+        jb->stats.buffered--;
+        jb->stats.emitted++;
+        jb->nextSeq = slot->seq + 1;
+        if (jb->stats.buffered > 0)
+            jb->firstSeq = nextBuffered(jb, jb->nextSeq);
+    }
+    return batch;
+}
+
+// Packets are released in sequence order once they have been held for the
+// target delay. The emit callback only queues them so it runs under the lock.
+static void releasePackets(void *opaque) {
+    jitterBuffer *jb = opaque;
+    pthread_mutex_lock(&jb->lock);
+    jb->timerArmed = 0;
+    if (jb->destroyed) {
+        pthread_mutex_unlock(&jb->lock);
+        freeJitterBuffer(jb);
+        return;
+    }
+    jitterBatch *batch = collectReleased(jb, monotonicTimeUs());
+    if (batch != NULL)
+        jb->emit(batch, jb->opaque);
+    if (jb->stats.buffered > 0) {
+        jb->timerArmed = 1;
+        timerWheelSchedule(JITTER_BUFFER_TICK_US, releasePackets, jb);
+    }
+    pthread_mutex_unlock(&jb->lock);
+}
+
+jitterBuffer *jitterBufferCreate(const jitterBufferConfig *config, jitterBufferEmit emit, void *opaque) {
+    jitterBuffer *jb = calloc(1, sizeof(jitterBuffer));
+    jb->config = *config;
+    jb->emit = emit;
+    jb->opaque = opaque;
+    jb->delayUs = (config->adaptive ? config->minDelayMs : config->delayMs) * 1000ull;
+    pthread_mutex_init(&jb->lock, NULL);
+    return jb;
+}
+
+void jitterBufferPush(jitterBuffer *jb, const uint8_t *buf, size_t len) {
+    if (len < RTP_MIN_HEADER_SIZE)
+        return;
+    uint16_t seq = rtcpReadU16(buf + 2);
+    uint32_t timestamp = rtcpReadU32(buf + 4);
+    uint64_t now = monotonicTimeUs();
+    pthread_mutex_lock(&jb->lock);
+    jb->stats.received++;
+    if (!jb->started) {
+        jb->started = 1;
+        jb->nextSeq = seq;
+    }
+    int16_t offset = (int16_t)(seq - jb->nextSeq);
+    if (offset < 0 && ++jb->lateRun >= JITTER_BUFFER_RESYNC_LATE) {
+        // the stream jumped back, what is buffered belongs to the old one
+        clearAll(jb);
+        jb->nextSeq = seq;
+        offset = 0;
+    }
+    if (offset < 0) {
+        jb->stats.late++;
+    } else {
+        jb->lateRun = 0;
+        if (offset >= JITTER_BUFFER_SLOTS) {
+            // too far ahead to wait for the gap, restart the window at seq
+            clearAll(jb);
+            jb->stats.lost += offset - JITTER_BUFFER_SLOTS;
+            jb->nextSeq = seq;
+        }
+        jitterSlot *slot = slotFor(jb, seq);
+        if (slot->buf && slot->seq == seq) {
+            jb->stats.duplicates++;
+        } else {
+            if (slot->buf)
+                clearSlot(jb, slot);
+            slot->buf = malloc(len);
+            memcpy(slot->buf, buf, len);
+            slot->len = len;
+            slot->seq = seq;
+            slot->arrival = now;
+            if (jb->stats.buffered == 0 || (int16_t)(seq - jb->firstSeq) < 0)
+                jb->firstSeq = seq;
+            jb->stats.buffered++;
+            updateDelay(jb, now, timestamp);
+        }
+        if (!jb->timerArmed) {
+            jb->timerArmed = 1;
+            timerWheelSchedule(JITTER_BUFFER_TICK_US, releasePackets, jb);
+        }
+    }
+    pthread_mutex_unlock(&jb->lock);
+}
+
+void jitterBufferGetStats(jitterBuffer *jb, jitterBufferStats *stats) {
+    pthread_mutex_lock(&jb->lock);
+    *stats = jb->stats;
+    stats->delayMs = (uint32_t)(jb->delayUs / 1000);
+    stats->jitterMs = jb->jitterUs / 1000.0;
+    pthread_mutex_unlock(&jb->lock);
+}
+
+void jitterBufferFreeBatch(jitterBatch *batch) {
+    for (size_t i = 0; i < batch->count; i++)
+        free(batch->packets[i].buf);
+    free(batch);
+}
+
+// Buffered packets are dropped. If a release is scheduled the timer thread
+// frees the jitter buffer, otherwise it is freed right away.
+void jitterBufferDestroy(jitterBuffer *jb) {
+    pthread_mutex_lock(&jb->lock);
+    jb->destroyed = 1;
+    int armed = jb->timerArmed;
+    pthread_mutex_unlock(&jb->lock);
+    if (!armed)
+        freeJitterBuffer(jb);
+}
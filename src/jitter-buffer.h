@@ -0,0 +1,55 @@
+#ifndef __JITTER_BUFFER_H
+#define __JITTER_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define JITTER_BUFFER_SLOTS 1024
+#define JITTER_BUFFER_DEFAULT_DELAY_MS 50
+#define JITTER_BUFFER_DEFAULT_MIN_DELAY_MS 10
+#define JITTER_BUFFER_DEFAULT_MAX_DELAY_MS 500
+
+typedef struct s_jitterBuffer jitterBuffer;
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+} jitterPacket;
+
+// Packets released by one tick, in sequence order. The receiver owns it.
+typedef struct {
+    size_t count;
+    jitterPacket packets[];
+} jitterBatch;
+
+// Called from the timer thread with the buffer locked, must not call back into it
+typedef void (*jitterBufferEmit)(jitterBatch *batch, void *opaque);
+
+typedef struct {
+    int adaptive;
+    uint32_t delayMs;    // fixed mode hold time
+    uint32_t minDelayMs; // adaptive mode bounds
+    uint32_t maxDelayMs;
+    uint32_t clockRate;
+} jitterBufferConfig;
+
+typedef struct {
+    uint64_t received;
+    uint64_t emitted;
+    uint64_t late;
+    uint64_t lost;
+    uint64_t duplicates;
+    uint32_t buffered;
+    uint32_t delayMs;
+    double jitterMs;
+} jitterBufferStats;
+
+jitterBuffer *jitterBufferCreate(const jitterBufferConfig *config, jitterBufferEmit emit, void *opaque);
+// Copies the RTP packet, safe from any thread
+void jitterBufferPush(jitterBuffer *jb, const uint8_t *buf, size_t len);
+void jitterBufferGetStats(jitterBuffer *jb, jitterBufferStats *stats);
+void jitterBufferFreeBatch(jitterBatch *batch);
+// No emit callback runs once this returns
+void jitterBufferDestroy(jitterBuffer *jb);
+
+#endif
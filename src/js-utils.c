@@ -15,6 +15,35 @@ int initFullClass(JSContext *ctx, JSModuleDef *m, JSFullClassDef *fullDef) {
     return 0;
 }
 
+// Instances of a subclass keep the base class id, so the base opaque and
+// finalizer apply to them. The subclass id only holds the prototype, which
+// inherits from the base prototype and is shared by every instance.
+int initFullSubClass(JSContext *ctx, JSModuleDef *m, JSFullClassDef *fullDef, JSClassID baseClass) {
+    JSValue baseProto, proto;
+    JSContructorDef *constructor = &fullDef->constructor;
+    JS_NewClassID(&fullDef->id);
+    JS_NewClass(JS_GetRuntime(ctx), fullDef->id, &fullDef->def);
+    fullDef->baseClass = baseClass;
+    baseProto = JS_GetClassProto(ctx, baseClass);
+    proto = JS_NewObjectProto(ctx, baseProto);
+    JS_FreeValue(ctx, baseProto);
+    JS_SetPropertyFunctionList(ctx, proto, fullDef->funcs, fullDef->funcs_len / sizeof(fullDef->funcs[0]));
+    JS_SetClassProto(ctx, fullDef->id, proto);
+    if (constructor->fn) {
+        JSValue obj = JS_NewCFunction2(ctx, constructor->fn, fullDef->def.class_name,
+            constructor->args_count, JS_CFUNC_constructor, 0);
+        JS_SetModuleExport(ctx, m, fullDef->def.class_name, obj);
+    }
+    return 0;
+}
+
+JSValue JS_NewSubClassObject(JSContext *ctx, const JSFullClassDef *fullDef) {
+    JSValue proto = JS_GetClassProto(ctx, fullDef->id);
+    JSValue obj = JS_NewObjectProtoClass(ctx, proto, fullDef->baseClass);
+    JS_FreeValue(ctx, proto);
+    return obj;
+}
+
 void JS_CopyToCStringMax(JSContext *ctx, JSValue val, char* dest, size_t max_len) {
     size_t len;
     const char* src = JS_ToCStringLen(ctx, &len, val);
@@ -30,4 +59,25 @@ uint32_t JS_GetArrayLength(JSContext *ctx, JSValue array) {
     JS_ToUint32(ctx, &res, len);
     JS_FreeValue(ctx, len);
     return res;
+}
+// Same as os.setReadHandler(fd, fn), the os module keeps fn alive. Needs
+// globalThis.os, as set up by qjs --std.
+int JS_SetOsReadHandler(JSContext *ctx, int fd, JSValueConst fn) {
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue os = JS_GetPropertyStr(ctx, global, "os");
+    if (!JS_IsObject(os)) {
+        JS_FreeValue(ctx, os);
+        JS_FreeValue(ctx, global);
+        JS_ThrowReferenceError(ctx, "globalThis.os is not set, import the os module into it");
+        return -1;
+    }
+    JSValue setReadHandler = JS_GetPropertyStr(ctx, os, "setReadHandler");
+    JSValue args[] = { JS_NewInt32(ctx, fd), fn };
+    JSValue ret = JS_Call(ctx, setReadHandler, JS_UNDEFINED, 2, args);
+    int status = JS_IsException(ret) ? -1 : 0;
+    JS_FreeValue(ctx, ret);
+    JS_FreeValue(ctx, setReadHandler);
+    JS_FreeValue(ctx, os);
+    JS_FreeValue(ctx, global);
+    return status;
 }
\ No newline at end of file
@@ -26,7 +26,9 @@ typedef struct JSFullClassDef_s
 
 int initFullClass(JSContext *ctx, JSModuleDef *m, JSFullClassDef *fullDef);
 int initFullSubClass(JSContext *ctx, JSModuleDef *m, JSFullClassDef *fullDef, JSClassID baseClass);
+JSValue JS_NewSubClassObject(JSContext *ctx, const JSFullClassDef *fullDef);
 void JS_CopyToCStringMax(JSContext *ctx, JSValue val, char* dest, size_t max_len);
 uint32_t JS_GetArrayLength(JSContext *ctx, JSValue array);
+int JS_SetOsReadHandler(JSContext *ctx, int fd, JSValueConst fn);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,337 @@
+#include "logger.h"
+#include "trace.h"
+#include "time-utils.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_RING_SIZE 1024 // power of two
+#define LOG_MESSAGE_MAX 240
+#define LOG_JS_BATCH_MAX 4096
+
+typedef struct {
+    atomic_size_t seq;
+    rtcLogLevel level;
+    struct timespec time;
+    char message[LOG_MESSAGE_MAX];
+} logEntry;
+
+typedef struct s_logBatchNode {
+    rtcLogLevel level;
+    char *message;
+    struct s_logBatchNode *next;
+} logBatchNode;
+
+static const char *levelNames[] = {
+    "none", "fatal", "error", "warning", "info", "debug", "verbose"
+};
+
+// Bounded multi producer queue (D. Vyukov). Producers are libdatachannel
+// threads and the JS thread, the only consumer is the drain thread.
+static logEntry ring[LOG_RING_SIZE];
+static atomic_size_t enqueuePos;
+static size_t dequeuePos;
+static atomic_int currentLevel = LOG_DEFAULT_LEVEL;
+static atomic_uint_fast64_t droppedCount;
+static atomic_uint_fast64_t writtenCount;
+// set while the drain thread waits for a byte on wakePipe
+static atomic_int drainSleeping;
+static int wakePipe[2] = { -1, -1 };
+
+// sink, shared by the drain thread and the JS thread only
+static pthread_mutex_t sinkLock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *sinkFile = NULL;
+static int jsSink = 0;
+static int jsSinkPipe[2] = { -1, -1 };
+static logBatchNode *jsBatchHead = NULL;
+static logBatchNode *jsBatchTail = NULL;
+static size_t jsBatchCount = 0;
+// lines the JS handler fell behind on
+static atomic_uint_fast64_t batchDroppedCount;
+// JS thread only, kept alive by the installed read handler
+static JSValue jsHandler;
+
+static int pushEntry(rtcLogLevel level, const char *fmt, va_list args) {
+    logEntry *entry;
+    size_t pos = atomic_load_explicit(&enqueuePos, memory_order_relaxed);
+    while (1) {
+        entry = &ring[pos & (LOG_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueuePos, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&enqueuePos, memory_order_relaxed);
+        }
+    }
+    entry->level = level;
+    clock_gettime(CLOCK_REALTIME, &entry->time);
+    vsnprintf(entry->message, LOG_MESSAGE_MAX, fmt, args);
+    atomic_store_explicit(&entry->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+// The drain thread publishes drainSleeping before its last look at the ring,
+// so either it sees the new entry or the producer sees it sleeping. The entry
+// is only published with release, the fences on both sides keep each store
+// ahead of the load that follows it.
+static void wakeDrainThread(void) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&drainSleeping) && atomic_exchange(&drainSleeping, 0))
+        write(wakePipe[1], "1", 1);
+}
+
+void logMessage(rtcLogLevel level, const char *fmt, ...) {
+    va_list args;
+    if (level > atomic_load_explicit(&currentLevel, memory_order_relaxed))
+        return;
+    va_start(args, fmt);
+    if (pushEntry(level, fmt, args) < 0)
+        atomic_fetch_add(&droppedCount, 1);
+    va_end(args);
+    wakeDrainThread();
+}
+
+static void handleRtcLog(rtcLogLevel level, const char *message) {
+    logMessage(level, "%s", message);
+}
+
+static void queueJsLine(rtcLogLevel level, const char *message) {
+    if (jsBatchCount >= LOG_JS_BATCH_MAX) {
+        atomic_fetch_add(&batchDroppedCount, 1);
+        return;
+    }
+    logBatchNode *node = malloc(sizeof(logBatchNode));
+    node->level = level;
+    node->message = strdup(message);
+    node->next = NULL;
+    if (jsBatchTail == NULL)
+        jsBatchHead = node;
+    else
+        jsBatchTail->next = node;
+    jsBatchTail = node;
+    jsBatchCount++;
+}
+
+static void writeLine(rtcLogLevel level, const struct timespec *time, const char *message) {
+    char stamp[32];
+    struct tm tm;
+    if (jsSink) {
+        queueJsLine(level, message);
+        return;
+    }
+    localtime_r(&time->tv_sec, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    fprintf(sinkFile ? sinkFile : stderr, "%s.%03ld %-7s %s\n",
+        stamp, time->tv_nsec / 1000000, levelNames[level], message);
+}
+
+static int ringHasEntry(void) {
+    logEntry *entry = &ring[dequeuePos & (LOG_RING_SIZE - 1)];
+    return atomic_load_explicit(&entry->seq, memory_order_acquire) == dequeuePos + 1;
+}
+
+static int drainRing(void) {
+    int count = 0;
+    while (1) {
+        logEntry *entry = &ring[dequeuePos & (LOG_RING_SIZE - 1)];
+        if (atomic_load_explicit(&entry->seq, memory_order_acquire) != dequeuePos + 1)
+            break;
+        writeLine(entry->level, &entry->time, entry->message);
+        atomic_store_explicit(&entry->seq, dequeuePos + LOG_RING_SIZE, memory_order_release);
+        dequeuePos++;
+        count++;
+    }
+    return count;
+}
+
+static void *drainThread(void *arg) {
+    uint64_t reportedDrops = 0;
+    traceSetThreadName("logger");
+    while (1) {
+        pthread_mutex_lock(&sinkLock);
+        int count = drainRing();
+        uint64_t dropped = atomic_load(&droppedCount);
+        if (dropped != reportedDrops) {
+            char message[64];
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            snprintf(message, sizeof(message), "log ring overflow, %llu messages dropped",
+                (unsigned long long)(dropped - reportedDrops));
+            writeLine(RTC_LOG_WARNING, &now, message);
+            reportedDrops = dropped;
+            count++;
+        }
+        if (count > 0) {
+            atomic_fetch_add(&writtenCount, count);
+            if (jsSink)
+                write(jsSinkPipe[1], "1", 1);
+            else
+                fflush(sinkFile ? sinkFile : stderr);
+        }
+        pthread_mutex_unlock(&sinkLock);
+        if (count > 0)
+            continue;
+        char buf[64];
+        atomic_store(&drainSleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!ringHasEntry() && atomic_load(&droppedCount) == reportedDrops)
+            read(wakePipe[0], buf, sizeof(buf));
+        atomic_store(&drainSleeping, 0);
+    }
+    return NULL;
+}
+
+void initLogger(void) {
+    static int initialized = 0;
+    pthread_t thread;
+    if (initialized) return;
+    initialized = 1;
+    for (size_t i = 0; i < LOG_RING_SIZE; i++)
+        atomic_init(&ring[i].seq, i);
+    if (pipe(jsSinkPipe) == -1 || pipe(wakePipe) == -1) {
+        perror("error creating log pipe");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(jsSinkPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(jsSinkPipe[1], F_SETFL, O_NONBLOCK);
+    // producers never block, the drain thread blocks on the read end
+    fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+    if (pthread_create(&thread, NULL, drainThread, NULL) != 0) {
+        perror("error creating log thread");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread);
+    rtcInitLogger(LOG_DEFAULT_LEVEL, handleRtcLog);
+}
+
+static int parseLogLevel(JSContext *ctx, JSValueConst val, rtcLogLevel *level) {
+    if (JS_IsNumber(val)) {
+        int32_t num;
+        JS_ToInt32(ctx, &num, val);
+        if (num < RTC_LOG_NONE || num > RTC_LOG_VERBOSE)
+            return -1;
+        *level = num;
+        return 0;
+    }
+    if (!JS_IsString(val))
+        return -1;
+    const char *name = JS_ToCString(ctx, val);
+    int status = -1;
+    for (int i = RTC_LOG_NONE; i <= RTC_LOG_VERBOSE; i++) {
+        if (strcmp(name, levelNames[i]) == 0) {
+            *level = i;
+            status = 0;
+        }
+    }
+    JS_FreeCString(ctx, name);
+    return status;
+}
+
+JSValue setLogLevel(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    rtcLogLevel level;
+    if (argc == 0 || parseLogLevel(ctx, argv[0], &level) < 0)
+        return JS_ThrowTypeError(ctx, "Invalid log level");
+    atomic_store(&currentLevel, level);
+    rtcInitLogger(level, handleRtcLog);
+    return JS_UNDEFINED;
+}
+
+static void deliverBatch(JSContext *ctx, JSValueConst fn) {
+    logBatchNode *node;
+    pthread_mutex_lock(&sinkLock);
+    node = jsBatchHead;
+    jsBatchHead = jsBatchTail = NULL;
+    jsBatchCount = 0;
+    pthread_mutex_unlock(&sinkLock);
+    while (node != NULL) {
+        logBatchNode *next = node->next;
+        JSValue args[] = { JS_NewString(ctx, levelNames[node->level]), JS_NewString(ctx, node->message) };
+        JSValue ret = JS_Call(ctx, fn, JS_UNDEFINED, 2, args);
+        JS_FreeValue(ctx, ret);
+        JS_FreeValue(ctx, args[0]);
+        JS_FreeValue(ctx, args[1]);
+        free(node->message);
+        free(node);
+        node = next;
+    }
+}
+
+// Read handler on the JS thread, func_data[0] is the user callback
+static JSValue deliverLogBatch(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv, int magic, JSValue *func_data)
+{
+    char buf[64];
+    while (read(jsSinkPipe[0], buf, sizeof(buf)) > 0) {}
+    deliverBatch(ctx, func_data[0]);
+    return JS_UNDEFINED;
+}
+
+// setLogHandler(path) appends to a file, setLogHandler(fn) calls fn(level,
+// message) on the JS thread and setLogHandler(null) goes back to stderr.
+JSValue setLogHandler(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    JSValueConst target = argc > 0 ? argv[0] : JS_UNDEFINED;
+    JSValue fn = JS_NULL;
+    FILE *file = NULL;
+    int useJs = 0, wasJs;
+    if (JS_IsString(target)) {
+        const char *path = JS_ToCString(ctx, target);
+        file = fopen(path, "a");
+        JS_FreeCString(ctx, path);
+        if (file == NULL)
+            return JS_ThrowInternalError(ctx, "Error opening log file");
+    } else if (JS_IsFunction(ctx, target)) {
+        fn = JS_NewCFunctionData(ctx, deliverLogBatch, 0, 0, 1, &target);
+        useJs = 1;
+    } else if (!JS_IsUndefined(target) && !JS_IsNull(target)) {
+        return JS_ThrowTypeError(ctx, "The log handler should be a path or a function");
+    }
+    pthread_mutex_lock(&sinkLock);
+    if (sinkFile)
+        fclose(sinkFile);
+    sinkFile = file;
+    wasJs = jsSink;
+    jsSink = useJs;
+    pthread_mutex_unlock(&sinkLock);
+    // lines already batched go to the old handler while it is still installed
+    if (wasJs)
+        deliverBatch(ctx, jsHandler);
+    int status = JS_SetOsReadHandler(ctx, jsSinkPipe[0], fn);
+    JS_FreeValue(ctx, fn);
+    jsHandler = useJs && status == 0 ? target : JS_UNDEFINED;
+    if (useJs && status < 0) {
+        pthread_mutex_lock(&sinkLock);
+        jsSink = 0;
+        pthread_mutex_unlock(&sinkLock);
+        return JS_EXCEPTION;
+    }
+    return JS_UNDEFINED;
+}
+
+JSValue getLogStats(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    JSValue stats = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, stats, "level", JS_NewString(ctx, levelNames[atomic_load(&currentLevel)]));
+    JS_SetPropertyStr(ctx, stats, "written", JS_NewFloat64(ctx, (double)atomic_load(&writtenCount)));
+    JS_SetPropertyStr(ctx, stats, "dropped", JS_NewFloat64(ctx,
+        (double)(atomic_load(&droppedCount) + atomic_load(&batchDroppedCount))));
+    return stats;
+}
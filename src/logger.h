@@ -0,0 +1,17 @@
+#ifndef __LOGGER_H
+#define __LOGGER_H
+
+#include "js-utils.h"
+#include <rtc/rtc.h>
+
+#define LOG_DEFAULT_LEVEL RTC_LOG_WARNING
+
+void initLogger(void);
+// Never blocks: when the ring is full the message is dropped and counted
+void logMessage(rtcLogLevel level, const char *fmt, ...);
+
+JSValue setLogLevel(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+JSValue setLogHandler(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+JSValue getLogStats(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+
+#endif
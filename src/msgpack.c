@@ -0,0 +1,497 @@
+#include "msgpack.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static int reserve(msgpackBuffer *buf, size_t extra) {
+    if (buf->len + extra <= buf->cap)
+        return 0;
+    size_t cap = buf->cap ? buf->cap * 2 : 256;
+    while (cap < buf->len + extra)
+        cap *= 2;
+    uint8_t *data = realloc(buf->data, cap);
+    if (data == NULL) {
+        buf->outOfMemory = 1;
+        return -1;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+static void putByte(msgpackBuffer *buf, uint8_t byte) {
+    buf->data[buf->len++] = byte;
+}
+
+static void putBigEndian(msgpackBuffer *buf, uint64_t val, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--)
+        putByte(buf, (uint8_t)(val >> (i * 8)));
+}
+
+static int writeHeader(msgpackBuffer *buf, uint8_t fix, uint8_t fixMax, uint8_t b8, uint8_t b16, uint8_t b32, uint32_t len) {
+    if (reserve(buf, 5) < 0)
+        return -1;
+    if (fix && len <= fixMax)
+        putByte(buf, fix | len);
+    else if (b8 && len <= UINT8_MAX) {
+        putByte(buf, b8);
+        putBigEndian(buf, len, 1);
+    } else if (len <= UINT16_MAX) {
+        putByte(buf, b16);
+        putBigEndian(buf, len, 2);
+    } else {
+        putByte(buf, b32);
+        putBigEndian(buf, len, 4);
+    }
+    return 0;
+}
+
+static int writeBytes(msgpackBuffer *buf, const void *data, size_t len) {
+    if (reserve(buf, len) < 0)
+        return -1;
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return 0;
+}
+
+static int encodeNumber(msgpackBuffer *buf, double d) {
+    if (reserve(buf, 9) < 0)
+        return -1;
+    if (d == trunc(d) && d >= -9007199254740991.0 && d <= 9007199254740991.0 && !(d == 0 && signbit(d))) {
+        int64_t i = (int64_t)d;
+        if (i >= 0 && i <= 0x7f)
+            putByte(buf, (uint8_t)i);
+        else if (i < 0 && i >= -32)
+            putByte(buf, (uint8_t)(0xe0 | (i + 32)));
+        else if (i >= 0) {
+            if (i <= UINT8_MAX) { putByte(buf, 0xcc); putBigEndian(buf, i, 1); }
+            else if (i <= UINT16_MAX) { putByte(buf, 0xcd); putBigEndian(buf, i, 2); }
+            else if (i <= UINT32_MAX) { putByte(buf, 0xce); putBigEndian(buf, i, 4); }
+            else { putByte(buf, 0xcf); putBigEndian(buf, i, 8); }
+        } else {
+            if (i >= INT8_MIN) { putByte(buf, 0xd0); putBigEndian(buf, (uint64_t)i, 1); }
+            else if (i >= INT16_MIN) { putByte(buf, 0xd1); putBigEndian(buf, (uint64_t)i, 2); }
+            else if (i >= INT32_MIN) { putByte(buf, 0xd2); putBigEndian(buf, (uint64_t)i, 4); }
+            else { putByte(buf, 0xd3); putBigEndian(buf, (uint64_t)i, 8); }
+        }
+        return 0;
+    }
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    putByte(buf, 0xcb);
+    putBigEndian(buf, bits, 8);
+    return 0;
+}
+
+enum {
+    BINARY_ARRAY_BUFFER,
+    BINARY_SHARED_ARRAY_BUFFER,
+    BINARY_TYPED_ARRAY,
+    BINARY_MAX,
+};
+
+typedef struct {
+    msgpackBuffer *buf;
+    // constructors binary values are told apart with, looked up on the
+    // first object so plain objects never go through a failing
+    // JS_GetArrayBuffer or JS_GetTypedArrayBuffer
+    JSValue binaryCtors[BINARY_MAX];
+    int hasCtors;
+} encoder;
+
+static int encodeValue(JSContext *ctx, JSValueConst val, encoder *enc, int depth);
+
+static int encodeString(JSContext *ctx, JSValueConst val, msgpackBuffer *buf) {
+    size_t len;
+    const char *str = JS_ToCStringLen(ctx, &len, val);
+    if (str == NULL)
+        return -1;
+    int status = writeHeader(buf, 0xa0, 31, 0xd9, 0xda, 0xdb, len) < 0 || writeBytes(buf, str, len) < 0 ? -1 : 0;
+    JS_FreeCString(ctx, str);
+    return status;
+}
+
+static int encodeArray(JSContext *ctx, JSValueConst val, encoder *enc, int depth) {
+    uint32_t len = JS_GetArrayLength(ctx, val);
+    if (writeHeader(enc->buf, 0x90, 15, 0, 0xdc, 0xdd, len) < 0)
+        return -1;
+    for (uint32_t i = 0; i < len; i++) {
+        JSValue item = JS_GetPropertyUint32(ctx, val, i);
+        int status = encodeValue(ctx, item, enc, depth + 1);
+        JS_FreeValue(ctx, item);
+        if (status < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int encodeObject(JSContext *ctx, JSValueConst val, encoder *enc, int depth) {
+    JSPropertyEnum *props;
+    uint32_t len;
+    int status = 0;
+    if (JS_GetOwnPropertyNames(ctx, &props, &len, val, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
+        return -1;
+    if (writeHeader(enc->buf, 0x80, 15, 0, 0xde, 0xdf, len) < 0)
+        status = -1;
+    for (uint32_t i = 0; i < len; i++) {
+        if (status == 0) {
+            JSValue key = JS_AtomToString(ctx, props[i].atom);
+            JSValue item = JS_GetProperty(ctx, val, props[i].atom);
+            if (encodeString(ctx, key, enc->buf) < 0 || encodeValue(ctx, item, enc, depth + 1) < 0)
+                status = -1;
+            JS_FreeValue(ctx, key);
+            JS_FreeValue(ctx, item);
+        }
+        JS_FreeAtom(ctx, props[i].atom);
+    }
+    js_free(ctx, props);
+    return status;
+}
+
+static void lookupBinaryCtors(JSContext *ctx, encoder *enc) {
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue uint8Array = JS_GetPropertyStr(ctx, global, "Uint8Array");
+    enc->binaryCtors[BINARY_ARRAY_BUFFER] = JS_GetPropertyStr(ctx, global, "ArrayBuffer");
+    enc->binaryCtors[BINARY_SHARED_ARRAY_BUFFER] = JS_GetPropertyStr(ctx, global, "SharedArrayBuffer");
+    // %TypedArray%, the constructor all typed arrays derive from
+    enc->binaryCtors[BINARY_TYPED_ARRAY] = JS_GetPropertyStr(ctx, uint8Array, "__proto__");
+    JS_FreeValue(ctx, uint8Array);
+    JS_FreeValue(ctx, global);
+    enc->hasCtors = 1;
+}
+
+// Returns the BINARY_ kind of val, or -1 for any other object
+static int binaryKind(JSContext *ctx, JSValueConst val, encoder *enc) {
+    if (!enc->hasCtors)
+        lookupBinaryCtors(ctx, enc);
+    for (int i = 0; i < BINARY_MAX; i++) {
+        if (!JS_IsFunction(ctx, enc->binaryCtors[i]))
+            continue;
+        int status = JS_IsInstanceOf(ctx, val, enc->binaryCtors[i]);
+        if (status != 0)
+            return status < 0 ? -2 : i;
+    }
+    return -1;
+}
+
+static int encodeBinary(JSContext *ctx, JSValueConst val, encoder *enc, int *handled) {
+    size_t len, offset = 0, elementSize;
+    uint8_t *data;
+    int kind = binaryKind(ctx, val, enc);
+    *handled = kind >= 0;
+    if (kind < -1)
+        return -1;
+    if (kind < 0)
+        return 0;
+    if (kind != BINARY_TYPED_ARRAY) {
+        data = JS_GetArrayBuffer(ctx, &len, val);
+        if (data == NULL)
+            return -1;
+    } else {
+        JSValue arrayBuffer = JS_GetTypedArrayBuffer(ctx, val, &offset, &len, &elementSize);
+        if (JS_IsException(arrayBuffer))
+            return -1;
+        size_t bufLen;
+        data = JS_GetArrayBuffer(ctx, &bufLen, arrayBuffer);
+        JS_FreeValue(ctx, arrayBuffer);
+        if (data == NULL)
+            return -1;
+    }
+    if (writeHeader(enc->buf, 0, 0, 0xc4, 0xc5, 0xc6, len) < 0 || writeBytes(enc->buf, data + offset, len) < 0)
+        return -1;
+    return 0;
+}
+
+static int encodeValue(JSContext *ctx, JSValueConst val, encoder *enc, int depth) {
+    msgpackBuffer *buf = enc->buf;
+    int handled;
+    if (depth > MSGPACK_MAX_DEPTH) {
+        JS_ThrowRangeError(ctx, "Value is nested too deeply");
+        return -1;
+    }
+    if (JS_IsUndefined(val) || JS_IsNull(val) || JS_IsFunction(ctx, val)) {
+        if (reserve(buf, 1) < 0)
+            return -1;
+        putByte(buf, 0xc0);
+        return 0;
+    }
+    if (JS_IsBool(val)) {
+        if (reserve(buf, 1) < 0)
+            return -1;
+        putByte(buf, JS_ToBool(ctx, val) ? 0xc3 : 0xc2);
+        return 0;
+    }
+    if (JS_IsNumber(val)) {
+        double d;
+        JS_ToFloat64(ctx, &d, val);
+        return encodeNumber(buf, d);
+    }
+    if (JS_IsString(val))
+        return encodeString(ctx, val, buf);
+    if (JS_IsArray(ctx, val))
+        return encodeArray(ctx, val, enc, depth);
+    if (JS_IsObject(val)) {
+        if (encodeBinary(ctx, val, enc, &handled) < 0)
+            return -1;
+        return handled ? 0 : encodeObject(ctx, val, enc, depth);
+    }
+    JS_ThrowTypeError(ctx, "Value can not be encoded");
+    return -1;
+}
+
+// On failure a JS exception is pending
+int msgpackEncode(JSContext *ctx, JSValueConst val, msgpackBuffer *buf) {
+    encoder enc = { .buf = buf };
+    int status;
+    memset(buf, 0, sizeof(*buf));
+    status = encodeValue(ctx, val, &enc, 0);
+    if (enc.hasCtors) {
+        for (int i = 0; i < BINARY_MAX; i++)
+            JS_FreeValue(ctx, enc.binaryCtors[i]);
+    }
+    if (status < 0) {
+        if (buf->outOfMemory)
+            JS_ThrowOutOfMemory(ctx);
+        msgpackBufferFree(buf);
+        return -1;
+    }
+    return 0;
+}
+
+void msgpackBufferFree(msgpackBuffer *buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->len = buf->cap = 0;
+    buf->outOfMemory = 0;
+}
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    msgpackNode *nodes;
+    size_t nodesLen;
+    size_t nodesCap;
+} decoder;
+
+static int readBigEndian(decoder *d, int bytes, uint64_t *val) {
+    if (d->len - d->pos < (size_t)bytes)
+        return -1;
+    *val = 0;
+    for (int i = 0; i < bytes; i++)
+        *val = *val << 8 | d->data[d->pos++];
+    return 0;
+}
+
+static msgpackNode *newNode(decoder *d, uint8_t type) {
+    if (d->nodesLen == d->nodesCap) {
+        size_t cap = d->nodesCap ? d->nodesCap * 2 : 16;
+        msgpackNode *nodes = realloc(d->nodes, cap * sizeof(msgpackNode));
+        if (nodes == NULL)
+            return NULL;
+        d->nodes = nodes;
+        d->nodesCap = cap;
+    }
+    msgpackNode *node = &d->nodes[d->nodesLen++];
+    memset(node, 0, sizeof(*node));
+    node->type = type;
+    return node;
+}
+
+static int decodeBytes(decoder *d, uint8_t type, uint64_t len) {
+    if (d->len - d->pos < len)
+        return -1;
+    msgpackNode *node = newNode(d, type);
+    if (node == NULL)
+        return -1;
+    node->length = (uint32_t)len;
+    node->value.offset = (uint32_t)d->pos;
+    d->pos += len;
+    return 0;
+}
+
+static int decodeValue(decoder *d, int depth);
+
+static int decodeContainer(decoder *d, uint8_t type, uint64_t count, int depth) {
+    size_t index = d->nodesLen;
+    uint64_t children = type == MSGPACK_NODE_MAP ? count * 2 : count;
+    // every child takes at least one byte
+    if (depth >= MSGPACK_MAX_DEPTH || children > d->len - d->pos || newNode(d, type) == NULL)
+        return -1;
+    d->nodes[index].length = (uint32_t)count;
+    for (uint64_t i = 0; i < children; i++) {
+        if (decodeValue(d, depth + 1) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int decodeExt(decoder *d, uint64_t len) {
+    uint64_t extType;
+    if (readBigEndian(d, 1, &extType) < 0 || decodeBytes(d, MSGPACK_NODE_EXT, len) < 0)
+        return -1;
+    d->nodes[d->nodesLen - 1].extType = (int8_t)extType;
+    return 0;
+}
+
+static int decodeScalar(decoder *d, uint8_t type, int bytes) {
+    uint64_t raw;
+    msgpackNode *node;
+    if (readBigEndian(d, bytes, &raw) < 0 || (node = newNode(d, type)) == NULL)
+        return -1;
+    if (type == MSGPACK_NODE_INT) {
+        int shift = 64 - bytes * 8;
+        node->value.i = (int64_t)(raw << shift) >> shift;
+    } else if (type == MSGPACK_NODE_FLOAT && bytes == 4) {
+        float f;
+        uint32_t bits = (uint32_t)raw;
+        memcpy(&f, &bits, sizeof(f));
+        node->value.f = f;
+    } else if (type == MSGPACK_NODE_FLOAT) {
+        memcpy(&node->value.f, &raw, sizeof(double));
+    } else {
+        node->value.u = raw;
+    }
+    return 0;
+}
+
+static int decodeValue(decoder *d, int depth) {
+    uint64_t len;
+    msgpackNode *node;
+    if (d->pos >= d->len)
+        return -1;
+    uint8_t b = d->data[d->pos++];
+    if (b <= 0x7f || b >= 0xe0) {
+        if ((node = newNode(d, MSGPACK_NODE_INT)) == NULL)
+            return -1;
+        node->value.i = (int8_t)b;
+        return 0;
+    }
+    if ((b & 0xf0) == 0x80)
+        return decodeContainer(d, MSGPACK_NODE_MAP, b & 0x0f, depth);
+    if ((b & 0xf0) == 0x90)
+        return decodeContainer(d, MSGPACK_NODE_ARRAY, b & 0x0f, depth);
+    if ((b & 0xe0) == 0xa0)
+        return decodeBytes(d, MSGPACK_NODE_STR, b & 0x1f);
+    switch (b) {
+        case 0xc0:
+            return newNode(d, MSGPACK_NODE_NIL) ? 0 : -1;
+        case 0xc2:
+        case 0xc3:
+            if ((node = newNode(d, MSGPACK_NODE_BOOL)) == NULL)
+                return -1;
+            node->value.u = b == 0xc3;
+            return 0;
+        case 0xc4: case 0xc5: case 0xc6:
+            return readBigEndian(d, 1 << (b - 0xc4), &len) < 0 ? -1 : decodeBytes(d, MSGPACK_NODE_BIN, len);
+        case 0xc7: case 0xc8: case 0xc9:
+            return readBigEndian(d, 1 << (b - 0xc7), &len) < 0 ? -1 : decodeExt(d, len);
+        case 0xca:
+            return decodeScalar(d, MSGPACK_NODE_FLOAT, 4);
+        case 0xcb:
+            return decodeScalar(d, MSGPACK_NODE_FLOAT, 8);
+        case 0xcc: case 0xcd: case 0xce: case 0xcf:
+            return decodeScalar(d, MSGPACK_NODE_UINT, 1 << (b - 0xcc));
+        case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+            return decodeScalar(d, MSGPACK_NODE_INT, 1 << (b - 0xd0));
+        case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+            return decodeExt(d, 1 << (b - 0xd4));
+        case 0xd9: case 0xda: case 0xdb:
+            return readBigEndian(d, 1 << (b - 0xd9), &len) < 0 ? -1 : decodeBytes(d, MSGPACK_NODE_STR, len);
+        case 0xdc: case 0xdd:
+            return readBigEndian(d, 2 << (b - 0xdc), &len) < 0 ? -1 : decodeContainer(d, MSGPACK_NODE_ARRAY, len, depth);
+        case 0xde: case 0xdf:
+            return readBigEndian(d, 2 << (b - 0xde), &len) < 0 ? -1 : decodeContainer(d, MSGPACK_NODE_MAP, len, depth);
+        default:
+            return -1; // 0xc1 is never used
+    }
+}
+
+// Runs on the network thread. Returns NULL unless data holds exactly one
+// well formed value, the document keeps its own copy of the bytes.
+msgpackDocument *msgpackDecode(const uint8_t *data, size_t len) {
+    decoder d = { .data = data, .len = len };
+    if (len > UINT32_MAX || decodeValue(&d, 0) < 0 || d.pos != len) {
+        free(d.nodes);
+        return NULL;
+    }
+    msgpackDocument *doc = malloc(sizeof(msgpackDocument));
+    doc->data = malloc(len);
+    memcpy(doc->data, data, len);
+    doc->len = len;
+    doc->nodes = d.nodes;
+    doc->nodesLen = d.nodesLen;
+    return doc;
+}
+
+void msgpackDocumentFree(msgpackDocument *doc) {
+    free(doc->data);
+    free(doc->nodes);
+    free(doc);
+}
+
+static JSValue nodeToJSValue(JSContext *ctx, const msgpackDocument *doc, size_t *index);
+
+static JSValue mapToJSValue(JSContext *ctx, const msgpackDocument *doc, const msgpackNode *node, size_t *index) {
+    JSValue obj = JS_NewObject(ctx);
+    for (uint32_t i = 0; i < node->length; i++) {
+        const msgpackNode *keyNode = &doc->nodes[*index];
+        JSAtom atom;
+        if (keyNode->type == MSGPACK_NODE_STR) {
+            atom = JS_NewAtomLen(ctx, (const char *)doc->data + keyNode->value.offset, keyNode->length);
+            (*index)++;
+        } else {
+            JSValue key = nodeToJSValue(ctx, doc, index);
+            atom = JS_ValueToAtom(ctx, key);
+            JS_FreeValue(ctx, key);
+        }
+        JSValue val = nodeToJSValue(ctx, doc, index);
+        if (atom == JS_ATOM_NULL) {
+            JS_FreeValue(ctx, val);
+            JS_FreeValue(ctx, obj);
+            return JS_EXCEPTION;
+        }
+        JS_DefinePropertyValue(ctx, obj, atom, val, JS_PROP_C_W_E);
+        JS_FreeAtom(ctx, atom);
+    }
+    return obj;
+}
+
+static JSValue nodeToJSValue(JSContext *ctx, const msgpackDocument *doc, size_t *index) {
+    const msgpackNode *node = &doc->nodes[(*index)++];
+    const uint8_t *bytes = doc->data + node->value.offset;
+    JSValue val;
+    switch (node->type) {
+        case MSGPACK_NODE_BOOL:
+            return JS_NewBool(ctx, node->value.u);
+        case MSGPACK_NODE_INT:
+            return JS_NewInt64(ctx, node->value.i);
+        case MSGPACK_NODE_UINT:
+            return JS_NewFloat64(ctx, (double)node->value.u);
+        case MSGPACK_NODE_FLOAT:
+            return JS_NewFloat64(ctx, node->value.f);
+        case MSGPACK_NODE_STR:
+            return JS_NewStringLen(ctx, (const char *)bytes, node->length);
+        case MSGPACK_NODE_BIN:
+            return JS_NewArrayBufferCopy(ctx, bytes, node->length);
+        case MSGPACK_NODE_EXT:
+            val = JS_NewObject(ctx);
+            JS_SetPropertyStr(ctx, val, "type", JS_NewInt32(ctx, node->extType));
+            JS_SetPropertyStr(ctx, val, "data", JS_NewArrayBufferCopy(ctx, bytes, node->length));
+            return val;
+        case MSGPACK_NODE_ARRAY:
+            val = JS_NewArray(ctx);
+            for (uint32_t i = 0; i < node->length; i++)
+                JS_DefinePropertyValueUint32(ctx, val, i, nodeToJSValue(ctx, doc, index), JS_PROP_C_W_E);
+            return val;
+        case MSGPACK_NODE_MAP:
+            return mapToJSValue(ctx, doc, node, index);
+        default:
+            return JS_NULL;
+    }
+}
+
+JSValue msgpackToJSValue(JSContext *ctx, const msgpackDocument *doc) {
+    size_t index = 0;
+    return nodeToJSValue(ctx, doc, &index);
+}
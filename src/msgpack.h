@@ -0,0 +1,57 @@
+#ifndef __MSGPACK_H
+#define __MSGPACK_H
+
+#include "js-utils.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define MSGPACK_MAX_DEPTH 64
+
+enum {
+    MSGPACK_NODE_NIL,
+    MSGPACK_NODE_BOOL,
+    MSGPACK_NODE_INT,
+    MSGPACK_NODE_UINT,
+    MSGPACK_NODE_FLOAT,
+    MSGPACK_NODE_STR,
+    MSGPACK_NODE_BIN,
+    MSGPACK_NODE_ARRAY,
+    MSGPACK_NODE_MAP,
+    MSGPACK_NODE_EXT,
+};
+
+// Decoded values are stored flat in pre-order: containers are followed by
+// their children, strings and binaries point into the message copy.
+typedef struct {
+    uint8_t type;
+    int8_t extType;
+    uint32_t length; // bytes for str/bin/ext, children for array, pairs for map
+    union {
+        int64_t i;
+        uint64_t u;
+        double f;
+        uint32_t offset;
+    } value;
+} msgpackNode;
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    msgpackNode *nodes;
+    size_t nodesLen;
+} msgpackDocument;
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+    int outOfMemory;
+} msgpackBuffer;
+
+int msgpackEncode(JSContext *ctx, JSValueConst val, msgpackBuffer *buf);
+void msgpackBufferFree(msgpackBuffer *buf);
+msgpackDocument *msgpackDecode(const uint8_t *data, size_t len);
+JSValue msgpackToJSValue(JSContext *ctx, const msgpackDocument *doc);
+void msgpackDocumentFree(msgpackDocument *doc);
+
+#endif
@@ -0,0 +1,85 @@
+#include "nack-history.h"
+#include <pthread.h>
+
+#define NACK_HISTORY_RTT_FACTOR 3
+#define NACK_HISTORY_MARGIN_MS 100
+#define NACK_HISTORY_DEFAULT_BITRATE 2000000
+#define NACK_HISTORY_DEFAULT_RTT_MS 150
+
+static pthread_mutex_t budgetLock = PTHREAD_MUTEX_INITIALIZER;
+static size_t budgetBytes = NACK_HISTORY_DEFAULT_BUDGET;
+static size_t usedBytes = 0;
+// process wide averages used when a track is created without hints
+static uint32_t observedBitrate = 0;
+static int observedRttMs = 0;
+
+void nackHistorySetBudget(size_t bytes) {
+    pthread_mutex_lock(&budgetLock);
+    budgetBytes = bytes;
+    pthread_mutex_unlock(&budgetLock);
+}
+
+size_t nackHistoryGetBudget(void) {
+    size_t bytes;
+    pthread_mutex_lock(&budgetLock);
+    bytes = budgetBytes;
+    pthread_mutex_unlock(&budgetLock);
+    return bytes;
+}
+
+size_t nackHistoryGetUsage(void) {
+    size_t bytes;
+    pthread_mutex_lock(&budgetLock);
+    bytes = usedBytes;
+    pthread_mutex_unlock(&budgetLock);
+    return bytes;
+}
+
+void nackHistoryObserve(uint32_t bitrate, int rttMs) {
+    pthread_mutex_lock(&budgetLock);
+    if (bitrate > 0)
+        observedBitrate = observedBitrate ? (observedBitrate * 7 + bitrate) / 8 : bitrate;
+    if (rttMs >= 0)
+        observedRttMs = observedRttMs ? (observedRttMs * 7 + rttMs) / 8 : rttMs;
+    pthread_mutex_unlock(&budgetLock);
+}
+
+// Enough history to cover a few round trips of retransmissions at the given
+// bitrate. Zero arguments fall back to what other tracks have observed.
+uint32_t nackHistoryAdaptiveSize(uint32_t bitrate, int rttMs, uint32_t packetSize) {
+    uint64_t packets;
+    pthread_mutex_lock(&budgetLock);
+    if (bitrate == 0)
+        bitrate = observedBitrate ? observedBitrate : NACK_HISTORY_DEFAULT_BITRATE;
+    if (rttMs <= 0)
+        rttMs = observedRttMs ? observedRttMs : NACK_HISTORY_DEFAULT_RTT_MS;
+    pthread_mutex_unlock(&budgetLock);
+    packets = (uint64_t)bitrate / 8 * (NACK_HISTORY_RTT_FACTOR * rttMs + NACK_HISTORY_MARGIN_MS)
+        / 1000 / packetSize + 1;
+    if (packets < NACK_HISTORY_MIN_PACKETS)
+        packets = NACK_HISTORY_MIN_PACKETS;
+    if (packets > NACK_HISTORY_MAX_PACKETS)
+        packets = NACK_HISTORY_MAX_PACKETS;
+    return (uint32_t)packets;
+}
+
+// Returns the number of packets granted. Explicitly sized histories are
+// always granted but still counted against the budget.
+uint32_t nackHistoryReserve(uint32_t packets, uint32_t packetSize, int withinBudget) {
+    pthread_mutex_lock(&budgetLock);
+    if (withinBudget) {
+        size_t available = budgetBytes > usedBytes ? budgetBytes - usedBytes : 0;
+        if ((size_t)packets * packetSize > available)
+            packets = available / packetSize;
+    }
+    usedBytes += (size_t)packets * packetSize;
+    pthread_mutex_unlock(&budgetLock);
+    return packets;
+}
+
+void nackHistoryRelease(uint32_t packets, uint32_t packetSize) {
+    pthread_mutex_lock(&budgetLock);
+    size_t bytes = (size_t)packets * packetSize;
+    usedBytes = usedBytes > bytes ? usedBytes - bytes : 0;
+    pthread_mutex_unlock(&budgetLock);
+}
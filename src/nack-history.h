@@ -0,0 +1,20 @@
+#ifndef __NACK_HISTORY_H
+#define __NACK_HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NACK_HISTORY_DEFAULT_PACKETS 128
+#define NACK_HISTORY_MIN_PACKETS 32
+#define NACK_HISTORY_MAX_PACKETS 8192
+#define NACK_HISTORY_DEFAULT_BUDGET (256 * 1024 * 1024)
+
+void nackHistorySetBudget(size_t bytes);
+size_t nackHistoryGetBudget(void);
+size_t nackHistoryGetUsage(void);
+void nackHistoryObserve(uint32_t bitrate, int rttMs);
+uint32_t nackHistoryAdaptiveSize(uint32_t bitrate, int rttMs, uint32_t packetSize);
+uint32_t nackHistoryReserve(uint32_t packets, uint32_t packetSize, int withinBudget);
+void nackHistoryRelease(uint32_t packets, uint32_t packetSize);
+
+#endif
@@ -0,0 +1,183 @@
+#include "net-impairment.h"
+#include "timer-wheel.h"
+#include "time-utils.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NET_IMPAIRMENT_MAX_QUEUED_BYTES (64 * 1024 * 1024)
+#define NET_IMPAIRMENT_TICK_US 1000
+
+typedef struct s_impairedMessage {
+    char *data;
+    int size;
+    size_t len;
+    uint64_t deliverAt;
+    netImpairmentDeliver deliver;
+    void *opaque;
+    struct s_impairedMessage *next;
+} impairedMessage;
+
+struct netImpairment {
+    atomic_int refs;
+    netImpairmentConfig config;
+    pthread_mutex_t lock;
+    uint64_t rng;
+    uint64_t linkFreeAt; // when the simulated link has sent what it was given
+    impairedMessage *head; // ordered by deliverAt
+    int timerArmed;
+    netImpairmentStats stats;
+};
+
+// splitmix64, so runs with the same seed make the same decisions
+static uint64_t nextRandom(netImpairment *ni) {
+    uint64_t z = (ni->rng += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double randomUnit(netImpairment *ni) {
+    return (nextRandom(ni) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void freeMessage(impairedMessage *msg) {
+    free(msg->data);
+    free(msg);
+}
+
+static void freeNetImpairment(netImpairment *ni) {
+    while (ni->head) {
+        impairedMessage *next = ni->head->next;
+        freeMessage(ni->head);
+        ni->head = next;
+    }
+    pthread_mutex_destroy(&ni->lock);
+    free(ni);
+}
+
+static void insertMessage(netImpairment *ni, impairedMessage *msg) {
+    impairedMessage **pos = &ni->head;
+    while (*pos && (*pos)->deliverAt <= msg->deliverAt)
+        pos = &(*pos)->next;
+    msg->next = *pos;
+    *pos = msg;
+}
+
+static void deliverMessages(void *opaque) {
+    netImpairment *ni = opaque;
+    impairedMessage *msg;
+    uint64_t now = monotonicTimeUs();
+    pthread_mutex_lock(&ni->lock);
+    ni->timerArmed = 0;
+    while ((msg = ni->head) != NULL && msg->deliverAt <= now) {
+        ni->head = msg->next;
+        ni->stats.queued--;
+        ni->stats.queuedBytes -= msg->len;
+        ni->stats.delivered++;
+        msg->deliver(msg->data, msg->size, msg->opaque);
+        freeMessage(msg);
+    }
+    if (ni->head) {
+        ni->timerArmed = 1;
+        timerWheelSchedule(NET_IMPAIRMENT_TICK_US, deliverMessages, ni);
+    }
+    int rearmed = ni->timerArmed;
+    pthread_mutex_unlock(&ni->lock);
+    // a pending timer holds a reference
+    if (!rearmed)
+        netImpairmentRelease(ni);
+}
+
+netImpairment *netImpairmentCreate(const netImpairmentConfig *config) {
+    netImpairment *ni = calloc(1, sizeof(netImpairment));
+    atomic_init(&ni->refs, 1);
+    ni->config = *config;
+    ni->rng = config->seed;
+    pthread_mutex_init(&ni->lock, NULL);
+    return ni;
+}
+
+void netImpairmentRetain(netImpairment *ni) {
+    atomic_fetch_add(&ni->refs, 1);
+}
+
+void netImpairmentRelease(netImpairment *ni) {
+    if (atomic_fetch_sub(&ni->refs, 1) == 1)
+        freeNetImpairment(ni);
+}
+
+void netImpairmentSubmit(netImpairment *ni, const char *message, int size, netImpairmentDeliver deliver, void *opaque) {
+    const netImpairmentConfig *config = &ni->config;
+    size_t len = size >= 0 ? (size_t)size : strlen(message) + 1;
+    uint64_t now = monotonicTimeUs();
+    pthread_mutex_lock(&ni->lock);
+    ni->stats.received++;
+    // every decision draws the same numbers, whatever the outcome
+    double loss = randomUnit(ni) * 100;
+    double reorder = randomUnit(ni) * 100;
+    double jitter = randomUnit(ni) * 2 - 1;
+    if (loss < config->lossPct) {
+        ni->stats.lost++;
+        pthread_mutex_unlock(&ni->lock);
+        return;
+    }
+    if (ni->stats.queuedBytes + len > NET_IMPAIRMENT_MAX_QUEUED_BYTES) {
+        ni->stats.overflowed++;
+        pthread_mutex_unlock(&ni->lock);
+        return;
+    }
+    uint64_t sentAt = now;
+    if (config->bandwidthKbps > 0) {
+        if (ni->linkFreeAt < now)
+            ni->linkFreeAt = now;
+        ni->linkFreeAt += len * 8000 / config->bandwidthKbps;
+        sentAt = ni->linkFreeAt;
+    }
+    int64_t delayUs = (int64_t)config->delayMs * 1000 + (int64_t)(jitter * config->jitterMs * 1000);
+    if (reorder < config->reorderPct) {
+        ni->stats.reordered++;
+        delayUs = 0;
+    }
+    impairedMessage *msg = malloc(sizeof(impairedMessage));
+    msg->data = malloc(len);
+    memcpy(msg->data, message, len);
+    msg->size = size;
+    msg->len = len;
+    msg->deliverAt = sentAt + (delayUs > 0 ? delayUs : 0);
+    msg->deliver = deliver;
+    msg->opaque = opaque;
+    insertMessage(ni, msg);
+    ni->stats.queued++;
+    ni->stats.queuedBytes += len;
+    if (!ni->timerArmed) {
+        ni->timerArmed = 1;
+        netImpairmentRetain(ni);
+        timerWheelSchedule(NET_IMPAIRMENT_TICK_US, deliverMessages, ni);
+    }
+    pthread_mutex_unlock(&ni->lock);
+}
+
+void netImpairmentCancel(netImpairment *ni, void *opaque) {
+    pthread_mutex_lock(&ni->lock);
+    impairedMessage **pos = &ni->head;
+    while (*pos) {
+        impairedMessage *msg = *pos;
+        if (msg->opaque != opaque) {
+            pos = &msg->next;
+            continue;
+        }
+        *pos = msg->next;
+        ni->stats.queued--;
+        ni->stats.queuedBytes -= msg->len;
+        freeMessage(msg);
+    }
+    pthread_mutex_unlock(&ni->lock);
+}
+
+void netImpairmentGetStats(netImpairment *ni, netImpairmentStats *stats) {
+    pthread_mutex_lock(&ni->lock);
+    *stats = ni->stats;
+    pthread_mutex_unlock(&ni->lock);
+}
@@ -0,0 +1,46 @@
+#ifndef __NET_IMPAIRMENT_H
+#define __NET_IMPAIRMENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Test only. Inbound messages of every channel and track of a peer
+// connection go through one simulated link before they are handled.
+typedef struct {
+    double lossPct;
+    double reorderPct;     // share of packets that skip the delay
+    uint32_t delayMs;
+    uint32_t jitterMs;     // uniform, +/- around delayMs
+    uint32_t bandwidthKbps; // 0 is unlimited
+    uint32_t seed;
+} netImpairmentConfig;
+
+typedef struct {
+    uint64_t received;
+    uint64_t delivered;
+    uint64_t lost;
+    uint64_t reordered;
+    uint64_t overflowed;
+    uint32_t queued;
+    uint64_t queuedBytes;
+} netImpairmentStats;
+
+typedef struct netImpairment netImpairment;
+
+// Runs on the timer thread with the link locked, size is negative for text
+// like the libdatachannel message callback
+typedef void (*netImpairmentDeliver)(const char *message, int size, void *opaque);
+
+// Starts with one reference
+netImpairment *netImpairmentCreate(const netImpairmentConfig *config);
+void netImpairmentRetain(netImpairment *ni);
+void netImpairmentRelease(netImpairment *ni);
+
+// Copies the message. Drops, delays and reordering only depend on the seed
+// and the order of the submitted messages.
+void netImpairmentSubmit(netImpairment *ni, const char *message, int size, netImpairmentDeliver deliver, void *opaque);
+// Drops what is pending for opaque, no deliver call for it runs once this returns
+void netImpairmentCancel(netImpairment *ni, void *opaque);
+void netImpairmentGetStats(netImpairment *ni, netImpairmentStats *stats);
+
+#endif
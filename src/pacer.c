@@ -0,0 +1,374 @@
+#include "pacer.h"
+#include "h264-utils.h"
+#include "rtcp-parser.h"
+#include "timer-wheel.h"
+#include "time-utils.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PACER_MAX_QUEUED_BYTES (16 * 1024 * 1024)
+#define RTP_HEADER_SIZE 12
+#define RTCP_SR_SIZE 28
+#define NTP_UNIX_EPOCH_OFFSET 2208988800.0
+
+typedef struct s_pacedPacket {
+    uint64_t enqueued;
+    size_t len;
+    int retransmission;
+    struct s_pacedPacket *next;
+    uint8_t buf[];
+} pacedPacket;
+
+struct s_pacer {
+    int trackId;
+    pacerConfig config;
+    double rate;  // bytes per microsecond
+    double burst; // bytes
+    double tokens;
+    uint64_t lastRefill;
+    pacerSentCallback onSent;
+    void *opaque;
+    pthread_mutex_t lock;
+    pacedPacket *head;
+    pacedPacket *tail;
+    // last of the retransmissions waiting at the head of the queue
+    pacedPacket *retransmitTail;
+    int timerArmed;
+    int destroyed;
+    // what the packetizer and sender reporter keep for unpaced tracks
+    uint16_t seq;
+    uint32_t timestamp;
+    uint32_t startTimestamp;
+    uint32_t recordingTimestamp;
+    uint32_t reportedTimestamp;
+    double startTime; // NTP seconds at recordingTimestamp
+    int reportRequested;
+    uint32_t packetCount;
+    uint32_t octetCount;
+    // sent packets by seq % historyPackets
+    uint32_t packetSize;
+    uint8_t *history;
+    uint16_t *historyLen;
+    int32_t *historySeq;
+    pacerStats stats;
+};
+
+typedef struct {
+    pacer *p;
+    uint32_t timestamp;
+    uint64_t now;
+    uint32_t count;
+    uint64_t bytes;
+    pacedPacket *head;
+    pacedPacket *tail;
+} pacedFrame;
+
+static void writeU16(uint8_t *p, uint16_t value) {
+    p[0] = value >> 8;
+    p[1] = value & 0xff;
+}
+
+static void writeU32(uint8_t *p, uint32_t value) {
+    writeU16(p, value >> 16);
+    writeU16(p + 2, value & 0xffff);
+}
+
+static void refillTokens(pacer *p, uint64_t now) {
+    p->tokens += (now - p->lastRefill) * p->rate;
+    if (p->tokens > p->burst)
+        p->tokens = p->burst;
+    p->lastRefill = now;
+}
+
+static void freePackets(pacedPacket *packet) {
+    while (packet != NULL) {
+        pacedPacket *next = packet->next;
+        free(packet);
+        packet = next;
+    }
+}
+
+static void freePacer(pacer *p) {
+    freePackets(p->head);
+    free(p->history);
+    free(p->historyLen);
+    free(p->historySeq);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+}
+
+static uint64_t tokenWaitUs(pacer *p) {
+    return p->tokens >= 0 ? 0 : (uint64_t)(-p->tokens / p->rate) + 1;
+}
+
+static void sendReport(pacer *p, uint32_t timestamp) {
+    uint8_t report[RTCP_SR_SIZE];
+    double seconds = p->startTime
+        + (double)(uint32_t)(timestamp - p->recordingTimestamp) / p->config.clockRate;
+    double whole = floor(seconds);
+    report[0] = 0x80;
+    report[1] = RTCP_TYPE_SR;
+    writeU16(report + 2, RTCP_SR_SIZE / 4 - 1);
+    writeU32(report + 4, p->config.ssrc);
+    writeU32(report + 8, (uint32_t)whole);
+    writeU32(report + 12, (uint32_t)((seconds - whole) * 4294967296.0));
+    writeU32(report + 16, timestamp);
+    writeU32(report + 20, p->packetCount);
+    writeU32(report + 24, p->octetCount);
+    if (rtcSendMessage(p->trackId, (const char *)report, sizeof(report)) < 0)
+        return;
+    p->reportRequested = 0;
+    p->reportedTimestamp = timestamp;
+}
+
+static void sendPacket(pacer *p, const uint8_t *buf, size_t len) {
+    if (rtcSendMessage(p->trackId, (const char *)buf, len) < 0)
+        return;
+    p->stats.pacedPackets++;
+    p->packetCount++;
+    p->octetCount += len - RTP_HEADER_SIZE;
+    if (p->config.historyPackets > 0) {
+        uint16_t seq = rtcpReadU16(buf + 2);
+        uint32_t slot = seq % p->config.historyPackets;
+        memcpy(p->history + (size_t)slot * p->packetSize, buf, len);
+        p->historyLen[slot] = len;
+        p->historySeq[slot] = seq;
+    }
+    p->onSent(buf, len, p->opaque);
+    if (p->reportRequested)
+        sendReport(p, rtcpReadU32(buf + 4));
+}
+
+static void releaseTimer(void *opaque);
+
+// A packet is released as soon as the bucket is not in debt, so packets
+// larger than the burst size still go out and the debt delays the next ones.
+static void releasePackets(pacer *p, uint64_t now) {
+    pacedPacket *packet;
+    refillTokens(p, now);
+    while ((packet = p->head) != NULL && p->tokens >= 0) {
+        p->head = packet->next;
+        if (p->head == NULL)
+            p->tail = NULL;
+        if (p->retransmitTail == packet)
+            p->retransmitTail = NULL;
+        p->tokens -= packet->len;
+        p->stats.queuedPackets--;
+        p->stats.queuedBytes -= packet->len;
+        uint32_t delayMs = (uint32_t)((now - packet->enqueued) / 1000);
+        if (delayMs > p->stats.maxDelayMs)
+            p->stats.maxDelayMs = delayMs;
+        if (packet->retransmission) {
+            if (rtcSendMessage(p->trackId, (const char *)packet->buf, packet->len) >= 0)
+                p->stats.retransmittedPackets++;
+        } else {
+            sendPacket(p, packet->buf, packet->len);
+        }
+        free(packet);
+    }
+    if (p->head != NULL && !p->timerArmed) {
+        p->timerArmed = 1;
+        timerWheelSchedule(tokenWaitUs(p), releaseTimer, p);
+    }
+}
+
+static void releaseTimer(void *opaque) {
+    pacer *p = opaque;
+    pthread_mutex_lock(&p->lock);
+    p->timerArmed = 0;
+    if (p->destroyed) {
+        pthread_mutex_unlock(&p->lock);
+        freePacer(p);
+        return;
+    }
+    releasePackets(p, monotonicTimeUs());
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void appendPayload(const uint8_t *prefix, size_t prefixLen,
+    const uint8_t *payload, size_t len, void *opaque)
+{
+    pacedFrame *frame = opaque;
+    pacer *p = frame->p;
+    size_t size = RTP_HEADER_SIZE + prefixLen + len;
+    pacedPacket *packet = malloc(sizeof(pacedPacket) + size);
+    packet->buf[0] = 0x80;
+    packet->buf[1] = p->config.payloadType & 0x7f;
+    writeU16(packet->buf + 2, p->seq++);
+    writeU32(packet->buf + 4, frame->timestamp);
+    writeU32(packet->buf + 8, p->config.ssrc);
+    if (prefixLen > 0)
+        memcpy(packet->buf + RTP_HEADER_SIZE, prefix, prefixLen);
+    memcpy(packet->buf + RTP_HEADER_SIZE + prefixLen, payload, len);
+    packet->len = size;
+    packet->retransmission = 0;
+    packet->enqueued = frame->now;
+    packet->next = NULL;
+    if (frame->tail == NULL)
+        frame->head = packet;
+    else
+        frame->tail->next = packet;
+    frame->tail = packet;
+    frame->count++;
+    frame->bytes += size;
+}
+
+pacer *pacerCreate(int trackId, const pacerConfig *config, pacerSentCallback onSent, void *opaque) {
+    pacer *p = calloc(1, sizeof(pacer));
+    p->trackId = trackId;
+    p->config = *config;
+    p->rate = config->rate / 8.0 / 1000000.0;
+    p->burst = config->burst;
+    p->tokens = config->burst;
+    p->lastRefill = monotonicTimeUs();
+    p->onSent = onSent;
+    p->opaque = opaque;
+    p->timestamp = p->startTimestamp = p->recordingTimestamp = config->timestamp;
+    p->packetSize = config->maxFragmentSize + RTP_HEADER_SIZE;
+    if (config->historyPackets > 0) {
+        p->history = malloc((size_t)config->historyPackets * p->packetSize);
+        p->historyLen = calloc(config->historyPackets, sizeof(uint16_t));
+        p->historySeq = malloc(config->historyPackets * sizeof(int32_t));
+        for (uint32_t i = 0; i < config->historyPackets; i++)
+            p->historySeq[i] = -1;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    return p;
+}
+
+// The frame is packetized and stamped under the pacer lock, so the
+// timestamp can't change between the two. Its packets go straight out while
+// the bucket has tokens and wait on the shared timer thread otherwise.
+int pacerSend(pacer *p, const uint8_t *frame, size_t len, const uint32_t *timestamp) {
+    pthread_mutex_lock(&p->lock);
+    if (p->stats.queuedBytes + len > PACER_MAX_QUEUED_BYTES) {
+        p->stats.droppedFrames++;
+        pthread_mutex_unlock(&p->lock);
+        return -1;
+    }
+    if (timestamp != NULL)
+        p->timestamp = *timestamp;
+    pacedFrame packets = { .p = p, .timestamp = p->timestamp, .now = monotonicTimeUs() };
+    h264ForEachRtpPayload(frame, len, p->config.separator, p->config.maxFragmentSize, appendPayload, &packets);
+    if (packets.tail != NULL) {
+        packets.tail->buf[1] |= 0x80; // marker on the last packet of the frame
+        if (p->tail == NULL)
+            p->head = packets.head;
+        else
+            p->tail->next = packets.head;
+        p->tail = packets.tail;
+        p->stats.queuedPackets += packets.count;
+        p->stats.queuedBytes += packets.bytes;
+    }
+    releasePackets(p, packets.now);
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+// Retransmissions go ahead of the queued packets, in the order they were
+// requested, and are released under the bucket like the rest. A NACK for a
+// whole frame can't turn into a burst.
+int pacerRetransmit(pacer *p, uint16_t seq) {
+    pthread_mutex_lock(&p->lock);
+    uint32_t slot = p->config.historyPackets > 0 ? seq % p->config.historyPackets : 0;
+    if (p->config.historyPackets == 0 || p->historySeq[slot] != seq) {
+        pthread_mutex_unlock(&p->lock);
+        return -1;
+    }
+    size_t len = p->historyLen[slot];
+    pacedPacket *packet = malloc(sizeof(pacedPacket) + len);
+    memcpy(packet->buf, p->history + (size_t)slot * p->packetSize, len);
+    packet->len = len;
+    packet->retransmission = 1;
+    packet->enqueued = monotonicTimeUs();
+    if (p->retransmitTail) {
+        packet->next = p->retransmitTail->next;
+        p->retransmitTail->next = packet;
+    } else {
+        packet->next = p->head;
+        p->head = packet;
+    }
+    if (packet->next == NULL)
+        p->tail = packet;
+    p->retransmitTail = packet;
+    p->stats.queuedPackets++;
+    p->stats.queuedBytes += len;
+    releasePackets(p, packet->enqueued);
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+uint32_t pacerGetTimestamp(pacer *p) {
+    pthread_mutex_lock(&p->lock);
+    uint32_t timestamp = p->timestamp;
+    pthread_mutex_unlock(&p->lock);
+    return timestamp;
+}
+
+void pacerSetTimestamp(pacer *p, uint32_t timestamp) {
+    pthread_mutex_lock(&p->lock);
+    p->timestamp = timestamp;
+    pthread_mutex_unlock(&p->lock);
+}
+
+uint32_t pacerGetStartTimestamp(pacer *p) {
+    pthread_mutex_lock(&p->lock);
+    uint32_t timestamp = p->startTimestamp;
+    pthread_mutex_unlock(&p->lock);
+    return timestamp;
+}
+
+uint32_t pacerGetReportedTimestamp(pacer *p) {
+    pthread_mutex_lock(&p->lock);
+    uint32_t timestamp = p->reportedTimestamp;
+    pthread_mutex_unlock(&p->lock);
+    return timestamp;
+}
+
+void pacerSetStartTime(pacer *p, double seconds, int since1970, uint32_t timestamp) {
+    pthread_mutex_lock(&p->lock);
+    p->startTime = seconds + (since1970 ? NTP_UNIX_EPOCH_OFFSET : 0);
+    p->timestamp = p->startTimestamp = p->recordingTimestamp = timestamp;
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Reports map the current timestamp to the start time, as libdatachannel's
+// sender reporter does
+void pacerStartRecording(pacer *p) {
+    pthread_mutex_lock(&p->lock);
+    p->recordingTimestamp = p->reportedTimestamp = p->timestamp;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pacerRequestReport(pacer *p) {
+    pthread_mutex_lock(&p->lock);
+    p->reportRequested = 1;
+    pthread_mutex_unlock(&p->lock);
+}
+
+uint32_t pacerSecondsToTimestamp(pacer *p, double seconds) {
+    return (uint32_t)round(seconds * p->config.clockRate);
+}
+
+double pacerTimestampToSeconds(pacer *p, uint32_t timestamp) {
+    return (double)timestamp / p->config.clockRate;
+}
+
+void pacerGetStats(pacer *p, pacerStats *stats) {
+    pthread_mutex_lock(&p->lock);
+    *stats = p->stats;
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Pending packets are dropped. If a release is scheduled the timer thread
+// frees the pacer, otherwise it is freed right away.
+void pacerDestroy(pacer *p) {
+    pthread_mutex_lock(&p->lock);
+    p->destroyed = 1;
+    int armed = p->timerArmed;
+    pthread_mutex_unlock(&p->lock);
+    if (!armed)
+        freePacer(p);
+}
@@ -0,0 +1,57 @@
+#ifndef __PACER_H
+#define __PACER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <rtc/rtc.h>
+
+typedef struct s_pacer pacer;
+
+// Called for every RTP packet that left the pacer, with the pacer locked
+typedef void (*pacerSentCallback)(const uint8_t *packet, size_t len, void *opaque);
+
+// A paced track has no libdatachannel packetizer. The pacer builds the H264
+// RTP packets itself so it can release them one by one, and takes over the
+// timestamp, sender report and NACK history of the packetizer chain.
+typedef struct {
+    uint32_t rate;  // bps
+    uint32_t burst; // bytes
+    uint32_t ssrc;
+    uint8_t payloadType;
+    uint32_t clockRate;
+    uint32_t timestamp;
+    rtcNalUnitSeparator separator;
+    uint16_t maxFragmentSize;
+    uint32_t historyPackets; // 0 disables retransmissions
+} pacerConfig;
+
+typedef struct {
+    uint32_t queuedPackets;
+    uint64_t queuedBytes;
+    uint64_t pacedPackets;
+    uint64_t droppedFrames;
+    uint64_t retransmittedPackets;
+    uint32_t maxDelayMs;
+} pacerStats;
+
+pacer *pacerCreate(int trackId, const pacerConfig *config, pacerSentCallback onSent, void *opaque);
+// A NULL timestamp stamps the frame with the current one, otherwise it
+// becomes the current timestamp
+int pacerSend(pacer *p, const uint8_t *frame, size_t len, const uint32_t *timestamp);
+// Queues a packet from the history ahead of the paced ones, -1 when it is
+// no longer there
+int pacerRetransmit(pacer *p, uint16_t seq);
+uint32_t pacerGetTimestamp(pacer *p);
+void pacerSetTimestamp(pacer *p, uint32_t timestamp);
+uint32_t pacerGetStartTimestamp(pacer *p);
+uint32_t pacerGetReportedTimestamp(pacer *p);
+void pacerSetStartTime(pacer *p, double seconds, int since1970, uint32_t timestamp);
+void pacerStartRecording(pacer *p);
+// A sender report follows the next packet
+void pacerRequestReport(pacer *p);
+uint32_t pacerSecondsToTimestamp(pacer *p, double seconds);
+double pacerTimestampToSeconds(pacer *p, uint32_t timestamp);
+void pacerGetStats(pacer *p, pacerStats *stats);
+void pacerDestroy(pacer *p);
+
+#endif
@@ -0,0 +1,83 @@
+#include "rtcp-parser.h"
+#include <time.h>
+
+#define NTP_UNIX_EPOCH_OFFSET 2208988800u
+
+int rtcpIsControlPacket(const uint8_t *buf, int len) {
+    // RFC 5761: RTP payload types 64-95 are never used so 192-223 is RTCP
+    return len >= 4 && (buf[0] >> 6) == 2 && buf[1] >= 192 && buf[1] <= 223;
+}
+
+// Walks a compound packet. Returns 0 once there is nothing left to read.
+int rtcpNextPacket(const uint8_t **buf, int *len, RtcpPacket *packet) {
+    const uint8_t *p = *buf;
+    int packetLen;
+    if (*len < 4 || (p[0] >> 6) != 2)
+        return 0;
+    packetLen = (rtcpReadU16(p + 2) + 1) * 4;
+    if (packetLen > *len)
+        return 0;
+    packet->type = p[1];
+    packet->count = p[0] & 0x1f;
+    packet->body = p + 4;
+    packet->bodyLen = packetLen - 4;
+    *buf += packetLen;
+    *len -= packetLen;
+    return 1;
+}
+
+int rtcpGetReportBlock(const RtcpPacket *packet, int index, RtcpReportBlock *block) {
+    int offset;
+    const uint8_t *p;
+    if (packet->type == RTCP_TYPE_SR)
+        offset = 24; // sender ssrc + sender info
+    else if (packet->type == RTCP_TYPE_RR)
+        offset = 4; // sender ssrc
+    else
+        return -1;
+    offset += index * RTCP_REPORT_BLOCK_SIZE;
+    if (index >= packet->count || offset + RTCP_REPORT_BLOCK_SIZE > packet->bodyLen)
+        return -1;
+    p = packet->body + offset;
+    block->ssrc = rtcpReadU32(p);
+    block->fractionLost = p[4];
+    block->packetsLost = (int32_t)(rtcpReadU32(p + 4) << 8) >> 8;
+    block->highestSeq = rtcpReadU32(p + 8);
+    block->jitter = rtcpReadU32(p + 12);
+    block->lsr = rtcpReadU32(p + 16);
+    block->dlsr = rtcpReadU32(p + 20);
+    return 0;
+}
+
+// draft-alvestrand-rmcat-remb application layer feedback
+int rtcpGetRembBitrate(const RtcpPacket *packet, uint64_t *bitrate) {
+    const uint8_t *p = packet->body;
+    if (packet->type != RTCP_TYPE_PSFB || packet->count != RTCP_PSFB_FMT_AFB || packet->bodyLen < 16)
+        return -1;
+    if (p[8] != 'R' || p[9] != 'E' || p[10] != 'M' || p[11] != 'B')
+        return -1;
+    uint8_t exponent = p[13] >> 2;
+    uint32_t mantissa = (uint32_t)(p[13] & 0x03) << 16 | rtcpReadU16(p + 14);
+    *bitrate = (uint64_t)mantissa << exponent;
+    return 0;
+}
+
+uint32_t rtcpNtpMiddleNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint32_t seconds = (uint32_t)ts.tv_sec + NTP_UNIX_EPOCH_OFFSET;
+    uint32_t fraction = (uint32_t)(((uint64_t)ts.tv_nsec << 16) / 1000000000u);
+    return seconds << 16 | fraction;
+}
+
+// RFC 3550 section 6.4.1. The sender report NTP time comes from the track
+// start time, so this is only meaningful when it is synced to the wall clock.
+int rtcpRoundTripMs(const RtcpReportBlock *block, uint32_t arrivalNtpMiddle) {
+    uint32_t rtt;
+    if (block->lsr == 0)
+        return -1;
+    rtt = arrivalNtpMiddle - block->lsr - block->dlsr;
+    if (rtt > 10 * 65536) // more than 10s, clocks are not in sync
+        return -1;
+    return (int)(((uint64_t)rtt * 1000) >> 16);
+}
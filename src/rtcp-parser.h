@@ -0,0 +1,57 @@
+#ifndef __RTCP_PARSER_H
+#define __RTCP_PARSER_H
+
+#include <stdint.h>
+
+enum {
+    RTCP_TYPE_SR = 200,
+    RTCP_TYPE_RR = 201,
+    RTCP_TYPE_RTPFB = 205,
+    RTCP_TYPE_PSFB = 206,
+};
+
+enum {
+    RTCP_RTPFB_FMT_NACK = 1,
+};
+
+enum {
+    RTCP_PSFB_FMT_PLI = 1,
+    RTCP_PSFB_FMT_FIR = 4,
+    RTCP_PSFB_FMT_AFB = 15,
+};
+
+#define RTCP_REPORT_BLOCK_SIZE 24
+
+typedef struct {
+    uint8_t type;
+    uint8_t count; // report count or feedback message type
+    const uint8_t *body; // everything after the 4 byte header
+    int bodyLen;
+} RtcpPacket;
+
+typedef struct {
+    uint32_t ssrc;
+    uint8_t fractionLost;
+    int32_t packetsLost;
+    uint32_t highestSeq;
+    uint32_t jitter;
+    uint32_t lsr;
+    uint32_t dlsr;
+} RtcpReportBlock;
+
+static inline uint16_t rtcpReadU16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline uint32_t rtcpReadU32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+int rtcpIsControlPacket(const uint8_t *buf, int len);
+int rtcpNextPacket(const uint8_t **buf, int *len, RtcpPacket *packet);
+int rtcpGetReportBlock(const RtcpPacket *packet, int index, RtcpReportBlock *block);
+int rtcpGetRembBitrate(const RtcpPacket *packet, uint64_t *bitrate);
+uint32_t rtcpNtpMiddleNow(void);
+int rtcpRoundTripMs(const RtcpReportBlock *block, uint32_t arrivalNtpMiddle);
+
+#endif
@@ -0,0 +1,184 @@
+#include "rtp-forwarder.h"
+#include "rtcp-parser.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rtc/rtc.h>
+
+#define RTP_MIN_HEADER_SIZE 12
+#define RTCP_PLI_SIZE 12
+
+typedef struct {
+    rtpForwardOutput *out;
+    int started;
+    uint16_t seqOffset;
+    uint32_t timestampOffset;
+} rtpForwardLink;
+
+struct s_rtpForwarder {
+    int trackId;
+    uint32_t ssrc;
+    pthread_mutex_t lock;
+    // SSRC of the remote sender, from the last packet
+    uint32_t mediaSsrc;
+    int hasMediaSsrc;
+    int keyframePending;
+    rtpForwardLink *links;
+    int linksLen;
+    int linksCap;
+    uint8_t *scratch;
+    size_t scratchLen;
+};
+
+static void writeU16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void writeU32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+void rtpForwardOutputInit(rtpForwardOutput *out, int trackId, uint32_t ssrc) {
+    out->trackId = trackId;
+    out->ssrc = ssrc;
+    out->source = NULL;
+    // the NACK accounting expects numbering from 0, like the packetizer's
+    out->nextSeq = 0;
+    out->nextTimestamp = rand();
+    atomic_init(&out->forwardedPackets, 0);
+    atomic_init(&out->failedPackets, 0);
+}
+
+rtpForwarder *rtpForwarderCreate(int trackId, uint32_t ssrc) {
+    rtpForwarder *fw = calloc(1, sizeof(rtpForwarder));
+    fw->trackId = trackId;
+    fw->ssrc = ssrc;
+    pthread_mutex_init(&fw->lock, NULL);
+    return fw;
+}
+
+// Called with the lock held
+static void sendPli(rtpForwarder *fw) {
+    uint8_t pli[RTCP_PLI_SIZE];
+    pli[0] = 0x80 | RTCP_PSFB_FMT_PLI;
+    pli[1] = RTCP_TYPE_PSFB;
+    writeU16(pli + 2, RTCP_PLI_SIZE / 4 - 1);
+    writeU32(pli + 4, fw->ssrc);
+    writeU32(pli + 8, fw->mediaSsrc);
+    fw->keyframePending = 0;
+    rtcSendMessage(fw->trackId, (const char *)pli, sizeof(pli));
+}
+
+void rtpForwarderRequestKeyframe(rtpForwarder *fw) {
+    pthread_mutex_lock(&fw->lock);
+    if (fw->hasMediaSsrc)
+        sendPli(fw);
+    else
+        fw->keyframePending = 1;
+    pthread_mutex_unlock(&fw->lock);
+}
+
+void rtpForwarderAdd(rtpForwarder *fw, rtpForwardOutput *out) {
+    if (out->source == fw)
+        return;
+    if (out->source)
+        rtpForwarderRemove(out->source, out);
+    pthread_mutex_lock(&fw->lock);
+    if (fw->linksLen == fw->linksCap) {
+        fw->linksCap = fw->linksCap ? fw->linksCap * 2 : 4;
+        fw->links = realloc(fw->links, fw->linksCap * sizeof(rtpForwardLink));
+    }
+    fw->links[fw->linksLen++] = (rtpForwardLink) { .out = out };
+    out->source = fw;
+    pthread_mutex_unlock(&fw->lock);
+    rtpForwarderRequestKeyframe(fw);
+}
+
+void rtpForwarderRemove(rtpForwarder *fw, rtpForwardOutput *out) {
+    pthread_mutex_lock(&fw->lock);
+    for (int i = 0; i < fw->linksLen; i++) {
+        if (fw->links[i].out == out) {
+            fw->links[i] = fw->links[--fw->linksLen];
+            out->source = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&fw->lock);
+}
+
+void rtpForwarderClear(rtpForwarder *fw) {
+    pthread_mutex_lock(&fw->lock);
+    for (int i = 0; i < fw->linksLen; i++)
+        fw->links[i].out->source = NULL;
+    fw->linksLen = 0;
+    pthread_mutex_unlock(&fw->lock);
+}
+
+int rtpForwarderCount(rtpForwarder *fw) {
+    pthread_mutex_lock(&fw->lock);
+    int count = fw->linksLen;
+    pthread_mutex_unlock(&fw->lock);
+    return count;
+}
+
+// Each output keeps its own SSRC. Sequence numbers and timestamps are
+// shifted by a per link offset taken on the first packet, so gaps and
+// reordering from the source are kept.
+static void forwardPacket(rtpForwarder *fw, rtpForwardLink *link, uint16_t seq, uint32_t timestamp, size_t len) {
+    rtpForwardOutput *out = link->out;
+    if (!link->started) {
+        link->started = 1;
+        link->seqOffset = out->nextSeq - seq;
+        link->timestampOffset = out->nextTimestamp - timestamp;
+    }
+    uint16_t outSeq = seq + link->seqOffset;
+    uint32_t outTimestamp = timestamp + link->timestampOffset;
+    writeU16(fw->scratch + 2, outSeq);
+    writeU32(fw->scratch + 4, outTimestamp);
+    writeU32(fw->scratch + 8, out->ssrc);
+    if (rtcSendMessage(out->trackId, (const char *)fw->scratch, len) < 0) {
+        atomic_fetch_add(&out->failedPackets, 1);
+        return;
+    }
+    atomic_fetch_add(&out->forwardedPackets, 1);
+    if ((int16_t)(outSeq - out->nextSeq) >= 0)
+        out->nextSeq = outSeq + 1;
+    if ((int32_t)(outTimestamp - out->nextTimestamp) >= 0)
+        out->nextTimestamp = outTimestamp + 1;
+}
+
+int rtpForwarderPush(rtpForwarder *fw, const uint8_t *buf, size_t len) {
+    if (len < RTP_MIN_HEADER_SIZE)
+        return 0;
+    uint16_t seq = rtcpReadU16(buf + 2);
+    uint32_t timestamp = rtcpReadU32(buf + 4);
+    pthread_mutex_lock(&fw->lock);
+    fw->mediaSsrc = rtcpReadU32(buf + 8);
+    fw->hasMediaSsrc = 1;
+    if (fw->keyframePending)
+        sendPli(fw);
+    int count = fw->linksLen;
+    if (count > 0 && len > fw->scratchLen) {
+        fw->scratch = realloc(fw->scratch, len);
+        fw->scratchLen = len;
+    }
+    for (int i = 0; i < count; i++) {
+        // the header is rewritten for each output, the payload is shared
+        memcpy(fw->scratch, buf, i == 0 ? len : RTP_MIN_HEADER_SIZE);
+        forwardPacket(fw, &fw->links[i], seq, timestamp, len);
+    }
+    pthread_mutex_unlock(&fw->lock);
+    return count;
+}
+
+void rtpForwarderDestroy(rtpForwarder *fw) {
+    rtpForwarderClear(fw);
+    pthread_mutex_destroy(&fw->lock);
+    free(fw->links);
+    free(fw->scratch);
+    free(fw);
+}
@@ -0,0 +1,42 @@
+#ifndef __RTP_FORWARDER_H
+#define __RTP_FORWARDER_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct s_rtpForwarder rtpForwarder;
+
+// The sending side of a forwarded stream, embedded in the output track.
+// Numbering continues when the output is moved to another source.
+typedef struct {
+    int trackId;
+    uint32_t ssrc;
+    rtpForwarder *source; // JS thread only
+    // written under the lock of the feeding forwarder
+    uint16_t nextSeq;
+    uint32_t nextTimestamp;
+    atomic_uint forwardedPackets;
+    atomic_uint failedPackets;
+} rtpForwardOutput;
+
+void rtpForwardOutputInit(rtpForwardOutput *out, int trackId, uint32_t ssrc);
+
+// Only the push runs off the JS thread. trackId is the source track, the
+// keyframe requests for the remote sender go out on it with ssrc as sender.
+rtpForwarder *rtpForwarderCreate(int trackId, uint32_t ssrc);
+// Moves out from its current source, if any, and asks the source for a
+// keyframe so the output can start decoding
+void rtpForwarderAdd(rtpForwarder *fw, rtpForwardOutput *out);
+void rtpForwarderRemove(rtpForwarder *fw, rtpForwardOutput *out);
+void rtpForwarderClear(rtpForwarder *fw);
+int rtpForwarderCount(rtpForwarder *fw);
+// Sends a rewritten copy of an RTP packet to every output, returns how many
+// outputs the packet was sent to
+int rtpForwarderPush(rtpForwarder *fw, const uint8_t *buf, size_t len);
+// Sends a PLI to the remote sender, or with the first packet when the
+// sender's SSRC is not known yet
+void rtpForwarderRequestKeyframe(rtpForwarder *fw);
+void rtpForwarderDestroy(rtpForwarder *fw);
+
+#endif
@@ -0,0 +1,68 @@
+#include "task-queue.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct s_task {
+    taskCallback callback;
+    void *opaque;
+    struct s_task *next;
+} task;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int started;
+    task *head;
+    task *tail;
+} taskQueue;
+
+static taskQueue queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *taskQueueThread(void *arg) {
+    traceSetThreadName("task-queue");
+    pthread_mutex_lock(&queue.lock);
+    while (1) {
+        while (queue.head == NULL)
+            pthread_cond_wait(&queue.cond, &queue.lock);
+        task *pending = queue.head;
+        queue.head = queue.tail = NULL;
+        pthread_mutex_unlock(&queue.lock);
+        while (pending != NULL) {
+            task *next = pending->next;
+            pending->callback(pending->opaque);
+            free(pending);
+            pending = next;
+        }
+        pthread_mutex_lock(&queue.lock);
+    }
+    return NULL;
+}
+
+void taskQueuePost(taskCallback callback, void *opaque) {
+    task *t = malloc(sizeof(task));
+    t->callback = callback;
+    t->opaque = opaque;
+    t->next = NULL;
+    pthread_mutex_lock(&queue.lock);
+    if (!queue.started) {
+        if (pthread_create(&queue.thread, NULL, taskQueueThread, NULL) != 0) {
+            perror("error creating task queue thread");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(queue.thread);
+        queue.started = 1;
+    }
+    if (queue.tail)
+        queue.tail->next = t;
+    else
+        queue.head = t;
+    queue.tail = t;
+    pthread_cond_signal(&queue.cond);
+    pthread_mutex_unlock(&queue.lock);
+}
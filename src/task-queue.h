@@ -0,0 +1,10 @@
+#ifndef __TASK_QUEUE_H
+#define __TASK_QUEUE_H
+
+typedef void (*taskCallback)(void *opaque);
+
+// Runs callback on the shared worker thread. Tasks run one at a time in the
+// order they were posted. Safe to call from any thread.
+void taskQueuePost(taskCallback callback, void *opaque);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __TIME_UTILS_H
+#define __TIME_UTILS_H
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t monotonicTimeUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include "timer-wheel.h"
+#include "time-utils.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TIMER_WHEEL_SLOTS 256
+#define TIMER_WHEEL_TICK_US 1000
+
+typedef struct s_timerEntry {
+    uint64_t deadline;
+    timerCallback callback;
+    void *opaque;
+    struct s_timerEntry *next;
+} timerEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int started;
+    size_t count;
+    uint64_t currentTick;
+    timerEntry *slots[TIMER_WHEEL_SLOTS];
+} timerWheel;
+
+static timerWheel wheel = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static timerEntry *collectExpired(uint64_t now) {
+    timerEntry *expired = NULL;
+    uint64_t targetTick = now / TIMER_WHEEL_TICK_US;
+    uint64_t firstTick = wheel.currentTick;
+    // after a long stall every slot is visited once
+    if (targetTick - firstTick >= TIMER_WHEEL_SLOTS)
+        firstTick = targetTick - TIMER_WHEEL_SLOTS + 1;
+    for (uint64_t tick = firstTick; tick <= targetTick; tick++) {
+        timerEntry **link = &wheel.slots[tick % TIMER_WHEEL_SLOTS];
+        while (*link != NULL) {
+            timerEntry *entry = *link;
+            if (entry->deadline > now) {
+                link = &entry->next;
+                continue;
+            }
+            *link = entry->next;
+            entry->next = expired;
+            expired = entry;
+            wheel.count--;
+        }
+    }
+    wheel.currentTick = targetTick + 1;
+    return expired;
+}
+
+static void *timerWheelThread(void *arg) {
+    traceSetThreadName("timer-wheel");
+    pthread_mutex_lock(&wheel.lock);
+    while (1) {
+        while (wheel.count == 0)
+            pthread_cond_wait(&wheel.cond, &wheel.lock);
+        timerEntry *expired = collectExpired(monotonicTimeUs());
+        pthread_mutex_unlock(&wheel.lock);
+        while (expired != NULL) {
+            timerEntry *next = expired->next;
+            expired->callback(expired->opaque);
+            free(expired);
+            expired = next;
+        }
+        pthread_mutex_lock(&wheel.lock);
+        if (wheel.count > 0) {
+            uint64_t next = wheel.currentTick * TIMER_WHEEL_TICK_US;
+            struct timespec ts = { .tv_sec = next / 1000000, .tv_nsec = (next % 1000000) * 1000 };
+            pthread_cond_timedwait(&wheel.cond, &wheel.lock, &ts);
+        }
+    }
+    return NULL;
+}
+
+static void startTimerWheel() {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wheel.cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&wheel.thread, NULL, timerWheelThread, NULL) != 0) {
+        perror("error creating timer wheel thread");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(wheel.thread);
+    wheel.started = 1;
+}
+
+void timerWheelSchedule(uint64_t delayUs, timerCallback callback, void *opaque) {
+    timerEntry *entry = malloc(sizeof(timerEntry));
+    uint64_t now = monotonicTimeUs();
+    entry->deadline = now + delayUs;
+    entry->callback = callback;
+    entry->opaque = opaque;
+    pthread_mutex_lock(&wheel.lock);
+    if (!wheel.started)
+        startTimerWheel();
+    if (wheel.count == 0)
+        wheel.currentTick = now / TIMER_WHEEL_TICK_US;
+    uint64_t tick = (entry->deadline + TIMER_WHEEL_TICK_US - 1) / TIMER_WHEEL_TICK_US;
+    if (tick < wheel.currentTick)
+        tick = wheel.currentTick;
+    entry->next = wheel.slots[tick % TIMER_WHEEL_SLOTS];
+    wheel.slots[tick % TIMER_WHEEL_SLOTS] = entry;
+    wheel.count++;
+    pthread_cond_signal(&wheel.cond);
+    pthread_mutex_unlock(&wheel.lock);
+}
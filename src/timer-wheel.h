@@ -0,0 +1,12 @@
+#ifndef __TIMER_WHEEL_H
+#define __TIMER_WHEEL_H
+
+#include <stdint.h>
+
+typedef void (*timerCallback)(void *opaque);
+
+// Runs callback on the shared timer thread once delayUs have elapsed, with a
+// resolution of one wheel tick. Safe to call from any thread.
+void timerWheelSchedule(uint64_t delayUs, timerCallback callback, void *opaque);
+
+#endif
@@ -0,0 +1,260 @@
+#include "trace.h"
+#include "time-utils.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+typedef struct {
+    const char *name;
+    const char *argName;
+    int64_t arg;
+    uint64_t ts;
+    uint64_t dur;
+    uint64_t id;
+    char phase;
+} traceEvent;
+
+// Written only by its thread; the reader takes the first count entries
+typedef struct s_traceBuffer {
+    int tid;
+    const char *threadName;
+    uint32_t generation;
+    size_t capacity;
+    atomic_size_t count;
+    atomic_size_t dropped;
+    traceEvent *events;
+    // its thread exited, the buffer is kept until its events are written
+    int retired;
+    struct s_traceBuffer *next;
+} traceBuffer;
+
+static atomic_int active;
+static atomic_uint generation;
+static uint64_t sessionStart;
+static size_t bufferEvents = TRACE_DEFAULT_BUFFER_EVENTS;
+static char *outputPath;
+
+static pthread_mutex_t buffersLock = PTHREAD_MUTEX_INITIALIZER;
+static traceBuffer *buffers;
+static pthread_once_t bufferKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t bufferKey;
+
+static _Thread_local traceBuffer *localBuffer;
+static _Thread_local const char *localThreadName;
+
+static int isActive(void) {
+    return atomic_load_explicit(&active, memory_order_relaxed);
+}
+
+// Runs when a thread that traced exits
+static void retireBuffer(void *arg) {
+    traceBuffer *buf = arg;
+    pthread_mutex_lock(&buffersLock);
+    buf->retired = 1;
+    pthread_mutex_unlock(&buffersLock);
+    localBuffer = NULL;
+}
+
+static void createBufferKey(void) {
+    pthread_key_create(&bufferKey, retireBuffer);
+}
+
+// Called with buffersLock held. A retired buffer whose events belong to an
+// older session has nothing left to write and is handed to the new thread.
+static traceBuffer *takeRetiredBuffer(uint32_t current) {
+    for (traceBuffer *buf = buffers; buf != NULL; buf = buf->next) {
+        if (buf->retired && buf->generation != current) {
+            buf->retired = 0;
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+// Called with buffersLock held once a session is written
+static void freeRetiredBuffers(void) {
+    traceBuffer **link = &buffers;
+    while (*link != NULL) {
+        traceBuffer *buf = *link;
+        if (buf->retired) {
+            *link = buf->next;
+            free(buf->events);
+            free(buf);
+        } else {
+            link = &buf->next;
+        }
+    }
+}
+
+static traceBuffer *getLocalBuffer(void) {
+    uint32_t current = atomic_load_explicit(&generation, memory_order_acquire);
+    traceBuffer *buf = localBuffer;
+    if (buf == NULL) {
+        pthread_once(&bufferKeyOnce, createBufferKey);
+        pthread_mutex_lock(&buffersLock);
+        buf = takeRetiredBuffer(current);
+        if (buf == NULL) {
+            buf = calloc(1, sizeof(traceBuffer));
+            buf->next = buffers;
+            buffers = buf;
+        }
+        pthread_mutex_unlock(&buffersLock);
+        buf->tid = (int)syscall(SYS_gettid);
+        localBuffer = buf;
+        pthread_setspecific(bufferKey, buf);
+    }
+    if (buf->generation != current) {
+        // first event of a new session, the reader is done with the old one
+        pthread_mutex_lock(&buffersLock);
+        if (buf->capacity != bufferEvents) {
+            free(buf->events);
+            buf->capacity = bufferEvents;
+            buf->events = malloc(buf->capacity * sizeof(traceEvent));
+        }
+        pthread_mutex_unlock(&buffersLock);
+        atomic_store_explicit(&buf->count, 0, memory_order_relaxed);
+        atomic_store_explicit(&buf->dropped, 0, memory_order_relaxed);
+        buf->generation = current;
+    }
+    buf->threadName = localThreadName;
+    return buf;
+}
+
+static void record(char phase, const char *name, uint64_t ts, uint64_t dur, const char *argName, int64_t arg, uint64_t id) {
+    traceBuffer *buf = getLocalBuffer();
+    size_t count = atomic_load_explicit(&buf->count, memory_order_relaxed);
+    if (count == buf->capacity) {
+        atomic_fetch_add_explicit(&buf->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    traceEvent *ev = &buf->events[count];
+    ev->phase = phase;
+    ev->name = name;
+    ev->ts = ts;
+    ev->dur = dur;
+    ev->argName = argName;
+    ev->arg = arg;
+    ev->id = id;
+    atomic_store_explicit(&buf->count, count + 1, memory_order_release);
+}
+
+uint64_t traceNow(void) {
+    return isActive() ? monotonicTimeUs() : 0;
+}
+
+void traceComplete(const char *name, uint64_t start, const char *argName, int64_t arg) {
+    if (start == 0 || !isActive())
+        return;
+    record('X', name, start, monotonicTimeUs() - start, argName, arg, 0);
+}
+
+void traceInstant(const char *name, const char *argName, int64_t arg) {
+    if (isActive())
+        record('i', name, monotonicTimeUs(), 0, argName, arg, 0);
+}
+
+void traceFlow(char phase, const char *name, uint64_t id, uint64_t ts) {
+    if (ts != 0 && isActive())
+        record(phase, name, ts, 0, NULL, 0, id);
+}
+
+void traceSetThreadName(const char *name) {
+    localThreadName = name;
+}
+
+static void writeEvent(FILE *f, const traceEvent *ev, int tid, int *first) {
+    fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"webrtc\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%d,\"tid\":%d",
+        *first ? "" : ",", ev->name, ev->phase,
+        (unsigned long long)(ev->ts - sessionStart), (int)getpid(), tid);
+    *first = 0;
+    if (ev->phase == 'X')
+        fprintf(f, ",\"dur\":%llu", (unsigned long long)ev->dur);
+    else if (ev->phase == 'i')
+        fprintf(f, ",\"s\":\"t\"");
+    else
+        fprintf(f, ",\"id\":%llu%s", (unsigned long long)ev->id, ev->phase == 'f' ? ",\"bp\":\"e\"" : "");
+    if (ev->argName)
+        fprintf(f, ",\"args\":{\"%s\":%lld}", ev->argName, (long long)ev->arg);
+    fprintf(f, "}");
+}
+
+// Returns the number of events written, or -1 if the file can't be opened
+static long writeTrace(const char *path, uint32_t session, size_t *dropped) {
+    FILE *f = fopen(path, "w");
+    long written = 0;
+    int first = 1;
+    if (f == NULL)
+        return -1;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    pthread_mutex_lock(&buffersLock);
+    for (traceBuffer *buf = buffers; buf != NULL; buf = buf->next) {
+        if (buf->generation != session)
+            continue;
+        size_t count = atomic_load_explicit(&buf->count, memory_order_acquire);
+        if (buf->threadName) {
+            fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",", (int)getpid(), buf->tid, buf->threadName);
+            first = 0;
+        }
+        for (size_t i = 0; i < count; i++)
+            writeEvent(f, &buf->events[i], buf->tid, &first);
+        written += count;
+        *dropped += atomic_load_explicit(&buf->dropped, memory_order_relaxed);
+    }
+    freeRetiredBuffers();
+    pthread_mutex_unlock(&buffersLock);
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return written;
+}
+
+JSValue startTracing(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    uint32_t events = TRACE_DEFAULT_BUFFER_EVENTS;
+    if (argc == 0 || !JS_IsString(argv[0]))
+        return JS_ThrowTypeError(ctx, "Invalid path argument");
+    if (argc > 1 && !JS_IsUndefined(argv[1])) {
+        JSValue val = JS_IsObject(argv[1]) ? JS_GetPropertyStr(ctx, argv[1], "bufferEvents") : JS_NULL;
+        int invalid = JS_IsNull(val) || (!JS_IsUndefined(val) && (!JS_IsNumber(val) || JS_ToUint32(ctx, &events, val) || events == 0));
+        JS_FreeValue(ctx, val);
+        if (invalid)
+            return JS_ThrowRangeError(ctx, "Invalid bufferEvents value");
+    }
+    if (isActive())
+        return JS_ThrowInternalError(ctx, "Tracing is already running");
+    const char *path = JS_ToCString(ctx, argv[0]);
+    free(outputPath);
+    outputPath = strdup(path);
+    JS_FreeCString(ctx, path);
+    pthread_mutex_lock(&buffersLock);
+    bufferEvents = events;
+    pthread_mutex_unlock(&buffersLock);
+    sessionStart = monotonicTimeUs();
+    traceSetThreadName("js");
+    atomic_fetch_add_explicit(&generation, 1, memory_order_release);
+    atomic_store(&active, 1);
+    return JS_UNDEFINED;
+}
+
+JSValue stopTracing(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    size_t dropped = 0;
+    if (!isActive())
+        return JS_ThrowInternalError(ctx, "Tracing is not running");
+    atomic_store(&active, 0);
+    long written = writeTrace(outputPath, atomic_load(&generation), &dropped);
+    if (written < 0)
+        return JS_ThrowInternalError(ctx, "Error writing trace file %s", outputPath);
+    JSValue stats = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, stats, "events", JS_NewFloat64(ctx, (double)written));
+    JS_SetPropertyStr(ctx, stats, "dropped", JS_NewFloat64(ctx, (double)dropped));
+    return stats;
+}
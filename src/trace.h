@@ -0,0 +1,24 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include "js-utils.h"
+#include <stdint.h>
+
+#define TRACE_DEFAULT_BUFFER_EVENTS 65536
+
+// Names and argument names must be string literals, only the pointer is kept.
+// While tracing is off every call costs one relaxed atomic load.
+
+// Start time for traceComplete, 0 while tracing is off
+uint64_t traceNow(void);
+void traceComplete(const char *name, uint64_t start, const char *argName, int64_t arg);
+void traceInstant(const char *name, const char *argName, int64_t arg);
+// Arrows between slices, phase is 's' at the source and 'f' at the target
+void traceFlow(char phase, const char *name, uint64_t id, uint64_t ts);
+// Labels the calling thread in the trace, cheap enough for any thread start
+void traceSetThreadName(const char *name);
+
+JSValue startTracing(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+JSValue stopTracing(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+
+#endif
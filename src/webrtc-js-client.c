@@ -1,10 +1,15 @@
 #include "webrtc-js-client.h"
 #include "RTCPeerConnection-js.h"
+#include "RTCPeerConnectionPool-js.h"
 #include "RTCDataChannel-js.h"
 #include "RTCDataChannelBase-js.h"
 #include "WebSocketClient-js.h"
+#include "WebSocketServer-js.h"
 #include "RTCTrack-js.h"
 #include "event-queue.h"
+#include "frame-ring.h"
+#include "logger.h"
+#include "trace.h"
 
 #define JS_DEF_FLAG(x) JS_PROP_INT32_DEF(#x, x, JS_PROP_CONFIGURABLE)
 
@@ -22,23 +27,44 @@ static const JSCFunctionListEntry webrtc_global_funcs[] = {
     JS_DEF_FLAG(RTC_CODEC_OPUS),
     JS_DEF_FLAG(RTC_CODEC_VP8),
     JS_DEF_FLAG(RTC_CODEC_VP9),
-    JS_CFUNC_DEF("createWebSocketClient", 1, createWebSocketClient)
+    JS_CFUNC_DEF("createWebSocketClient", 1, createWebSocketClient),
+    JS_CFUNC_DEF("createWebSocketServer", 1, createWebSocketServer),
+    JS_CFUNC_DEF("setNackMemoryBudget", 1, setNackMemoryBudget),
+    JS_CFUNC_DEF("getNackMemoryUsage", 0, getNackMemoryUsage),
+    JS_CFUNC_DEF("setLogLevel", 1, setLogLevel),
+    JS_CFUNC_DEF("setLogHandler", 1, setLogHandler),
+    JS_CFUNC_DEF("getLogStats", 0, getLogStats),
+    JS_CFUNC_DEF("setEventBudget", 1, setEventBudget),
+    JS_CFUNC_DEF("getEventStats", 0, getEventStats),
+    JS_CFUNC_DEF("startTracing", 2, startTracing),
+    JS_CFUNC_DEF("stopTracing", 0, stopTracing),
+    JS_CFUNC_DEF("createFrameRing", 1, createFrameRing),
+    JS_CFUNC_DEF("writeFrameRing", 3, writeFrameRing),
+    JS_CFUNC_DEF("getFrameRingStats", 1, getFrameRingStats),
+    JS_CFUNC_DEF("preload", 0, preloadWebRtc),
+    JS_CFUNC_DEF("setSctpSettings", 1, setSctpSettings)
 };
 
 static int init(JSContext *ctx, JSModuleDef *m) {
     JS_SetModuleExportList(ctx, m, webrtc_global_funcs, countof(webrtc_global_funcs));
     initFullClass(ctx, m, &RTCPeerConnection_Class);
+    initFullClass(ctx, m, &RTCPeerConnectionPool_Class);
     initFullClass(ctx, m, &RTCDataChannelBase_Class);
+    initFullSubClass(ctx, m, &RTCDataChannel_Class, RTCDataChannelBase_Class.id);
+    initFullSubClass(ctx, m, &RTCTrack_Class, RTCDataChannelBase_Class.id);
+    initFullSubClass(ctx, m, &WebSocketClient_Class, RTCDataChannelBase_Class.id);
+    initFullClass(ctx, m, &WebSocketServer_Class);
     return 0;
 }
 
 JSModuleDef *JS_INIT_WEBRTC_CLIENT_MODULE(JSContext *ctx, const char *module_name) {
     JSModuleDef *m;
-    rtcInitLogger(RTC_LOG_DEBUG, NULL);
+    initLogger();
     m = JS_NewCModule(ctx, module_name, init);
     if (!m) return NULL;
     initEventQueue(ctx);
     JS_AddModuleExportList(ctx, m, webrtc_global_funcs, countof(webrtc_global_funcs));
     JS_AddModuleExport(ctx, m, RTCPeerConnection_Class.def.class_name);
+    JS_AddModuleExport(ctx, m, RTCPeerConnectionPool_Class.def.class_name);
     return m;
 }
\ No newline at end of file
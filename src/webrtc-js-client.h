@@ -1,10 +1,9 @@
 #ifndef WEBRTC_JS_CLIENT_H
 #define WEBRTC_JS_CLIENT_H
 
-#define JS_SHARED_LIBRARY
-
 #include "js-utils.h"
 
+// JS_SHARED_LIBRARY is set by the build for the shared library target only
 #ifdef JS_SHARED_LIBRARY
 #define JS_INIT_WEBRTC_CLIENT_MODULE js_init_module
 #else
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+#include "h264-utils.h"
+#include "test-utils.h"
+
+#define MAX_FRAGMENT_SIZE 100
+#define NAL_HEADER 0x65 // IDR slice, NRI 3
+
+typedef struct {
+    uint8_t nal[1024];
+    size_t nalLen;
+    uint32_t payloads;
+    int fragmented;
+} reassembly;
+
+// Builds one access unit holding a single NAL unit of the given size, in
+// either framing. Start sequence payload bytes never contain a zero.
+static size_t buildFrame(uint8_t *buf, size_t nalLen, rtcNalUnitSeparator separator) {
+    size_t pos = 0;
+    if (separator == RTC_NAL_SEPARATOR_LENGTH) {
+        buf[pos++] = (uint8_t)(nalLen >> 24);
+        buf[pos++] = (uint8_t)(nalLen >> 16);
+        buf[pos++] = (uint8_t)(nalLen >> 8);
+        buf[pos++] = (uint8_t)nalLen;
+    } else {
+        static const uint8_t startSequence[] = { 0, 0, 0, 1 };
+        memcpy(buf, startSequence, sizeof(startSequence));
+        pos += sizeof(startSequence);
+    }
+    buf[pos] = NAL_HEADER;
+    for (size_t i = 1; i < nalLen; i++)
+        buf[pos + i] = (uint8_t)(i % 251 + 1);
+    return pos + nalLen;
+}
+
+static void collectPayload(const uint8_t *prefix, size_t prefixLen,
+    const uint8_t *payload, size_t len, void *opaque)
+{
+    reassembly *r = opaque;
+    CHECK(prefixLen + len <= MAX_FRAGMENT_SIZE);
+    r->payloads++;
+    if (prefixLen == 0) {
+        CHECK_EQ(r->nalLen, 0);
+        memcpy(r->nal, payload, len);
+        r->nalLen = len;
+        return;
+    }
+    CHECK_EQ(prefixLen, 2);
+    CHECK_EQ(prefix[0], (NAL_HEADER & 0xe0) | 28);
+    CHECK_EQ(prefix[1] & 0x1f, NAL_HEADER & 0x1f);
+    CHECK_EQ(!!(prefix[1] & 0x80), r->nalLen == 0);
+    r->fragmented = 1;
+    if (r->nalLen == 0)
+        r->nal[r->nalLen++] = (prefix[0] & 0xe0) | (prefix[1] & 0x1f);
+    memcpy(r->nal + r->nalLen, payload, len);
+    r->nalLen += len;
+    if (prefix[1] & 0x40)
+        CHECK(r->nalLen > MAX_FRAGMENT_SIZE);
+}
+
+static void checkNalUnit(size_t nalLen, uint32_t expectedPackets, rtcNalUnitSeparator separator) {
+    uint8_t buf[1024 + 4];
+    size_t len = buildFrame(buf, nalLen, separator);
+    const uint8_t *nal = buf + len - nalLen;
+    reassembly r = { .nalLen = 0, .payloads = 0, .fragmented = 0 };
+    CHECK_EQ(h264CountRtpPackets(buf, len, separator, MAX_FRAGMENT_SIZE), expectedPackets);
+    h264ForEachRtpPayload(buf, len, separator, MAX_FRAGMENT_SIZE, collectPayload, &r);
+    CHECK_EQ(r.payloads, expectedPackets);
+    CHECK_EQ(r.fragmented, expectedPackets > 1);
+    CHECK_EQ(r.nalLen, nalLen);
+    CHECK(memcmp(r.nal, nal, nalLen) == 0);
+}
+
+int main(void) {
+    static const rtcNalUnitSeparator separators[] = {
+        RTC_NAL_SEPARATOR_LENGTH, RTC_NAL_SEPARATOR_LONG_START_SEQUENCE
+    };
+    for (size_t i = 0; i < sizeof(separators) / sizeof(separators[0]); i++) {
+        // Fragments carry MAX_FRAGMENT_SIZE - 2 bytes after the NAL header
+        checkNalUnit(1, 1, separators[i]);
+        checkNalUnit(MAX_FRAGMENT_SIZE - 1, 1, separators[i]);
+        checkNalUnit(MAX_FRAGMENT_SIZE, 1, separators[i]);
+        checkNalUnit(MAX_FRAGMENT_SIZE + 1, 2, separators[i]);
+        checkNalUnit(1 + 2 * (MAX_FRAGMENT_SIZE - 2), 2, separators[i]);
+        checkNalUnit(2 + 2 * (MAX_FRAGMENT_SIZE - 2), 3, separators[i]);
+        checkNalUnit(1 + 10 * (MAX_FRAGMENT_SIZE - 2), 10, separators[i]);
+    }
+
+    // Two NAL units in one access unit, one of them fragmented
+    uint8_t buf[2 * (1024 + 4)];
+    size_t len = buildFrame(buf, 50, RTC_NAL_SEPARATOR_LONG_START_SEQUENCE);
+    len += buildFrame(buf + len, 250, RTC_NAL_SEPARATOR_LONG_START_SEQUENCE);
+    CHECK_EQ(h264CountRtpPackets(buf, len, RTC_NAL_SEPARATOR_LONG_START_SEQUENCE, MAX_FRAGMENT_SIZE), 4);
+
+    if (testFailures)
+        fprintf(stderr, "%d checks failed\n", testFailures);
+    return testFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
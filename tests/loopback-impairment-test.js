@@ -0,0 +1,85 @@
+import * as std from "std";
+import * as os from "os";
+
+// Connects two peers inside the process, the answerer behind a seeded
+// testNetwork, and checks that two runs with the same seed lose and reorder
+// the same messages. Takes the path of libqjsWebRtcClient.so.
+
+const MESSAGES = 500;
+const TIMEOUT_MS = 20000;
+const testNetwork = { lossPct: 20, reorderPct: 10, delayMs: 5, jitterMs: 2, seed: 1234 };
+
+function fail(message) {
+    console.log(message);
+    std.exit(1);
+}
+
+function impairedRun(RTCPeerConnection) {
+    return new Promise((resolve) => {
+        const offerer = new RTCPeerConnection();
+        const answerer = new RTCPeerConnection({ testNetwork });
+        const received = [];
+        const started = Date.now();
+
+        answerer.ondatachannel = (channel) => {
+            channel.onmessage = (msg) => received.push(Number(msg));
+        };
+        answerer.onicegatheringstatechange = (state) => {
+            if (state == "complete")
+                offerer.setRemoteDescription(answerer.localDescription);
+        };
+        offerer.onicegatheringstatechange = (state) => {
+            if (state == "complete") {
+                answerer.setRemoteDescription(offerer.localDescription);
+                answerer.createAnswer();
+            }
+        };
+
+        function waitForLink() {
+            const stats = answerer.testNetworkStats;
+            if (Date.now() - started > TIMEOUT_MS)
+                fail(`Timed out with ${JSON.stringify(stats)}`);
+            if (stats.received < MESSAGES || stats.queued > 0) {
+                os.setTimeout(waitForLink, 10);
+                return;
+            }
+            channel.close();
+            offerer.close();
+            answerer.close();
+            resolve({ stats, received });
+        }
+
+        const channel = offerer.createDataChannel('impaired');
+        channel.onopen = () => {
+            for (let i = 0; i < MESSAGES; i++)
+                channel.send(String(i));
+            waitForLink();
+        };
+        offerer.createOffer();
+    });
+}
+
+function compareRuns(first, second) {
+    const { stats } = first;
+    if (stats.received != MESSAGES || stats.lost + stats.delivered + stats.overflowed != MESSAGES)
+        fail(`Unexpected counts ${JSON.stringify(stats)}`);
+    if (stats.lost == 0 || stats.reordered == 0)
+        fail(`The link neither lost nor reordered anything: ${JSON.stringify(stats)}`);
+    if (first.received.length != stats.delivered)
+        fail(`${first.received.length} messages reached the channel, ${stats.delivered} were delivered`);
+    for (const key of ["lost", "reordered", "delivered", "overflowed"]) {
+        if (first.stats[key] != second.stats[key])
+            fail(`${key}: ${first.stats[key]} then ${second.stats[key]} with the same seed`);
+    }
+    const sorted = (run) => run.received.slice().sort((a, b) => a - b).join();
+    if (sorted(first) != sorted(second))
+        fail("The same seed delivered different messages");
+}
+
+import(scriptArgs[1]).then(async ({ RTCPeerConnection }) => {
+    const first = await impairedRun(RTCPeerConnection);
+    const second = await impairedRun(RTCPeerConnection);
+    compareRuns(first, second);
+    console.log(`lost ${first.stats.lost}, reordered ${first.stats.reordered}, delivered ${first.stats.delivered} in both runs`);
+    std.exit(0);
+}).catch((e) => fail(`${e}\n${e.stack}`));
@@ -0,0 +1,101 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "net-impairment.h"
+#include "test-utils.h"
+
+#define MESSAGES 2000
+#define SEED 1234
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint8_t delivered[MESSAGES];
+    uint32_t count;
+} deliveries;
+
+typedef struct {
+    netImpairmentStats stats;
+    uint8_t delivered[MESSAGES];
+} run;
+
+// The timer wheel labels its thread for tracing, which would pull in QuickJS
+void traceSetThreadName(const char *name) {
+    (void)name;
+}
+
+static void recordDelivery(const char *message, int size, void *opaque) {
+    deliveries *d = opaque;
+    uint32_t index;
+    CHECK_EQ(size, sizeof(index));
+    memcpy(&index, message, sizeof(index));
+    pthread_mutex_lock(&d->lock);
+    if (index < MESSAGES)
+        d->delivered[index]++;
+    d->count++;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static void impairedRun(const netImpairmentConfig *config, run *result) {
+    deliveries d = { .lock = PTHREAD_MUTEX_INITIALIZER, .count = 0 };
+    netImpairment *ni = netImpairmentCreate(config);
+    memset(d.delivered, 0, sizeof(d.delivered));
+    for (uint32_t i = 0; i < MESSAGES; i++)
+        netImpairmentSubmit(ni, (const char *)&i, sizeof(i), recordDelivery, &d);
+    // every message is due within delay + jitter, give it plenty more
+    for (int waitMs = 0; waitMs < 2000; waitMs++) {
+        netImpairmentGetStats(ni, &result->stats);
+        if (result->stats.queued == 0)
+            break;
+        usleep(1000);
+    }
+    netImpairmentCancel(ni, &d);
+    netImpairmentGetStats(ni, &result->stats);
+    netImpairmentRelease(ni);
+    pthread_mutex_lock(&d.lock);
+    memcpy(result->delivered, d.delivered, sizeof(d.delivered));
+    CHECK_EQ(d.count, result->stats.delivered);
+    pthread_mutex_unlock(&d.lock);
+}
+
+int main(void) {
+    netImpairmentConfig config = {
+        .lossPct = 20,
+        .reorderPct = 10,
+        .delayMs = 20,
+        .jitterMs = 5,
+        .seed = SEED,
+    };
+    static run first, second, other;
+    impairedRun(&config, &first);
+    impairedRun(&config, &second);
+
+    CHECK_EQ(first.stats.received, MESSAGES);
+    CHECK_EQ(first.stats.queued, 0);
+    CHECK_EQ(first.stats.overflowed, 0);
+    CHECK_EQ(first.stats.lost + first.stats.delivered, MESSAGES);
+    // 20% loss and 10% reordering of the rest, with a wide margin
+    CHECK(first.stats.lost > MESSAGES / 10 && first.stats.lost < MESSAGES * 3 / 10);
+    CHECK(first.stats.reordered > MESSAGES / 20 && first.stats.reordered < MESSAGES * 3 / 20);
+
+    // The same seed drops and reorders the same messages
+    CHECK_EQ(second.stats.lost, first.stats.lost);
+    CHECK_EQ(second.stats.reordered, first.stats.reordered);
+    CHECK_EQ(second.stats.delivered, first.stats.delivered);
+    CHECK(memcmp(second.delivered, first.delivered, MESSAGES) == 0);
+    for (uint32_t i = 0; i < MESSAGES; i++)
+        CHECK(first.delivered[i] <= 1);
+
+    config.seed = SEED + 1;
+    impairedRun(&config, &other);
+    CHECK(memcmp(other.delivered, first.delivered, MESSAGES) != 0);
+
+    config = (netImpairmentConfig) { .lossPct = 100, .seed = SEED };
+    impairedRun(&config, &other);
+    CHECK_EQ(other.stats.lost, MESSAGES);
+    CHECK_EQ(other.stats.delivered, 0);
+
+    if (testFailures)
+        fprintf(stderr, "%d checks failed\n", testFailures);
+    return testFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
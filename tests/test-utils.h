@@ -0,0 +1,23 @@
+#ifndef __TEST_UTILS_H
+#define __TEST_UTILS_H
+
+#include <stdio.h>
+
+static int testFailures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        testFailures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+    long long _a = (long long)(actual), _e = (long long)(expected); \
+    if (_a != _e) { \
+        fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _a, _e); \
+        testFailures++; \
+    } \
+} while (0)
+
+#endif